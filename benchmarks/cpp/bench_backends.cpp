@@ -0,0 +1,68 @@
+// Native SIMD backend against the OpenCL CPU and GPU runtimes on the host
+// (float *) interface, so copies to and from the device are included.
+//
+// Usage: bench_backends [--devices native,cpu,gpu] [--min-size 128] [--max-size 2048]
+#include "bench_common.hpp"
+#include <memory>
+
+int main(int argc, char **argv)
+{
+	int min_size = bench::int_arg(argc, argv, "--min-size", 128);
+	int max_size = bench::int_arg(argc, argv, "--max-size", 2048);
+
+	std::vector<std::string> devices = bench::list_arg(argc, argv, "--devices", "native,cpu,gpu");
+
+	struct Case
+	{
+		const char *name;
+		operation_types op_type;
+		bool binary;
+	};
+	const Case cases[] = {{"matmul", operation_types::MATRIX_MULTIPLICATION, true},
+						  {"add", operation_types::ELEM_WISE_ADD, true},
+						  {"transpose", operation_types::TRANSPOSE, false},
+						  {"frobenius", operation_types::FROBENIUS_NORM, false},
+						  {"determinant", operation_types::DETERMINANT, false},
+						  {"inverse", operation_types::INVERSE, false}};
+
+	NativeBackend probe(1);
+	std::printf("native: %s, %u threads\n", probe.instruction_set_name(), NativeBackend().thread_count());
+
+	std::printf("%12s %8s", "op", "size");
+	for (const std::string &device : devices)
+		std::printf(" %10s ms", device.c_str());
+	std::printf("\n");
+
+	std::vector<std::unique_ptr<OperationManager>> managers;
+	for (const std::string &device : devices)
+	{
+		managers.emplace_back(new OperationManager(bench::device_type(device)));
+		managers.back()->warm_up();
+	}
+
+	for (const Case &test : cases)
+	{
+		for (int n = min_size; n <= max_size; n *= 2)
+		{
+			std::vector<float> lhs = bench::random_matrix(n, n, 1);
+			std::vector<float> rhs = bench::random_matrix(n, n, 2);
+			// Diagonally dominant so determinant and inverse stay well conditioned
+			for (int i = 0; i < n; i++)
+				lhs[static_cast<size_t>(i) * n + i] += static_cast<float>(n);
+
+			std::printf("%12s %8d", test.name, n);
+			for (auto &manager : managers)
+			{
+				double seconds = bench::median_seconds([&]()
+				{
+					float *result = test.binary ? manager->multi_vector_op(test.op_type, lhs.data(), n, n, rhs.data(), n, n)
+												: manager->single_vector_op(test.op_type, lhs.data(), n, n);
+					free(result);
+				}, 0.5, 20);
+				std::printf(" %13.3f", seconds * 1e3);
+			}
+			std::printf("\n");
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,68 @@
+// Matrices per second of the batched kernels against one single-matrix op
+// per matrix, for batches of small square matrices.
+//
+// Usage: bench_batched [--device cpu|gpu] [--batch 10000] [--loop-batch 200]
+#include "bench_common.hpp"
+
+int main(int argc, char **argv)
+{
+	int batch = bench::int_arg(argc, argv, "--batch", 10000);
+	// Per-matrix calls are slow, time them on a smaller batch
+	int loop_batch = std::min(batch, bench::int_arg(argc, argv, "--loop-batch", 200));
+
+	OperationManager manager(bench::device_arg(argc, argv));
+	const operation_types ops[] = {operation_types::MATRIX_MULTIPLICATION, operation_types::DETERMINANT,
+								   operation_types::INVERSE, operation_types::TRANSPOSE};
+	const char *names[] = {"mat_mul", "determinant", "inverse", "transpose"};
+	std::printf("%12s %6s %18s %18s %9s\n", "op", "size", "per-matrix mat/s", "batched mat/s", "speedup");
+
+	for (int n = 4; n <= OperationManager::batch_max_size(); n *= 2)
+	{
+		std::vector<float> data = bench::random_matrix(batch * n, n, 1);
+		DeviceMatrix input = manager.from_host(data.data(), batch * n, n);
+		std::vector<DeviceMatrix> singles;
+		for (int m = 0; m < loop_batch; m++)
+		{
+			singles.push_back(manager.from_host(&data[static_cast<size_t>(m) * n * n], n, n));
+		}
+
+		for (size_t op = 0; op < sizeof(ops) / sizeof(ops[0]); op++)
+		{
+			bool binary = ops[op] == operation_types::MATRIX_MULTIPLICATION;
+			auto batched = [&]()
+			{
+				return binary ? manager.batched_multi_vector_op(ops[op], input, input, batch)
+							  : manager.batched_single_vector_op(ops[op], input, batch);
+			};
+			auto per_matrix = [&]()
+			{
+				for (const DeviceMatrix &single : singles)
+				{
+					DeviceMatrix result = binary ? manager.multi_vector_op(ops[op], single, single)
+												 : manager.single_vector_op(ops[op], single);
+				}
+			};
+
+			// First calls build the programs, keep them out of the timing
+			batched();
+			per_matrix();
+			manager.finish();
+
+			double batched_seconds = bench::median_seconds([&]()
+			{
+				DeviceMatrix result = batched();
+				manager.finish();
+			});
+			double loop_seconds = bench::median_seconds([&]()
+			{
+				per_matrix();
+				manager.finish();
+			});
+
+			double batched_rate = batch / batched_seconds;
+			double loop_rate = loop_batch / loop_seconds;
+			std::printf("%12s %6d %18.0f %18.0f %8.1fx\n", names[op], n, loop_rate, batched_rate, batched_rate / loop_rate);
+		}
+	}
+	return 0;
+}
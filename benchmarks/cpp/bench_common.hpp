@@ -0,0 +1,159 @@
+#ifndef BENCH_COMMON_HPP
+#define BENCH_COMMON_HPP
+
+#include "../../src/cpp/core/include/pch.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace bench
+{
+	// Uniform values in [-1, 1), seeded so runs are comparable
+	inline std::vector<float> random_matrix(int height, int width, unsigned seed = 42)
+	{
+		std::mt19937 generator(seed);
+		std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+		std::vector<float> matrix(static_cast<size_t>(height) * width);
+		for (float &value : matrix)
+		{
+			value = distribution(generator);
+		}
+		return matrix;
+	}
+
+	// Repeats fn until min_seconds have elapsed (at least once, at most max_repeats
+	// times) and returns the median seconds per call
+	template <typename Fn>
+	double median_seconds(Fn &&fn, double min_seconds = 1.0, int max_repeats = 100)
+	{
+		std::vector<double> times;
+		double total = 0.0;
+		while (times.empty() || (total < min_seconds && static_cast<int>(times.size()) < max_repeats))
+		{
+			auto start = std::chrono::steady_clock::now();
+			fn();
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			times.push_back(elapsed.count());
+			total += elapsed.count();
+		}
+		std::sort(times.begin(), times.end());
+		return times[times.size() / 2];
+	}
+
+	// First call and steady-state latencies of an operation
+	struct Timings
+	{
+		double first_seconds = 0.0;
+		std::vector<double> samples; // Calls after the first, ascending
+
+		// Nearest-rank percentile of the steady-state samples, p in [0, 100]
+		double percentile(double p) const
+		{
+			size_t rank = static_cast<size_t>(p / 100.0 * samples.size() + 0.5);
+			return samples[std::min(samples.size() - 1, rank == 0 ? 0 : rank - 1)];
+		}
+		double mean() const
+		{
+			double total = 0.0;
+			for (double sample : samples)
+				total += sample;
+			return total / samples.size();
+		}
+	};
+
+	// Times one call of fn on its own, then repeats it like median_seconds
+	template <typename Fn>
+	Timings time_calls(Fn &&fn, double min_seconds = 1.0, int max_repeats = 100)
+	{
+		Timings timings;
+		auto start = std::chrono::steady_clock::now();
+		fn();
+		std::chrono::duration<double> first = std::chrono::steady_clock::now() - start;
+		timings.first_seconds = first.count();
+
+		double total = 0.0;
+		while (timings.samples.empty() || (total < min_seconds && static_cast<int>(timings.samples.size()) < max_repeats))
+		{
+			start = std::chrono::steady_clock::now();
+			fn();
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			timings.samples.push_back(elapsed.count());
+			total += elapsed.count();
+		}
+		std::sort(timings.samples.begin(), timings.samples.end());
+		return timings;
+	}
+
+	// Value following --name on the command line, or fallback
+	inline const char *string_arg(int argc, char **argv, const char *name, const char *fallback)
+	{
+		for (int i = 1; i + 1 < argc; i++)
+		{
+			if (std::strcmp(argv[i], name) == 0)
+			{
+				return argv[i + 1];
+			}
+		}
+		return fallback;
+	}
+
+	inline int int_arg(int argc, char **argv, const char *name, int fallback)
+	{
+		const char *value = string_arg(argc, argv, name, nullptr);
+		return value ? std::atoi(value) : fallback;
+	}
+
+	// Comma separated --name a,b,c
+	inline std::vector<std::string> list_arg(int argc, char **argv, const char *name, const char *fallback)
+	{
+		std::vector<std::string> items;
+		std::string value = string_arg(argc, argv, name, fallback);
+		size_t start = 0;
+		while (start <= value.size())
+		{
+			size_t end = std::min(value.find(',', start), value.size());
+			if (end > start)
+				items.push_back(value.substr(start, end - start));
+			start = end + 1;
+		}
+		return items;
+	}
+
+	inline double double_arg(int argc, char **argv, const char *name, double fallback)
+	{
+		const char *value = string_arg(argc, argv, name, nullptr);
+		return value ? std::atof(value) : fallback;
+	}
+
+	inline OperationManager::device_types device_type(const std::string &device)
+	{
+		if (device == "gpu")
+			return OperationManager::device_types::GPU_DEVICE;
+		if (device == "native")
+			return OperationManager::device_types::NATIVE_CPU;
+		return OperationManager::device_types::CPU_DEVICE;
+	}
+
+	// --device cpu|gpu|native, defaulting to the CPU OpenCL runtime
+	inline OperationManager::device_types device_arg(int argc, char **argv)
+	{
+		return device_type(string_arg(argc, argv, "--device", "cpu"));
+	}
+
+	inline float max_abs_difference(const float *lhs, const float *rhs, size_t size)
+	{
+		float difference = 0.0f;
+		for (size_t i = 0; i < size; i++)
+		{
+			difference = std::max(difference, std::abs(lhs[i] - rhs[i]));
+		}
+		return difference;
+	}
+}
+
+#endif
@@ -0,0 +1,49 @@
+// Determinant scaling: blocked LU against the single work-item reference
+// kernel, which only handles n <= 16.
+//
+// Usage: bench_determinant [--device cpu|gpu] [--min-size 4] [--max-size 4096]
+#include "bench_common.hpp"
+
+int main(int argc, char **argv)
+{
+	int min_size = bench::int_arg(argc, argv, "--min-size", 4);
+	int max_size = bench::int_arg(argc, argv, "--max-size", 4096);
+
+	OperationManager manager(bench::device_arg(argc, argv));
+	std::printf("%8s %14s %14s %12s %14s\n", "size", "reference ms", "blocked LU ms", "LU GF/s", "|diff|");
+
+	for (int n = min_size; n <= max_size; n *= 2)
+	{
+		std::vector<float> data = bench::random_matrix(n, n, 1);
+		DeviceMatrix input = manager.from_host(data.data(), n, n);
+		// LU performs about 2/3 n^3 flops
+		double flops = 2.0 / 3.0 * n * n * static_cast<double>(n);
+
+		auto run = [&](OperationManager::kernel_variants variant, float &determinant)
+		{
+			manager.set_kernel_variant(operation_types::DETERMINANT, variant);
+			// First call builds the programs, keep it out of the timing
+			manager.single_vector_op(operation_types::DETERMINANT, input).to_host(&determinant);
+			return bench::median_seconds([&]()
+			{
+				DeviceMatrix result = manager.single_vector_op(operation_types::DETERMINANT, input);
+				manager.finish();
+			});
+		};
+
+		float lu_determinant = 0.0f;
+		double lu_seconds = run(OperationManager::kernel_variants::OPTIMIZED, lu_determinant);
+		if (n <= 16)
+		{
+			float reference_determinant = 0.0f;
+			double reference_seconds = run(OperationManager::kernel_variants::REFERENCE, reference_determinant);
+			std::printf("%8d %14.3f %14.3f %12.2f %14.3g\n", n, reference_seconds * 1e3, lu_seconds * 1e3, flops / lu_seconds * 1e-9,
+						std::fabs(lu_determinant - reference_determinant));
+		}
+		else
+		{
+			std::printf("%8d %14s %14.3f %12.2f %14s\n", n, "-", lu_seconds * 1e3, flops / lu_seconds * 1e-9, "-");
+		}
+	}
+	return 0;
+}
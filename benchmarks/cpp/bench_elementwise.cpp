@@ -0,0 +1,75 @@
+// Bandwidth of the elementwise kernels specialized through -D options (by
+// broadcast pattern, then with the sizes compiled in) against the generic
+// kernel that indexes rhs with row % rheight and col % rwidth. Same-shape
+// operands run the flat float4/float8 kernel. --peak-gbps is the device's
+// theoretical memory bandwidth, which OpenCL does not report; when given, the
+// best figure of each row is also shown as a share of it.
+//
+// Usage: bench_elementwise [--device cpu|gpu] [--min-size 256] [--max-size 8192] [--peak-gbps 0]
+#include "bench_common.hpp"
+
+int main(int argc, char **argv)
+{
+	int min_size = bench::int_arg(argc, argv, "--min-size", 256);
+	int max_size = bench::int_arg(argc, argv, "--max-size", 8192);
+	double peak_gbps = bench::double_arg(argc, argv, "--peak-gbps", 0.0);
+
+	OperationManager manager(bench::device_arg(argc, argv));
+	std::printf("%8s %-8s %14s %18s %14s %8s %12s\n", "size", "rhs", "generic GB/s", "specialized GB/s", "fixed GB/s", "% peak",
+				"max |diff|");
+
+	for (int n = min_size; n <= max_size; n *= 2)
+	{
+		std::vector<float> lhs_data = bench::random_matrix(n, n, 1);
+		DeviceMatrix lhs = manager.from_host(lhs_data.data(), n, n);
+
+		struct RhsShape
+		{
+			const char *name;
+			int height;
+			int width;
+		};
+		const RhsShape rhs_shapes[] = {{"full", n, n}, {"row", 1, n}, {"column", n, 1}};
+		for (const RhsShape &shape : rhs_shapes)
+		{
+			std::vector<float> rhs_data = bench::random_matrix(shape.height, shape.width, 2);
+			DeviceMatrix rhs = manager.from_host(rhs_data.data(), shape.height, shape.width);
+			double bytes = sizeof(float) * (2.0 * n * static_cast<double>(n) + rhs.size());
+
+			// min_calls = 0 keeps the sizes as arguments, 1 compiles them in from the first call
+			auto run = [&](OperationManager::kernel_variants variant, size_t min_calls, std::vector<float> &output)
+			{
+				manager.set_kernel_variant(operation_types::ELEM_WISE_ADD, variant);
+				manager.set_shape_specialization(min_calls);
+				// First call builds the program, keep it out of the timing
+				DeviceMatrix warm_up = manager.multi_vector_op(operation_types::ELEM_WISE_ADD, lhs, rhs);
+				output.resize(warm_up.size());
+				warm_up.to_host(output.data());
+				double seconds = bench::median_seconds([&]()
+				{
+					DeviceMatrix sum = manager.multi_vector_op(operation_types::ELEM_WISE_ADD, lhs, rhs);
+					manager.finish();
+				});
+				return bytes / seconds * 1e-9;
+			};
+
+			std::vector<float> generic_output;
+			std::vector<float> broadcast_output;
+			std::vector<float> fixed_output;
+			double generic_gbps = run(OperationManager::kernel_variants::REFERENCE, 0, generic_output);
+			double broadcast_gbps = run(OperationManager::kernel_variants::OPTIMIZED, 0, broadcast_output);
+			double fixed_gbps = run(OperationManager::kernel_variants::OPTIMIZED, 1, fixed_output);
+
+			float diff = std::max(bench::max_abs_difference(broadcast_output.data(), generic_output.data(), generic_output.size()),
+								  bench::max_abs_difference(fixed_output.data(), generic_output.data(), generic_output.size()));
+			double best_gbps = std::max(generic_gbps, std::max(broadcast_gbps, fixed_gbps));
+			if (peak_gbps > 0.0)
+				std::printf("%8d %-8s %14.2f %18.2f %14.2f %7.1f%% %12.3g\n", n, shape.name, generic_gbps, broadcast_gbps, fixed_gbps,
+							100.0 * best_gbps / peak_gbps, diff);
+			else
+				std::printf("%8d %-8s %14.2f %18.2f %14.2f %8s %12.3g\n", n, shape.name, generic_gbps, broadcast_gbps, fixed_gbps, "-",
+							diff);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,63 @@
+// (A + B) * C - D as three ELEM_WISE_* ops against one fused expression
+// kernel. Bandwidth counts the bytes the fused kernel must move (four
+// inputs and one output) so the two columns are directly comparable.
+//
+// Usage: bench_fusion [--device cpu|gpu] [--min-size 256] [--max-size 8192]
+#include "bench_common.hpp"
+
+int main(int argc, char **argv)
+{
+	int min_size = bench::int_arg(argc, argv, "--min-size", 256);
+	int max_size = bench::int_arg(argc, argv, "--max-size", 8192);
+
+	OperationManager manager(bench::device_arg(argc, argv));
+	std::printf("%8s %16s %16s %9s %12s\n", "size", "separate GB/s", "fused GB/s", "speedup", "max |diff|");
+
+	for (int n = min_size; n <= max_size; n *= 2)
+	{
+		std::vector<DeviceMatrix> inputs;
+		for (unsigned seed = 1; seed <= 4; seed++)
+		{
+			std::vector<float> data = bench::random_matrix(n, n, seed);
+			inputs.push_back(manager.from_host(data.data(), n, n));
+		}
+		const DeviceMatrix &a = inputs[0];
+		const DeviceMatrix &b = inputs[1];
+		const DeviceMatrix &c = inputs[2];
+		const DeviceMatrix &d = inputs[3];
+		double bytes = 5.0 * sizeof(float) * n * static_cast<double>(n);
+
+		auto separate = [&]()
+		{
+			DeviceMatrix sum = manager.multi_vector_op(operation_types::ELEM_WISE_ADD, a, b);
+			DeviceMatrix product = manager.multi_vector_op(operation_types::ELEM_WISE_MUL, sum, c);
+			return manager.multi_vector_op(operation_types::ELEM_WISE_SUB, product, d);
+		};
+		auto fused = [&]()
+		{
+			return manager.evaluate((a + b) * c - d);
+		};
+
+		// First calls build the programs, keep them out of the timing
+		std::vector<float> separate_output(static_cast<size_t>(n) * n);
+		std::vector<float> fused_output(static_cast<size_t>(n) * n);
+		separate().to_host(separate_output.data());
+		fused().to_host(fused_output.data());
+
+		double separate_seconds = bench::median_seconds([&]()
+		{
+			DeviceMatrix result = separate();
+			manager.finish();
+		});
+		double fused_seconds = bench::median_seconds([&]()
+		{
+			DeviceMatrix result = fused();
+			manager.finish();
+		});
+
+		std::printf("%8d %16.2f %16.2f %8.2fx %12.3g\n", n, bytes / separate_seconds * 1e-9, bytes / fused_seconds * 1e-9,
+					separate_seconds / fused_seconds,
+					bench::max_abs_difference(fused_output.data(), separate_output.data(), fused_output.size()));
+	}
+	return 0;
+}
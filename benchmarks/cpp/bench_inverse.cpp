@@ -0,0 +1,50 @@
+// INVERSE throughput (LU factorization plus blocked substitution) and the
+// residual max |A * inverse(A) - I|, checked on the device with mat_mul.
+//
+// Usage: bench_inverse [--device cpu|gpu] [--min-size 64] [--max-size 4096]
+#include "bench_common.hpp"
+
+int main(int argc, char **argv)
+{
+	int min_size = bench::int_arg(argc, argv, "--min-size", 64);
+	int max_size = bench::int_arg(argc, argv, "--max-size", 4096);
+
+	OperationManager manager(bench::device_arg(argc, argv));
+	std::printf("%8s %12s %12s %12s %12s\n", "size", "ms", "GF/s", "matrices/s", "residual");
+
+	for (int n = min_size; n <= max_size; n *= 2)
+	{
+		// Diagonally dominant so the residual reflects the kernels, not conditioning
+		std::vector<float> data = bench::random_matrix(n, n, 1);
+		for (int i = 0; i < n; i++)
+		{
+			data[static_cast<size_t>(i) * n + i] += static_cast<float>(n);
+		}
+		DeviceMatrix input = manager.from_host(data.data(), n, n);
+		// Counted as the profiler and bench_suite count it
+		double flops = operation_flops(operation_types::INVERSE, n, n, 0);
+
+		// First call builds the programs, keep it out of the timing
+		DeviceMatrix inverse = manager.single_vector_op(operation_types::INVERSE, input);
+		double seconds = bench::median_seconds([&]()
+		{
+			DeviceMatrix result = manager.single_vector_op(operation_types::INVERSE, input);
+			manager.finish();
+		});
+
+		std::vector<float> product(static_cast<size_t>(n) * n);
+		manager.multi_vector_op(operation_types::MATRIX_MULTIPLICATION, input, inverse).to_host(product.data());
+		float residual = 0.0f;
+		for (int row = 0; row < n; row++)
+		{
+			for (int col = 0; col < n; col++)
+			{
+				float expected = row == col ? 1.0f : 0.0f;
+				residual = std::max(residual, std::abs(product[static_cast<size_t>(row) * n + col] - expected));
+			}
+		}
+
+		std::printf("%8d %12.3f %12.2f %12.2f %12.3g\n", n, seconds * 1e3, flops / seconds * 1e-9, 1.0 / seconds, residual);
+	}
+	return 0;
+}
@@ -0,0 +1,54 @@
+// GFLOP/s of the tiled GEMM kernel against the reference mat_mul kernel.
+//
+// Usage: bench_mat_mul [--device cpu|gpu] [--min-size 256] [--max-size 8192]
+//                      [--reference-max-size 8192]
+#include "bench_common.hpp"
+
+int main(int argc, char **argv)
+{
+	int min_size = bench::int_arg(argc, argv, "--min-size", 256);
+	int max_size = bench::int_arg(argc, argv, "--max-size", 8192);
+	int reference_max_size = bench::int_arg(argc, argv, "--reference-max-size", max_size);
+
+	OperationManager manager(bench::device_arg(argc, argv));
+	std::printf("%8s %16s %16s %9s %12s\n", "size", "reference GF/s", "tiled GF/s", "speedup", "max |diff|");
+
+	for (int n = min_size; n <= max_size; n *= 2)
+	{
+		std::vector<float> lhs_data = bench::random_matrix(n, n, 1);
+		std::vector<float> rhs_data = bench::random_matrix(n, n, 2);
+		DeviceMatrix lhs = manager.from_host(lhs_data.data(), n, n);
+		DeviceMatrix rhs = manager.from_host(rhs_data.data(), n, n);
+		double flops = 2.0 * n * n * static_cast<double>(n);
+
+		auto run = [&](OperationManager::kernel_variants variant, std::vector<float> &output)
+		{
+			manager.set_kernel_variant(operation_types::MATRIX_MULTIPLICATION, variant);
+			// First call builds the program, keep it out of the timing
+			DeviceMatrix warm_up = manager.multi_vector_op(operation_types::MATRIX_MULTIPLICATION, lhs, rhs);
+			output.resize(warm_up.size());
+			warm_up.to_host(output.data());
+			double seconds = bench::median_seconds([&]()
+			{
+				DeviceMatrix product = manager.multi_vector_op(operation_types::MATRIX_MULTIPLICATION, lhs, rhs);
+				manager.finish();
+			});
+			return flops / seconds * 1e-9;
+		};
+
+		std::vector<float> tiled_output;
+		std::vector<float> reference_output;
+		double tiled_gflops = run(OperationManager::kernel_variants::OPTIMIZED, tiled_output);
+		if (n <= reference_max_size)
+		{
+			double reference_gflops = run(OperationManager::kernel_variants::REFERENCE, reference_output);
+			std::printf("%8d %16.2f %16.2f %8.2fx %12.3g\n", n, reference_gflops, tiled_gflops, tiled_gflops / reference_gflops,
+						bench::max_abs_difference(tiled_output.data(), reference_output.data(), tiled_output.size()));
+		}
+		else
+		{
+			std::printf("%8d %16s %16.2f %9s %12s\n", n, "-", tiled_gflops, "-", "-");
+		}
+	}
+	return 0;
+}
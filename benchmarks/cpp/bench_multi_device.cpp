@@ -0,0 +1,59 @@
+// GEMM and elementwise add on each OpenCL device alone against the row-panel
+// split across all of them.
+//
+// Usage: bench_multi_device [--min-size 512] [--max-size 4096]
+#include "bench_common.hpp"
+
+int main(int argc, char **argv)
+{
+	int min_size = bench::int_arg(argc, argv, "--min-size", 512);
+	int max_size = bench::int_arg(argc, argv, "--max-size", 4096);
+
+	DeviceManager devices;
+	for (size_t i = 0; i < devices.device_count(); i++)
+	{
+		std::printf("device %zu: %s (%s)\n", i, devices.device(i).name.c_str(), devices.device(i).platform_name.c_str());
+		devices.manager(i).warm_up({operation_types::MATRIX_MULTIPLICATION, operation_types::ELEM_WISE_ADD});
+	}
+
+	std::printf("%10s %8s", "op", "size");
+	for (size_t i = 0; i < devices.device_count(); i++)
+		std::printf(" %9s %zu", "device", i);
+	std::printf(" %11s %12s\n", "split", "max |diff|");
+
+	for (operation_types op_type : {operation_types::MATRIX_MULTIPLICATION, operation_types::ELEM_WISE_ADD})
+	{
+		bool gemm = op_type == operation_types::MATRIX_MULTIPLICATION;
+		for (int n = min_size; n <= max_size; n *= 2)
+		{
+			std::vector<float> lhs = bench::random_matrix(n, n, 1);
+			std::vector<float> rhs = bench::random_matrix(n, n, 2);
+			double work = gemm ? 2.0 * n * n * static_cast<double>(n) : static_cast<double>(n) * n;
+			const char *unit = gemm ? "GF/s" : "Ge/s";
+
+			std::printf("%10s %8d", gemm ? "matmul" : "add", n);
+			float *single = nullptr;
+			for (size_t i = 0; i < devices.device_count(); i++)
+			{
+				double seconds = bench::median_seconds([&]()
+				{
+					free(single);
+					single = devices.manager(i).multi_vector_op(op_type, lhs.data(), n, n, rhs.data(), n, n);
+				}, 0.5, 20);
+				std::printf(" %6.1f %s", work / seconds * 1e-9, unit);
+			}
+
+			float *split = nullptr;
+			double seconds = bench::median_seconds([&]()
+			{
+				free(split);
+				split = devices.multi_vector_op(op_type, lhs.data(), n, n, rhs.data(), n, n);
+			}, 0.5, 20);
+			std::printf(" %6.1f %s %12.3g\n", work / seconds * 1e-9, unit,
+						bench::max_abs_difference(split, single, static_cast<size_t>(n) * n));
+			free(single);
+			free(split);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,245 @@
+// Sweeps every operation_types kernel over matrix sizes and shapes on each
+// device type. Reports the first call (program builds, buffer creation) apart
+// from steady-state latency percentiles and throughput, and writes everything
+// as JSON so runs can be compared across releases.
+//
+// Host mode times the float * interface including transfers, device mode the
+// DeviceMatrix interface on resident inputs up to finish(). Each (op, shape,
+// mode) runs on a fresh OperationManager with the on-disk binary cache off, so
+// the first call always compiles its programs; the builds and binary loads it
+// did are recorded next to first_call_ms.
+//
+// Usage: bench_suite [--devices cpu,gpu] [--sizes 64,256,1024] [--ops all|MATRIX_MULTIPLICATION,...]
+//                    [--min-seconds 0.25] [--max-repeats 50] [--json bench_results.json]
+#include "bench_common.hpp"
+#include <ctime>
+#include <fstream>
+#include <memory>
+
+namespace
+{
+	const operation_types all_operations[] = {
+		operation_types::ELEM_WISE_ADD, operation_types::ELEM_WISE_SUB, operation_types::ELEM_WISE_DIV,
+		operation_types::ELEM_WISE_MUL, operation_types::MATRIX_MULTIPLICATION, operation_types::DETERMINANT,
+		operation_types::FROBENIUS_NORM, operation_types::TRACE, operation_types::INVERSE,
+		operation_types::TRANSPOSE, operation_types::LU_DECOMPOSITION};
+
+	struct Shape
+	{
+		int height;
+		int width;
+		int rhs_height; // 0 for single-matrix ops
+		int rhs_width;
+	};
+
+	struct Result
+	{
+		std::string device;
+		std::string op;
+		std::string mode;
+		Shape shape;
+		bench::Timings timings;
+		double flops;
+		size_t bytes;
+		size_t program_builds; // Over all timed calls, which only the first should cause
+		size_t binary_loads;
+	};
+
+	// Nothing cached in memory or on disk, so the first call is a cold build
+	std::unique_ptr<OperationManager> fresh_manager(const std::string &device)
+	{
+		std::unique_ptr<OperationManager> manager(new OperationManager(bench::device_type(device)));
+		manager->set_binary_cache_dir("");
+		return manager;
+	}
+
+	bool is_binary(operation_types op_type)
+	{
+		return op_type == operation_types::ELEM_WISE_ADD || op_type == operation_types::ELEM_WISE_SUB ||
+			   op_type == operation_types::ELEM_WISE_DIV || op_type == operation_types::ELEM_WISE_MUL ||
+			   op_type == operation_types::MATRIX_MULTIPLICATION;
+	}
+
+	// Square n x n plus one non-square shape per op where the op allows it
+	std::vector<Shape> shapes_for(operation_types op_type, int n)
+	{
+		switch (op_type)
+		{
+		case operation_types::MATRIX_MULTIPLICATION:
+			return {{n, n, n, n}, {4 * n, std::max(1, n / 4), std::max(1, n / 4), n}};
+		case operation_types::ELEM_WISE_ADD:
+		case operation_types::ELEM_WISE_SUB:
+		case operation_types::ELEM_WISE_DIV:
+		case operation_types::ELEM_WISE_MUL:
+			return {{n, n, n, n}, {n, n, 1, n}}; // Second broadcasts one row
+		case operation_types::DETERMINANT:
+		case operation_types::INVERSE:
+		case operation_types::LU_DECOMPOSITION:
+			return {{n, n, 0, 0}};
+		default:
+			return {{n, n, 0, 0}, {4 * n, std::max(1, n / 4), 0, 0}};
+		}
+	}
+
+	// Memory-bound ops report GB/s, the rest GFLOP/s
+	bool reports_bandwidth(operation_types op_type)
+	{
+		return op_type != operation_types::MATRIX_MULTIPLICATION && op_type != operation_types::DETERMINANT &&
+			   op_type != operation_types::INVERSE && op_type != operation_types::LU_DECOMPOSITION;
+	}
+
+	std::string shape_string(const Shape &shape)
+	{
+		std::string text = std::to_string(shape.height) + "x" + std::to_string(shape.width);
+		if (shape.rhs_height)
+			text += "," + std::to_string(shape.rhs_height) + "x" + std::to_string(shape.rhs_width);
+		return text;
+	}
+
+	bool write_json(const std::string &path, const std::vector<Result> &results)
+	{
+		std::ofstream file(path, std::ios::trunc);
+		if (!file.is_open())
+			return false;
+
+		char timestamp[32];
+		std::time_t now = std::time(nullptr);
+		std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+		file << "{\n  \"suite\": \"blitzmat\",\n  \"timestamp\": \"" << timestamp << "\",\n  \"results\": [";
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const Result &result = results[i];
+			double median = result.timings.percentile(50);
+			file << (i ? ",\n" : "\n") << "    {\"device\": \"" << result.device << "\", \"op\": \"" << result.op
+				 << "\", \"mode\": \"" << result.mode << "\", \"shape\": [" << result.shape.height << ", " << result.shape.width
+				 << ", " << result.shape.rhs_height << ", " << result.shape.rhs_width << "]"
+				 << ", \"first_call_ms\": " << result.timings.first_seconds * 1e3
+				 << ", \"first_call_builds\": " << result.program_builds
+				 << ", \"first_call_binary_loads\": " << result.binary_loads
+				 << ", \"min_ms\": " << result.timings.samples.front() * 1e3
+				 << ", \"p50_ms\": " << median * 1e3 << ", \"p90_ms\": " << result.timings.percentile(90) * 1e3
+				 << ", \"p99_ms\": " << result.timings.percentile(99) * 1e3 << ", \"mean_ms\": " << result.timings.mean() * 1e3
+				 << ", \"samples\": " << result.timings.samples.size() << ", \"flops\": " << result.flops
+				 << ", \"bytes\": " << result.bytes << ", \"gflops\": " << result.flops / median * 1e-9
+				 << ", \"gbytes_per_second\": " << result.bytes / median * 1e-9 << "}";
+		}
+		file << "\n  ]\n}\n";
+		return static_cast<bool>(file);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	std::vector<std::string> devices = bench::list_arg(argc, argv, "--devices", "cpu,gpu");
+	std::vector<std::string> size_list = bench::list_arg(argc, argv, "--sizes", "64,256,1024");
+	std::vector<std::string> op_names = bench::list_arg(argc, argv, "--ops", "all");
+	double min_seconds = bench::double_arg(argc, argv, "--min-seconds", 0.25);
+	int max_repeats = bench::int_arg(argc, argv, "--max-repeats", 50);
+	std::string json_path = bench::string_arg(argc, argv, "--json", "bench_results.json");
+
+	std::vector<operation_types> op_types;
+	for (operation_types op_type : all_operations)
+	{
+		if (op_names.size() == 1 && op_names[0] == "all")
+			op_types.push_back(op_type);
+		else if (std::find(op_names.begin(), op_names.end(), operation_name(op_type)) != op_names.end())
+			op_types.push_back(op_type);
+	}
+
+	std::printf("%-7s %-22s %-6s %-18s %10s %7s %10s %10s %10s %12s\n", "device", "op", "mode", "shape", "first ms", "builds",
+				"p50 ms", "p90 ms", "p99 ms", "throughput");
+	std::vector<Result> results;
+	for (const std::string &device : devices)
+	{
+		try
+		{
+			fresh_manager(device);
+		}
+		catch (const std::exception &e)
+		{
+			std::printf("%-7s skipped: %s\n", device.c_str(), e.what());
+			continue;
+		}
+		bool resident = bench::device_type(device) != OperationManager::device_types::NATIVE_CPU;
+
+		for (operation_types op_type : op_types)
+		{
+			for (const std::string &size : size_list)
+			{
+				for (const Shape &shape : shapes_for(op_type, std::atoi(size.c_str())))
+				{
+					std::vector<float> lhs = bench::random_matrix(shape.height, shape.width, 1);
+					std::vector<float> rhs = bench::random_matrix(std::max(shape.rhs_height, 1), std::max(shape.rhs_width, 1), 2);
+					// Diagonally dominant so factorizations stay well conditioned, and no zero divisors
+					if (shape.height == shape.width)
+					{
+						for (int i = 0; i < shape.height; i++)
+							lhs[static_cast<size_t>(i) * shape.width + i] += static_cast<float>(shape.height);
+					}
+					for (float &value : rhs)
+						value += value < 0.0f ? -1.0f : 1.0f;
+
+					Result result;
+					result.device = device;
+					result.op = operation_name(op_type);
+					result.shape = shape;
+					result.flops = operation_flops(op_type, shape.height, shape.width, shape.rhs_width);
+					result.bytes = operation_bytes(op_type, shape.height, shape.width, shape.rhs_height, shape.rhs_width);
+
+					std::vector<std::string> modes = {"host"};
+					if (resident)
+						modes.push_back("device");
+					for (const std::string &mode : modes)
+					{
+						result.mode = mode;
+						std::unique_ptr<OperationManager> manager = fresh_manager(device);
+						if (mode == "host")
+						{
+							result.timings = bench::time_calls([&]()
+							{
+								float *output = is_binary(op_type)
+													? manager->multi_vector_op(op_type, lhs.data(), shape.height, shape.width,
+																			   rhs.data(), shape.rhs_height, shape.rhs_width)
+													: manager->single_vector_op(op_type, lhs.data(), shape.height, shape.width);
+								free(output);
+							}, min_seconds, max_repeats);
+						}
+						else
+						{
+							DeviceMatrix lhs_matrix = manager->from_host(lhs.data(), shape.height, shape.width);
+							DeviceMatrix rhs_matrix = manager->from_host(rhs.data(), std::max(shape.rhs_height, 1), std::max(shape.rhs_width, 1));
+							result.timings = bench::time_calls([&]()
+							{
+								DeviceMatrix output = is_binary(op_type) ? manager->multi_vector_op(op_type, lhs_matrix, rhs_matrix)
+																		 : manager->single_vector_op(op_type, lhs_matrix);
+								manager->finish();
+							}, min_seconds, max_repeats);
+						}
+
+						OperationManager::CacheStats stats = manager->get_cache_stats();
+						result.program_builds = stats.program_builds;
+						result.binary_loads = stats.binary_loads;
+
+						double median = result.timings.percentile(50);
+						bool bandwidth = reports_bandwidth(op_type);
+						std::printf("%-7s %-22s %-6s %-18s %10.3f %7zu %10.3f %10.3f %10.3f %7.2f %s\n", device.c_str(), result.op.c_str(),
+									mode.c_str(), shape_string(shape).c_str(), result.timings.first_seconds * 1e3, result.program_builds,
+									median * 1e3,
+									result.timings.percentile(90) * 1e3, result.timings.percentile(99) * 1e3,
+									(bandwidth ? result.bytes : result.flops) / median * 1e-9, bandwidth ? "GB/s" : "GF/s");
+						results.push_back(result);
+					}
+				}
+			}
+		}
+	}
+
+	if (!write_json(json_path, results))
+	{
+		std::fprintf(stderr, "Could not write %s\n", json_path.c_str());
+		return 1;
+	}
+	std::printf("Wrote %zu results to %s\n", results.size(), json_path.c_str());
+	return 0;
+}
@@ -0,0 +1,54 @@
+// Effective bandwidth (bytes read + written per second) of the tiled and
+// in-place transpose kernels against the reference transpose kernel.
+//
+// Usage: bench_transpose [--device cpu|gpu] [--min-size 256] [--max-size 8192]
+#include "bench_common.hpp"
+
+int main(int argc, char **argv)
+{
+	int min_size = bench::int_arg(argc, argv, "--min-size", 256);
+	int max_size = bench::int_arg(argc, argv, "--max-size", 8192);
+
+	OperationManager manager(bench::device_arg(argc, argv));
+	std::printf("%8s %16s %16s %16s %12s\n", "size", "reference GB/s", "tiled GB/s", "in-place GB/s", "max |diff|");
+
+	for (int n = min_size; n <= max_size; n *= 2)
+	{
+		std::vector<float> data = bench::random_matrix(n, n, 1);
+		DeviceMatrix input = manager.from_host(data.data(), n, n);
+		double bytes = 2.0 * sizeof(float) * n * static_cast<double>(n);
+
+		auto run = [&](OperationManager::kernel_variants variant, std::vector<float> &output)
+		{
+			manager.set_kernel_variant(operation_types::TRANSPOSE, variant);
+			// First call builds the program, keep it out of the timing
+			DeviceMatrix warm_up = manager.single_vector_op(operation_types::TRANSPOSE, input);
+			output.resize(warm_up.size());
+			warm_up.to_host(output.data());
+			double seconds = bench::median_seconds([&]()
+			{
+				DeviceMatrix transposed = manager.single_vector_op(operation_types::TRANSPOSE, input);
+				manager.finish();
+			});
+			return bytes / seconds * 1e-9;
+		};
+
+		std::vector<float> reference_output;
+		std::vector<float> tiled_output;
+		double reference_gbps = run(OperationManager::kernel_variants::REFERENCE, reference_output);
+		double tiled_gbps = run(OperationManager::kernel_variants::OPTIMIZED, tiled_output);
+
+		// Each in-place call flips the matrix back, the timing does not depend on its contents
+		manager.transpose_in_place(input);
+		manager.finish();
+		double in_place_seconds = bench::median_seconds([&]()
+		{
+			manager.transpose_in_place(input);
+			manager.finish();
+		});
+
+		std::printf("%8d %16.2f %16.2f %16.2f %12.3g\n", n, reference_gbps, tiled_gbps, bytes / in_place_seconds * 1e-9,
+					bench::max_abs_difference(tiled_output.data(), reference_output.data(), tiled_output.size()));
+	}
+	return 0;
+}
@@ -2,12 +2,284 @@
 #include <Python.h>
 #include "operation_manager.hpp"
 #include <numpy/arrayobject.h>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
 
 typedef struct
 {
     PyObject_HEAD OperationManager *op_manager;
 } PyOperationManager;
 
+typedef struct
+{
+    PyObject_HEAD DeviceMatrix *matrix;
+    PyOperationManager *owner; // Manager the matrix came from, kept alive by this reference
+} PyDeviceMatrix;
+
+// Runs fn on self's manager with the GIL released, so other Python threads keep
+// running meanwhile, including ops on the same manager, which gives each
+// calling thread its own command queue. fn must not touch Python objects. A C++ exception becomes a RuntimeError and false is returned.
+template <typename Function>
+static bool
+run_without_gil(PyOperationManager *self, Function fn)
+{
+    std::string error;
+    bool failed = false;
+    Py_BEGIN_ALLOW_THREADS
+    try
+    {
+        fn(*self->op_manager);
+    }
+    catch (const std::exception &e)
+    {
+        error = e.what();
+        failed = true;
+    }
+    Py_END_ALLOW_THREADS
+    if (failed)
+    {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+    }
+    return !failed;
+}
+
+static bool
+is_float32_format(const char *format)
+{
+    // Native or explicitly little-endian float, the only layouts the kernels read
+    return format && (strcmp(format, "f") == 0 || strcmp(format, "@f") == 0 || strcmp(format, "=f") == 0 ||
+                      strcmp(format, "<f") == 0);
+}
+
+// A C-contiguous 2-D float32 buffer borrowed from any buffer-protocol object
+// (numpy arrays, memoryviews, array.array, ...), released on destruction
+class FloatBuffer
+{
+public:
+    FloatBuffer() {}
+    FloatBuffer(const FloatBuffer &) = delete;
+    FloatBuffer &operator=(const FloatBuffer &) = delete;
+    ~FloatBuffer()
+    {
+        if (held)
+            PyBuffer_Release(&view);
+    }
+
+    // Sets a TypeError and returns false when object is not such a buffer
+    bool acquire(PyObject *object, bool writable, const char *name)
+    {
+        int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | (writable ? PyBUF_WRITABLE : 0);
+        if (PyObject_GetBuffer(object, &view, flags) != 0)
+        {
+            PyErr_Format(PyExc_TypeError, "%s must be a C-contiguous%s float32 buffer", name, writable ? " writable" : "");
+            return false;
+        }
+        held = true;
+        if (view.ndim != 2 || view.itemsize != sizeof(float) || !is_float32_format(view.format))
+        {
+            PyErr_Format(PyExc_TypeError, "%s must be a 2-D float32 buffer", name);
+            return false;
+        }
+        return true;
+    }
+
+    float *data() const { return static_cast<float *>(view.buf); }
+    int height() const { return static_cast<int>(view.shape[0]); }
+    int width() const { return static_cast<int>(view.shape[1]); }
+    // Whether both buffers are held and share any bytes
+    bool overlaps(const FloatBuffer &other) const
+    {
+        if (!held || !other.held)
+            return false;
+        uintptr_t begin = reinterpret_cast<uintptr_t>(view.buf);
+        uintptr_t other_begin = reinterpret_cast<uintptr_t>(other.view.buf);
+        return begin < other_begin + static_cast<uintptr_t>(other.view.len) &&
+               other_begin < begin + static_cast<uintptr_t>(view.len);
+    }
+
+private:
+    Py_buffer view;
+    bool held = false;
+};
+
+// New reference to out when one was passed, otherwise to a new float32 array of shape
+static PyObject *
+output_array(PyObject *out, std::pair<int, int> shape)
+{
+    if (out && out != Py_None)
+    {
+        Py_INCREF(out);
+        return out;
+    }
+    npy_intp dims[2] = {shape.first, shape.second};
+    return PyArray_SimpleNew(2, dims, NPY_FLOAT);
+}
+
+// Borrows the writable buffer of output, which must have the result's shape
+static bool
+acquire_output(FloatBuffer &buffer, PyObject *output, std::pair<int, int> shape)
+{
+    if (!buffer.acquire(output, true, "out"))
+    {
+        return false;
+    }
+    if (buffer.height() != shape.first || buffer.width() != shape.second)
+    {
+        PyErr_Format(PyExc_ValueError, "out has shape (%d, %d) but the result is (%d, %d)", buffer.height(), buffer.width(),
+                     shape.first, shape.second);
+        return false;
+    }
+    return true;
+}
+
+// Sets a ValueError and returns false when output shares memory with one of inputs,
+// which the ops would read after writing part of the result
+static bool
+check_disjoint(const FloatBuffer &output, std::initializer_list<const FloatBuffer *> inputs)
+{
+    for (const FloatBuffer *input : inputs)
+    {
+        if (output.overlaps(*input))
+        {
+            PyErr_SetString(PyExc_ValueError, "out must not overlap the inputs");
+            return false;
+        }
+    }
+    return true;
+}
+
+static void
+PyDeviceMatrix_dealloc(PyDeviceMatrix *self)
+{
+    if (self->matrix)
+    {
+        // Returning the buffer may wait on the manager's pool, which another thread may be using
+        DeviceMatrix *matrix = self->matrix;
+        Py_BEGIN_ALLOW_THREADS
+        delete matrix;
+        Py_END_ALLOW_THREADS
+    }
+    Py_XDECREF(self->owner);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+// Reads the matrix into a (height, width) float32 array, out= when given
+static PyObject *
+PyDeviceMatrix_to_host(PyDeviceMatrix *self, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = {"out", NULL};
+    PyObject *out_object = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", const_cast<char **>(keywords), &out_object))
+    {
+        return NULL;
+    }
+
+    std::pair<int, int> shape(self->matrix->height(), self->matrix->width());
+    PyObject *result = output_array(out_object, shape);
+    if (result == NULL)
+    {
+        return NULL;
+    }
+    FloatBuffer output;
+    if (!acquire_output(output, result, shape))
+    {
+        Py_DECREF(result);
+        return NULL;
+    }
+
+    const DeviceMatrix *matrix = self->matrix;
+    float *data = output.data();
+    if (!run_without_gil(self->owner, [&](OperationManager &)
+                         { matrix->to_host(data); }))
+    {
+        Py_DECREF(result);
+        return NULL;
+    }
+    return result;
+}
+
+static PyObject *
+PyDeviceMatrix_get_shape(PyDeviceMatrix *self, void *closure)
+{
+    return Py_BuildValue("(ii)", self->matrix->height(), self->matrix->width());
+}
+
+static PyMethodDef PyDeviceMatrix_methods[] = {
+    {"to_host", (PyCFunction)PyDeviceMatrix_to_host, METH_VARARGS | METH_KEYWORDS,
+     "Copy the matrix back into a numpy array, or into out="},
+    {NULL} /* Sentinel */
+};
+
+static PyGetSetDef PyDeviceMatrix_getset[] = {
+    {"shape", (getter)PyDeviceMatrix_get_shape, NULL, "(height, width) of the matrix", NULL},
+    {NULL} /* Sentinel */
+};
+
+static PyTypeObject PyDeviceMatrixType = {
+    PyVarObject_HEAD_INIT(NULL, 0) "opencl_ops.DeviceMatrix", /* tp_name */
+    sizeof(PyDeviceMatrix),                                   /* tp_basicsize */
+    0,                                                        /* tp_itemsize */
+    (destructor)PyDeviceMatrix_dealloc,                       /* tp_dealloc */
+    0,                                                        /* tp_print */
+    0,                                                        /* tp_getattr */
+    0,                                                        /* tp_setattr */
+    0,                                                        /* tp_reserved */
+    0,                                                        /* tp_repr */
+    0,                                                        /* tp_as_number */
+    0,                                                        /* tp_as_sequence */
+    0,                                                        /* tp_as_mapping */
+    0,                                                        /* tp_hash  */
+    0,                                                        /* tp_call */
+    0,                                                        /* tp_str */
+    0,                                                        /* tp_getattro */
+    0,                                                        /* tp_setattro */
+    0,                                                        /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                                       /* tp_flags */
+    "Matrix resident in OpenCL device memory",                /* tp_doc */
+    0,                                                        /* tp_traverse */
+    0,                                                        /* tp_clear */
+    0,                                                        /* tp_richcompare */
+    0,                                                        /* tp_weaklistoffset */
+    0,                                                        /* tp_iter */
+    0,                                                        /* tp_iternext */
+    PyDeviceMatrix_methods,                                   /* tp_methods */
+    0,                                                        /* tp_members */
+    PyDeviceMatrix_getset,                                    /* tp_getset */
+};
+
+// Wraps matrix in a Python DeviceMatrix that keeps owner alive
+static PyObject *
+wrap_device_matrix(PyOperationManager *owner, std::unique_ptr<DeviceMatrix> matrix)
+{
+    PyDeviceMatrix *wrapped = PyObject_New(PyDeviceMatrix, &PyDeviceMatrixType);
+    if (wrapped == NULL)
+    {
+        return NULL;
+    }
+    Py_INCREF(owner);
+    wrapped->owner = owner;
+    wrapped->matrix = matrix.release();
+    return (PyObject *)wrapped;
+}
+
+// Sets a ValueError and returns false when matrix (a DeviceMatrix) came from another
+// manager, whose buffers belong to a different OpenCL context
+static bool
+check_owner(PyOperationManager *self, PyObject *matrix, const char *name)
+{
+    if (((PyDeviceMatrix *)matrix)->owner != self)
+    {
+        PyErr_Format(PyExc_ValueError, "%s is a DeviceMatrix of another OperationManager", name);
+        return false;
+    }
+    return true;
+}
+
 static void
 PyOperationManager_dealloc(PyOperationManager *self)
 {
@@ -33,8 +305,10 @@ PyOperationManager_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 static int
 PyOperationManager_init(PyOperationManager *self, PyObject *args, PyObject *kwds)
 {
+    static const char *keywords[] = {"device_type", "profiling", NULL};
     const char *device_type_str;
-    if (!PyArg_ParseTuple(args, "s", &device_type_str))
+    int profiling = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|p", const_cast<char **>(keywords), &device_type_str, &profiling))
     {
         return -1;
     }
@@ -48,15 +322,19 @@ PyOperationManager_init(PyOperationManager *self, PyObject *args, PyObject *kwds
     {
         device_type = OperationManager::device_types::GPU_DEVICE;
     }
+    else if (strcmp(device_type_str, "NATIVE") == 0)
+    {
+        device_type = OperationManager::device_types::NATIVE_CPU;
+    }
     else
     {
-        PyErr_SetString(PyExc_ValueError, "Device type must be either 'CPU' or 'GPU'");
+        PyErr_SetString(PyExc_ValueError, "Device type must be 'CPU', 'GPU' or 'NATIVE'");
         return -1;
     }
 
     try
     {
-        self->op_manager = new OperationManager(device_type);
+        self->op_manager = new OperationManager(device_type, profiling != 0);
     }
     catch (const std::exception &e)
     {
@@ -68,34 +346,46 @@ PyOperationManager_init(PyOperationManager *self, PyObject *args, PyObject *kwds
 }
 
 static PyObject *
-PyOperationManager_multi_vector_op(PyOperationManager *self, PyObject *args)
+PyOperationManager_from_host(PyOperationManager *self, PyObject *args)
 {
-    PyArrayObject *lhs_array, *rhs_array;
-    const char *op_type_str;
+    PyObject *data_object;
 
-    if (!PyArg_ParseTuple(args, "sOO", &op_type_str, &lhs_array, &rhs_array))
+    if (!PyArg_ParseTuple(args, "O", &data_object))
     {
         return NULL;
     }
 
-    if (!PyArray_Check(lhs_array) || !PyArray_Check(rhs_array))
+    FloatBuffer data;
+    if (!data.acquire(data_object, false, "data"))
     {
-        PyErr_SetString(PyExc_TypeError, "Arguments must be numpy arrays");
         return NULL;
     }
 
-    // Verify array types
-    if (PyArray_TYPE(lhs_array) != NPY_float || PyArray_TYPE(rhs_array) != NPY_float)
+    const float *values = data.data();
+    int height = data.height();
+    int width = data.width();
+    std::unique_ptr<DeviceMatrix> matrix;
+    if (!run_without_gil(self, [&](OperationManager &manager)
+                         { matrix.reset(new DeviceMatrix(manager.from_host(values, height, width))); }))
     {
-        PyErr_SetString(PyExc_TypeError, "Arrays must be of type numpy.float64");
         return NULL;
     }
+    return wrap_device_matrix(self, std::move(matrix));
+}
 
-    // Get array dimensions
-    int lheight = PyArray_DIM(lhs_array, 0);
-    int lwidth = PyArray_DIM(lhs_array, 1);
-    int rheight = PyArray_DIM(rhs_array, 0);
-    int rwidth = PyArray_DIM(rhs_array, 1);
+static PyObject *
+PyOperationManager_multi_vector_op(PyOperationManager *self, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = {"operation", "lhs", "rhs", "out", NULL};
+    PyObject *lhs_object, *rhs_object;
+    PyObject *out_object = NULL;
+    const char *op_type_str;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "sOO|O", const_cast<char **>(keywords), &op_type_str, &lhs_object, &rhs_object,
+                                     &out_object))
+    {
+        return NULL;
+    }
 
     // Get operation type
     operation_types op_type;
@@ -125,57 +415,80 @@ PyOperationManager_multi_vector_op(PyOperationManager *self, PyObject *args)
         return NULL;
     }
 
-    // Get data pointers
-    float *lhs_data = (float *)PyArray_DATA(lhs_array);
-    float *rhs_data = (float *)PyArray_DATA(rhs_array);
-
-    try
+    // Device matrices stay on the device and return a DeviceMatrix
+    if (PyObject_TypeCheck(lhs_object, &PyDeviceMatrixType) && PyObject_TypeCheck(rhs_object, &PyDeviceMatrixType))
     {
-        float *result = self->op_manager->multi_vector_op(
-            op_type, lhs_data, lheight, lwidth, rhs_data, rheight, rwidth);
-
-        // Create output numpy array
-        npy_intp dims[2] = {lheight, rwidth};
-        PyObject *result_array = PyArray_SimpleNewFromData(2, dims, NPY_float, result);
-
-        // Set array to own the memory
-        PyArray_ENABLEFLAGS((PyArrayObject *)result_array, NPY_ARRAY_OWNDATA);
+        if (out_object && out_object != Py_None)
+        {
+            PyErr_SetString(PyExc_TypeError, "out= is only supported for host arrays");
+            return NULL;
+        }
+        if (!check_owner(self, lhs_object, "lhs") || !check_owner(self, rhs_object, "rhs"))
+        {
+            return NULL;
+        }
+        const DeviceMatrix &lhs_matrix = *((PyDeviceMatrix *)lhs_object)->matrix;
+        const DeviceMatrix &rhs_matrix = *((PyDeviceMatrix *)rhs_object)->matrix;
+        std::unique_ptr<DeviceMatrix> result;
+        if (!run_without_gil(self, [&](OperationManager &manager)
+                             { result.reset(new DeviceMatrix(manager.multi_vector_op(op_type, lhs_matrix, rhs_matrix))); }))
+        {
+            return NULL;
+        }
+        return wrap_device_matrix(self, std::move(result));
+    }
 
-        return result_array;
+    if (PyObject_TypeCheck(lhs_object, &PyDeviceMatrixType) || PyObject_TypeCheck(rhs_object, &PyDeviceMatrixType))
+    {
+        PyErr_SetString(PyExc_TypeError, "Arguments must both be float32 buffers or both be DeviceMatrix objects");
+        return NULL;
     }
-    catch (const std::exception &e)
+    FloatBuffer lhs, rhs;
+    if (!lhs.acquire(lhs_object, false, "lhs") || !rhs.acquire(rhs_object, false, "rhs"))
     {
-        PyErr_SetString(PyExc_RuntimeError, e.what());
         return NULL;
     }
-}
 
-static PyObject *
-PyOperationManager_single_vector_op(PyOperationManager *self, PyObject *args)
-{
-    PyArrayObject *data_array;
-    const char *op_type_str;
-
-    if (!PyArg_ParseTuple(args, "sO", &op_type_str, &data_array))
+    // The result is written straight into out= (or a new array), nothing else is allocated on the host
+    std::pair<int, int> shape = operation_result_shape(op_type, lhs.height(), lhs.width(), rhs.width());
+    PyObject *result = output_array(out_object, shape);
+    if (result == NULL)
     {
         return NULL;
     }
-
-    if (!PyArray_Check(data_array))
+    FloatBuffer output;
+    if (!acquire_output(output, result, shape) || !check_disjoint(output, {&lhs, &rhs}))
     {
-        PyErr_SetString(PyExc_TypeError, "Argument must be a numpy array");
+        Py_DECREF(result);
         return NULL;
     }
 
-    if (PyArray_TYPE(data_array) != NPY_float)
+    const float *lhs_data = lhs.data();
+    const float *rhs_data = rhs.data();
+    int lheight = lhs.height(), lwidth = lhs.width();
+    int rheight = rhs.height(), rwidth = rhs.width();
+    float *out = output.data();
+    if (!run_without_gil(self, [&](OperationManager &manager)
+                         { manager.multi_vector_op(op_type, lhs_data, lheight, lwidth, rhs_data, rheight, rwidth, out); }))
     {
-        PyErr_SetString(PyExc_TypeError, "Array must be of type numpy.float64");
+        Py_DECREF(result);
         return NULL;
     }
+    return result;
+}
+
+static PyObject *
+PyOperationManager_single_vector_op(PyOperationManager *self, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = {"operation", "data", "out", NULL};
+    PyObject *data_object;
+    PyObject *out_object = NULL;
+    const char *op_type_str;
 
-    int height = PyArray_DIM(data_array, 0);
-    int width = PyArray_DIM(data_array, 1);
-    float *data = (float *)PyArray_DATA(data_array);
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "sO|O", const_cast<char **>(keywords), &op_type_str, &data_object, &out_object))
+    {
+        return NULL;
+    }
 
     operation_types op_type;
     if (strcmp(op_type_str, "transpose") == 0)
@@ -204,31 +517,357 @@ PyOperationManager_single_vector_op(PyOperationManager *self, PyObject *args)
         return NULL;
     }
 
-    try
+    if (PyObject_TypeCheck(data_object, &PyDeviceMatrixType))
     {
-        float *result = self->op_manager->single_vector_op(op_type, data, height, width);
+        if (out_object && out_object != Py_None)
+        {
+            PyErr_SetString(PyExc_TypeError, "out= is only supported for host arrays");
+            return NULL;
+        }
+        if (!check_owner(self, data_object, "data"))
+        {
+            return NULL;
+        }
+        const DeviceMatrix &matrix = *((PyDeviceMatrix *)data_object)->matrix;
+        std::unique_ptr<DeviceMatrix> result;
+        if (!run_without_gil(self, [&](OperationManager &manager)
+                             { result.reset(new DeviceMatrix(manager.single_vector_op(op_type, matrix))); }))
+        {
+            return NULL;
+        }
+        return wrap_device_matrix(self, std::move(result));
+    }
 
-        npy_intp dims[2] = {width, height}; // Note: dimensions swapped for transpose
-        PyObject *result_array = PyArray_SimpleNewFromData(2, dims, NPY_float, result);
-        PyArray_ENABLEFLAGS((PyArrayObject *)result_array, NPY_ARRAY_OWNDATA);
+    FloatBuffer data;
+    if (!data.acquire(data_object, false, "data"))
+    {
+        return NULL;
+    }
 
-        return result_array;
+    // Result shape follows the operation (1x1 for scalars, swapped for transpose)
+    std::pair<int, int> shape = operation_result_shape(op_type, data.height(), data.width());
+    PyObject *result = output_array(out_object, shape);
+    if (result == NULL)
+    {
+        return NULL;
     }
-    catch (const std::exception &e)
+    FloatBuffer output;
+    if (!acquire_output(output, result, shape) || !check_disjoint(output, {&data}))
+    {
+        Py_DECREF(result);
+        return NULL;
+    }
+
+    const float *values = data.data();
+    int height = data.height();
+    int width = data.width();
+    float *out = output.data();
+    if (!run_without_gil(self, [&](OperationManager &manager)
+                         { manager.single_vector_op(op_type, values, height, width, out); }))
+    {
+        Py_DECREF(result);
+        return NULL;
+    }
+    return result;
+}
+
+// Optional 2-D epilogue operand of gemm with exactly the given shape, None leaves it unset
+static bool
+acquire_operand(FloatBuffer &buffer, PyObject *object, const char *name, int height, int width, const float **data)
+{
+    if (!object || object == Py_None)
+    {
+        return true;
+    }
+    if (!buffer.acquire(object, false, name))
+    {
+        return false;
+    }
+    if (buffer.height() != height || buffer.width() != width)
+    {
+        PyErr_Format(PyExc_ValueError, "%s has shape (%d, %d) but must be (%d, %d)", name, buffer.height(), buffer.width(),
+                     height, width);
+        return false;
+    }
+    *data = buffer.data();
+    return true;
+}
+
+static PyObject *
+PyOperationManager_gemm(PyOperationManager *self, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = {"lhs", "rhs", "alpha", "beta", "out", "row_bias", "column_bias", "scale",
+                                     "clamp_min", "clamp_max", NULL};
+    PyObject *lhs_object, *rhs_object;
+    PyObject *out_object = NULL, *row_bias_object = NULL, *column_bias_object = NULL, *scale_object = NULL;
+    PyObject *clamp_min_object = NULL, *clamp_max_object = NULL;
+    float alpha = 1.0f, beta = 0.0f;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO|ffOOOOOO", const_cast<char **>(keywords), &lhs_object, &rhs_object,
+                                     &alpha, &beta, &out_object, &row_bias_object, &column_bias_object, &scale_object,
+                                     &clamp_min_object, &clamp_max_object))
+    {
+        return NULL;
+    }
+    if (beta != 0.0f && (!out_object || out_object == Py_None))
+    {
+        PyErr_SetString(PyExc_ValueError, "beta requires out= holding the matrix to accumulate into");
+        return NULL;
+    }
+
+    FloatBuffer lhs, rhs;
+    if (!lhs.acquire(lhs_object, false, "lhs") || !rhs.acquire(rhs_object, false, "rhs"))
+    {
+        return NULL;
+    }
+    int lheight = lhs.height(), lwidth = lhs.width();
+    int rheight = rhs.height(), rwidth = rhs.width();
+
+    // Unset clamp bounds are open, so clamp_min alone is e.g. a ReLU
+    HostGemmEpilogue epilogue;
+    FloatBuffer row_bias, column_bias, scale;
+    if (!acquire_operand(row_bias, row_bias_object, "row_bias", 1, rwidth, &epilogue.row_bias) ||
+        !acquire_operand(column_bias, column_bias_object, "column_bias", lheight, 1, &epilogue.column_bias) ||
+        !acquire_operand(scale, scale_object, "scale", lheight, rwidth, &epilogue.scale))
+    {
+        return NULL;
+    }
+    epilogue.clamp_min = -std::numeric_limits<float>::infinity();
+    epilogue.clamp_max = std::numeric_limits<float>::infinity();
+    PyObject *bounds[2] = {clamp_min_object, clamp_max_object};
+    float *limits[2] = {&epilogue.clamp_min, &epilogue.clamp_max};
+    for (int i = 0; i < 2; i++)
+    {
+        if (bounds[i] && bounds[i] != Py_None)
+        {
+            double value = PyFloat_AsDouble(bounds[i]);
+            if (value == -1.0 && PyErr_Occurred())
+            {
+                return NULL;
+            }
+            *limits[i] = static_cast<float>(value);
+            epilogue.clamp = true;
+        }
+    }
+
+    std::pair<int, int> shape = operation_result_shape(operation_types::MATRIX_MULTIPLICATION, lheight, lwidth, rwidth);
+    PyObject *result = output_array(out_object, shape);
+    if (result == NULL)
+    {
+        return NULL;
+    }
+    FloatBuffer output;
+    if (!acquire_output(output, result, shape) || !check_disjoint(output, {&lhs, &rhs, &row_bias, &column_bias, &scale}))
+    {
+        Py_DECREF(result);
+        return NULL;
+    }
+
+    const float *lhs_data = lhs.data();
+    const float *rhs_data = rhs.data();
+    float *out = output.data();
+    if (!run_without_gil(self, [&](OperationManager &manager)
+                         { manager.gemm(alpha, lhs_data, lheight, lwidth, rhs_data, rheight, rwidth, beta, out, epilogue); }))
+    {
+        Py_DECREF(result);
+        return NULL;
+    }
+    return result;
+}
+
+// Out-of-core matrix multiplication, e.g. of numpy.memmap operands larger than device memory
+static PyObject *
+PyOperationManager_streaming_gemm(PyOperationManager *self, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = {"lhs", "rhs", "out", "device_budget", NULL};
+    PyObject *lhs_object, *rhs_object;
+    PyObject *out_object = NULL;
+    Py_ssize_t device_budget = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO|On", const_cast<char **>(keywords), &lhs_object, &rhs_object,
+                                     &out_object, &device_budget))
+    {
+        return NULL;
+    }
+    if (device_budget < 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "device_budget must not be negative");
+        return NULL;
+    }
+    FloatBuffer lhs, rhs;
+    if (!lhs.acquire(lhs_object, false, "lhs") || !rhs.acquire(rhs_object, false, "rhs"))
+    {
+        return NULL;
+    }
+
+    std::pair<int, int> shape = operation_result_shape(operation_types::MATRIX_MULTIPLICATION, lhs.height(), lhs.width(), rhs.width());
+    PyObject *result = output_array(out_object, shape);
+    if (result == NULL)
+    {
+        return NULL;
+    }
+    FloatBuffer output;
+    if (!acquire_output(output, result, shape) || !check_disjoint(output, {&lhs, &rhs}))
+    {
+        Py_DECREF(result);
+        return NULL;
+    }
+
+    const float *lhs_data = lhs.data();
+    const float *rhs_data = rhs.data();
+    int lheight = lhs.height(), lwidth = lhs.width();
+    int rheight = rhs.height(), rwidth = rhs.width();
+    float *out = output.data();
+    if (!run_without_gil(self, [&](OperationManager &manager)
+                         { manager.streaming_gemm(lhs_data, lheight, lwidth, rhs_data, rheight, rwidth, out,
+                                                  static_cast<size_t>(device_budget)); }))
+    {
+        Py_DECREF(result);
+        return NULL;
+    }
+    return result;
+}
+
+// A .bmat file straight into device memory, without a copy in host memory on the way
+static PyObject *
+PyOperationManager_load_bmat(PyOperationManager *self, PyObject *args)
+{
+    const char *path;
+    if (!PyArg_ParseTuple(args, "s", &path))
+    {
+        return NULL;
+    }
+    std::string file(path);
+    std::unique_ptr<DeviceMatrix> matrix;
+    if (!run_without_gil(self, [&](OperationManager &manager)
+                         { matrix.reset(new DeviceMatrix(manager.load_bmat(file))); }))
+    {
+        return NULL;
+    }
+    return wrap_device_matrix(self, std::move(matrix));
+}
+
+// One dict per recorded op, see OperationManager::OpProfile
+static PyObject *
+PyOperationManager_get_profile(PyOperationManager *self, PyObject *Py_UNUSED(ignored))
+{
+    std::vector<OperationManager::OpProfile> profile;
+    if (!run_without_gil(self, [&](OperationManager &manager)
+                         { profile = manager.get_profile(); }))
+    {
+        return NULL;
+    }
+
+    PyObject *records = PyList_New(0);
+    if (!records)
+    {
+        return NULL;
+    }
+    for (const OperationManager::OpProfile &op : profile)
+    {
+        PyObject *record = Py_BuildValue(
+            "{s:s,s:(ii),s:(ii),s:n,s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:d}",
+            "op", op.name.c_str(),
+            "shape", op.height, op.width,
+            "rhs_shape", op.rhs_height, op.rhs_width,
+            "bytes_moved", static_cast<Py_ssize_t>(op.bytes_moved),
+            "flops", op.flops,
+            "build_seconds", op.build_seconds,
+            "buffer_seconds", op.buffer_seconds,
+            "write_seconds", op.write_seconds,
+            "kernel_seconds", op.kernel_seconds,
+            "read_seconds", op.read_seconds,
+            "start_seconds", op.start_seconds,
+            "end_seconds", op.end_seconds,
+            "gflops", op.gflops(),
+            "gbytes_per_second", op.gbytes_per_second());
+        if (!record || PyList_Append(records, record) != 0)
+        {
+            Py_XDECREF(record);
+            Py_DECREF(records);
+            return NULL;
+        }
+        Py_DECREF(record);
+    }
+    return records;
+}
+
+static PyObject *
+PyOperationManager_reset_profile(PyOperationManager *self, PyObject *Py_UNUSED(ignored))
+{
+    if (!run_without_gil(self, [](OperationManager &manager)
+                         { manager.reset_profile(); }))
+    {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+PyOperationManager_export_chrome_trace(PyOperationManager *self, PyObject *args)
+{
+    const char *path;
+    if (!PyArg_ParseTuple(args, "s", &path))
+    {
+        return NULL;
+    }
+    bool written = false;
+    if (!run_without_gil(self, [&](OperationManager &manager)
+                         { written = manager.export_chrome_trace(path); }))
     {
-        PyErr_SetString(PyExc_RuntimeError, e.what());
         return NULL;
     }
+    if (!written)
+    {
+        PyErr_Format(PyExc_OSError, "Could not write trace to %s", path);
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+PyOperationManager_autotune(PyOperationManager *self, PyObject *args)
+{
+    int size = 0;
+    if (!PyArg_ParseTuple(args, "|i", &size))
+    {
+        return NULL;
+    }
+    std::string tuning;
+    if (!run_without_gil(self, [&](OperationManager &manager)
+                         { tuning = manager.autotune(size); }))
+    {
+        return NULL;
+    }
+    return PyUnicode_FromString(tuning.c_str());
 }
 
 static PyMethodDef PyOperationManager_methods[] = {
-    {"multi_vector_op", (PyCFunction)PyOperationManager_multi_vector_op, METH_VARARGS,
-     "Perform operation on two vectors"},
-    {"single_vector_op", (PyCFunction)PyOperationManager_single_vector_op, METH_VARARGS,
-     "Perform operation on a single vector"},
+    {"multi_vector_op", (PyCFunction)PyOperationManager_multi_vector_op, METH_VARARGS | METH_KEYWORDS,
+     "Perform operation on two matrices, writing into out= when given"},
+    {"single_vector_op", (PyCFunction)PyOperationManager_single_vector_op, METH_VARARGS | METH_KEYWORDS,
+     "Perform operation on a single matrix, writing into out= when given"},
+    {"gemm", (PyCFunction)PyOperationManager_gemm, METH_VARARGS | METH_KEYWORDS,
+     "alpha * lhs @ rhs + beta * out, then row_bias/column_bias add, scale multiply and clamp, in one kernel"},
+    {"streaming_gemm", (PyCFunction)PyOperationManager_streaming_gemm, METH_VARARGS | METH_KEYWORDS,
+     "lhs @ rhs streamed through device memory in panels, for operands (e.g. numpy.memmap) larger than it"},
+    {"from_host", (PyCFunction)PyOperationManager_from_host, METH_VARARGS,
+     "Copy a float32 buffer into a DeviceMatrix"},
+    {"load_bmat", (PyCFunction)PyOperationManager_load_bmat, METH_VARARGS,
+     "Upload a .bmat file into a DeviceMatrix from its memory mapping"},
+    {"get_profile", (PyCFunction)PyOperationManager_get_profile, METH_NOARGS,
+     "Per-op timings recorded by a manager created with profiling=True"},
+    {"reset_profile", (PyCFunction)PyOperationManager_reset_profile, METH_NOARGS,
+     "Discard recorded op timings"},
+    {"export_chrome_trace", (PyCFunction)PyOperationManager_export_chrome_trace, METH_VARARGS,
+     "Write recorded op timings as Chrome trace JSON"},
+    {"autotune", (PyCFunction)PyOperationManager_autotune, METH_VARARGS,
+     "Time kernel tile and work-group variants on this device and save the fastest for later sessions. "
+     "Run it while no other thread uses the manager"},
     {NULL} /* Sentinel */
 };
 
+
 static PyTypeObject PyOperationManagerType = {
     PyVarObject_HEAD_INIT(NULL, 0) "opencl_ops.OperationManager", /* tp_name */
     sizeof(PyOperationManager),                                   /* tp_basicsize */
@@ -269,12 +908,107 @@ static PyTypeObject PyOperationManagerType = {
     PyOperationManager_new,                                       /* tp_new */
 };
 
+// File errors become OSError, malformed .bmat files ValueError
+static void
+set_file_error(const std::exception &e)
+{
+    PyErr_SetString(dynamic_cast<const std::invalid_argument *>(&e) ? PyExc_ValueError : PyExc_OSError, e.what());
+}
+
+static void
+release_mapped_matrix(PyObject *capsule)
+{
+    delete static_cast<MappedMatrix *>(PyCapsule_GetPointer(capsule, "opencl_ops.MappedMatrix"));
+}
+
+// A numpy array over the file's memory mapping, which lives as long as the array
+static PyObject *
+opencl_ops_load_bmat(PyObject *Py_UNUSED(module), PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = {"path", "writable", NULL};
+    const char *path;
+    int writable = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|p", const_cast<char **>(keywords), &path, &writable))
+    {
+        return NULL;
+    }
+
+    std::unique_ptr<MappedMatrix> mapped;
+    try
+    {
+        mapped.reset(new MappedMatrix(MappedMatrix::open_bmat(path, writable != 0)));
+    }
+    catch (const std::exception &e)
+    {
+        set_file_error(e);
+        return NULL;
+    }
+
+    npy_intp dims[2] = {mapped->height(), mapped->width()};
+    PyObject *array = PyArray_SimpleNewFromData(2, dims, NPY_FLOAT, mapped->data());
+    if (array == NULL)
+    {
+        return NULL;
+    }
+    if (!writable)
+    {
+        PyArray_CLEARFLAGS(reinterpret_cast<PyArrayObject *>(array), NPY_ARRAY_WRITEABLE);
+    }
+    PyObject *capsule = PyCapsule_New(mapped.get(), "opencl_ops.MappedMatrix", release_mapped_matrix);
+    if (capsule == NULL)
+    {
+        Py_DECREF(array);
+        return NULL;
+    }
+    mapped.release();
+    if (PyArray_SetBaseObject(reinterpret_cast<PyArrayObject *>(array), capsule) < 0) // Steals capsule
+    {
+        Py_DECREF(array);
+        return NULL;
+    }
+    return array;
+}
+
+static PyObject *
+opencl_ops_save_bmat(PyObject *Py_UNUSED(module), PyObject *args)
+{
+    const char *path;
+    PyObject *data_object;
+    if (!PyArg_ParseTuple(args, "sO", &path, &data_object))
+    {
+        return NULL;
+    }
+    FloatBuffer data;
+    if (!data.acquire(data_object, false, "data"))
+    {
+        return NULL;
+    }
+    try
+    {
+        MappedMatrix::save_bmat(path, data.data(), data.height(), data.width());
+    }
+    catch (const std::exception &e)
+    {
+        set_file_error(e);
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef opencl_ops_functions[] = {
+    {"load_bmat", (PyCFunction)opencl_ops_load_bmat, METH_VARARGS | METH_KEYWORDS,
+     "Memory-map a .bmat file as a float32 array, read-only unless writable=True"},
+    {"save_bmat", (PyCFunction)opencl_ops_save_bmat, METH_VARARGS,
+     "Write a 2-D float32 buffer as a .bmat file with page-aligned data"},
+    {NULL} /* Sentinel */
+};
+
 static PyModuleDef opencl_ops_module = {
     PyModuleDef_HEAD_INIT,
     "opencl_ops",
     "OpenCL Operations Module",
     -1,
-    NULL};
+    opencl_ops_functions};
 
 PyMODINIT_FUNC
 PyInit_opencl_ops(void)
@@ -284,6 +1018,8 @@ PyInit_opencl_ops(void)
     PyObject *m;
     if (PyType_Ready(&PyOperationManagerType) < 0)
         return NULL;
+    if (PyType_Ready(&PyDeviceMatrixType) < 0)
+        return NULL;
 
     m = PyModule_Create(&opencl_ops_module);
     if (m == NULL)
@@ -297,5 +1033,13 @@ PyInit_opencl_ops(void)
         return NULL;
     }
 
+    Py_INCREF(&PyDeviceMatrixType);
+    if (PyModule_AddObject(m, "DeviceMatrix", (PyObject *)&PyDeviceMatrixType) < 0)
+    {
+        Py_DECREF(&PyDeviceMatrixType);
+        Py_DECREF(m);
+        return NULL;
+    }
+
     return m;
 }
\ No newline at end of file
@@ -12,6 +12,13 @@ typedef struct {
     OperationManager* op_manager;
 } PyOperationManager;
 
+// Structure for the Python DeviceMatrix object
+typedef struct {
+    PyObject_HEAD
+    DeviceMatrix* matrix;
+    PyOperationManager* owner;  // Manager the matrix came from
+} PyDeviceMatrix;
+
 // Deallocation function
 static void PyOperationManager_dealloc(PyOperationManager* self);
 
@@ -20,14 +27,21 @@ static PyObject* PyOperationManager_new(PyTypeObject* type, PyObject* args, PyOb
 static int PyOperationManager_init(PyOperationManager* self, PyObject* args, PyObject* kwds);
 
 // Method functions
-static PyObject* PyOperationManager_multi_vector_op(PyOperationManager* self, PyObject* args);
-static PyObject* PyOperationManager_single_vector_op(PyOperationManager* self, PyObject* args);
+static PyObject* PyOperationManager_multi_vector_op(PyOperationManager* self, PyObject* args, PyObject* kwds);
+static PyObject* PyOperationManager_single_vector_op(PyOperationManager* self, PyObject* args, PyObject* kwds);
+static PyObject* PyOperationManager_from_host(PyOperationManager* self, PyObject* args);
+
+// DeviceMatrix functions
+static void PyDeviceMatrix_dealloc(PyDeviceMatrix* self);
+static PyObject* PyDeviceMatrix_to_host(PyDeviceMatrix* self, PyObject* args, PyObject* kwds);
+static PyObject* PyDeviceMatrix_get_shape(PyDeviceMatrix* self, void* closure);
 
 // Method definitions array
 static PyMethodDef PyOperationManager_methods[];
 
-// Type object
+// Type objects
 static PyTypeObject PyOperationManagerType;
+static PyTypeObject PyDeviceMatrixType;
 
 // Module definition
 static PyModuleDef opencl_ops_module;
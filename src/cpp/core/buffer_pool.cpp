@@ -0,0 +1,236 @@
+#include "include/buffer_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <stdexcept>
+
+BufferPool::BufferPool(cl_context context, size_t host_alignment)
+	: context(context), host_alignment(host_alignment)
+{
+	clRetainContext(context);
+}
+
+BufferPool::~BufferPool()
+{
+	trim_locked(0);
+	clReleaseContext(context);
+}
+
+size_t BufferPool::bucket_size(size_t bytes)
+{
+	const size_t minimum = 256;
+	if (bytes <= minimum)
+	{
+		return minimum;
+	}
+
+	// Round up to 2^k, 1.25 * 2^k, 1.5 * 2^k or 1.75 * 2^k, wasting at most 25%
+	size_t power = minimum;
+	while (power * 2 < bytes)
+	{
+		power *= 2;
+	}
+	size_t step = power / 4;
+	return ((bytes + step - 1) / step) * step;
+}
+
+cl_mem BufferPool::acquire(size_t bytes, cl_event *ready)
+{
+	size_t size = bucket_size(bytes);
+	*ready = nullptr;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto free_list = free_lists.find(size);
+	if (free_list != free_lists.end() && !free_list->second.empty())
+	{
+		PooledBuffer pooled = free_list->second.back();
+		free_list->second.pop_back();
+		stats.hits++;
+		stats.bytes_pooled -= size;
+		stats.bytes_in_use += size;
+		stats.peak_bytes_in_use = std::max(stats.peak_bytes_in_use, stats.bytes_in_use);
+		*ready = pooled.reusable_after;
+		return pooled.buffer;
+	}
+
+	auto create_start = std::chrono::steady_clock::now();
+	cl_int err;
+	cl_mem buffer = create_buffer(size, &err);
+	if (err == CL_MEM_OBJECT_ALLOCATION_FAILURE || err == CL_OUT_OF_RESOURCES)
+	{
+		// Idle buffers may be what is exhausting the device, give them back and retry
+		trim_locked(0);
+		buffer = create_buffer(size, &err);
+	}
+	if (err != CL_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create device buffer");
+	}
+	std::chrono::duration<double> create_time = std::chrono::steady_clock::now() - create_start;
+	stats.create_seconds += create_time.count();
+	stats.misses++;
+	stats.bytes_in_use += size;
+	stats.peak_bytes_in_use = std::max(stats.peak_bytes_in_use, stats.bytes_in_use);
+	return buffer;
+}
+
+cl_mem BufferPool::create_buffer(size_t size, cl_int *err)
+{
+	if (host_alignment == 0)
+	{
+		return clCreateBuffer(context, CL_MEM_READ_WRITE, size, NULL, err);
+	}
+
+	void *data = nullptr;
+	if (posix_memalign(&data, host_alignment, size) != 0)
+	{
+		*err = CL_MEM_OBJECT_ALLOCATION_FAILURE;
+		return nullptr;
+	}
+	cl_mem buffer = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, size, data, err);
+	if (*err != CL_SUCCESS)
+	{
+		free(data);
+		return nullptr;
+	}
+	// The memory must outlive commands still queued when the buffer is released
+	HostBlock *block = new HostBlock{data, true};
+	if (clSetMemObjectDestructorCallback(buffer, free_host_block, block) != CL_SUCCESS)
+	{
+		clReleaseMemObject(buffer);
+		free(data);
+		delete block;
+		*err = CL_OUT_OF_RESOURCES;
+		return nullptr;
+	}
+	host_blocks[buffer] = block;
+	return buffer;
+}
+
+void CL_CALLBACK BufferPool::free_host_block(cl_mem, void *user_data)
+{
+	HostBlock *block = static_cast<HostBlock *>(user_data);
+	if (block->owned)
+		free(block->data);
+	delete block;
+}
+
+bool BufferPool::host_backed(cl_mem buffer) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return host_blocks.count(buffer) != 0;
+}
+
+float *BufferPool::detach(cl_mem buffer, size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto block = host_blocks.find(buffer);
+	if (block == host_blocks.end())
+	{
+		throw std::invalid_argument("Buffer is not backed by host memory");
+	}
+	stats.bytes_in_use -= bucket_size(bytes);
+
+	// The destructor callback now leaves the memory to the caller
+	block->second->owned = false;
+	float *data = static_cast<float *>(block->second->data);
+	host_blocks.erase(block);
+	clReleaseMemObject(buffer);
+	return data;
+}
+
+size_t BufferPool::get_host_alignment() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return host_alignment;
+}
+
+void BufferPool::set_host_alignment(size_t alignment)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	host_alignment = alignment;
+	trim_locked(0);
+}
+
+void BufferPool::release(cl_mem buffer, size_t bytes, cl_event reusable_after)
+{
+	size_t size = bucket_size(bytes);
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.bytes_in_use -= size;
+
+	// Buffers created before set_host_alignment() switched kinds are not recycled
+	PooledBuffer pooled = {buffer, reusable_after};
+	if (size > max_buffer_bytes || stats.bytes_pooled + size > max_pooled_bytes ||
+		(host_blocks.count(buffer) != 0) != (host_alignment != 0))
+	{
+		free_buffer(pooled);
+		return;
+	}
+	free_lists[size].push_back(pooled);
+	stats.bytes_pooled += size;
+}
+
+void BufferPool::free_buffer(PooledBuffer &pooled)
+{
+	// clReleaseMemObject defers the free until queued commands are done with it
+	if (pooled.reusable_after)
+		clReleaseEvent(pooled.reusable_after);
+	host_blocks.erase(pooled.buffer);
+	clReleaseMemObject(pooled.buffer);
+}
+
+void BufferPool::trim(size_t target_bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	trim_locked(target_bytes);
+}
+
+void BufferPool::trim_locked(size_t target_bytes)
+{
+	for (auto free_list = free_lists.rbegin(); free_list != free_lists.rend() && stats.bytes_pooled > target_bytes; ++free_list)
+	{
+		while (!free_list->second.empty() && stats.bytes_pooled > target_bytes)
+		{
+			free_buffer(free_list->second.back());
+			free_list->second.pop_back();
+			stats.bytes_pooled -= free_list->first;
+		}
+	}
+}
+
+void BufferPool::set_limits(size_t max_pooled_bytes, size_t max_buffer_bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	this->max_pooled_bytes = max_pooled_bytes;
+	this->max_buffer_bytes = max_buffer_bytes;
+
+	// Drop idle buffers that are now over either limit
+	for (auto &free_list : free_lists)
+	{
+		if (free_list.first > max_buffer_bytes)
+		{
+			for (PooledBuffer &pooled : free_list.second)
+			{
+				free_buffer(pooled);
+				stats.bytes_pooled -= free_list.first;
+			}
+			free_list.second.clear();
+		}
+	}
+	trim_locked(max_pooled_bytes);
+}
+
+BufferPool::Stats BufferPool::get_stats() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+void BufferPool::reset_stats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.hits = 0;
+	stats.misses = 0;
+	stats.create_seconds = 0.0;
+	stats.peak_bytes_in_use = stats.bytes_in_use;
+}
@@ -0,0 +1,315 @@
+#include "include/device_manager.hpp"
+#include "include/operation_manager.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+
+std::string platform_string(cl_platform_id platform, cl_platform_info param)
+{
+	size_t size = 0;
+	if (clGetPlatformInfo(platform, param, 0, NULL, &size) != CL_SUCCESS || size == 0)
+	{
+		return "";
+	}
+	std::vector<char> value(size);
+	clGetPlatformInfo(platform, param, size, value.data(), NULL);
+	return std::string(value.data());
+}
+
+std::string device_string(cl_device_id device, cl_device_info param)
+{
+	size_t size = 0;
+	if (clGetDeviceInfo(device, param, 0, NULL, &size) != CL_SUCCESS || size == 0)
+	{
+		return "";
+	}
+	std::vector<char> value(size);
+	clGetDeviceInfo(device, param, size, value.data(), NULL);
+	return std::string(value.data());
+}
+
+// Row panel boundaries, one panel per weight sized in proportion to it.
+// Every boundary but the last is a multiple of align. Panels flagged in
+// needs_rows get at least one align-row block, taken from the largest panel,
+// while there are blocks to spare.
+std::vector<int> split_rows(int rows, int align, const std::vector<double> &weights, const std::vector<bool> &needs_rows)
+{
+	double total = 0.0;
+	for (double weight : weights)
+		total += weight;
+
+	int blocks = (rows + align - 1) / align;
+	std::vector<int> counts(weights.size(), 0);
+	double cumulative = 0.0;
+	int assigned = 0;
+	for (size_t i = 0; i < weights.size(); i++)
+	{
+		cumulative += weights[i];
+		int bound = i + 1 < weights.size() ? static_cast<int>(blocks * (cumulative / total) + 0.5) : blocks;
+		bound = std::max(assigned, std::min(bound, blocks));
+		counts[i] = bound - assigned;
+		assigned = bound;
+	}
+
+	for (size_t i = 0; i < counts.size(); i++)
+	{
+		if (!needs_rows[i] || counts[i] > 0)
+			continue;
+		size_t largest = static_cast<size_t>(std::max_element(counts.begin(), counts.end()) - counts.begin());
+		if (counts[largest] > 1 || (counts[largest] == 1 && !needs_rows[largest]))
+		{
+			counts[largest]--;
+			counts[i]++;
+		}
+	}
+
+	std::vector<int> bounds(weights.size() + 1, 0);
+	for (size_t i = 0; i < counts.size(); i++)
+		bounds[i + 1] = std::min(bounds[i] + counts[i] * align, rows);
+	bounds.back() = rows;
+	return bounds;
+}
+
+} // namespace
+
+std::vector<DeviceManager::Device> DeviceManager::enumerate()
+{
+	std::vector<Device> found;
+
+	cl_uint num_platforms = 0;
+	if (clGetPlatformIDs(0, NULL, &num_platforms) != CL_SUCCESS || num_platforms == 0)
+	{
+		return found;
+	}
+	std::vector<cl_platform_id> platforms(num_platforms);
+	clGetPlatformIDs(num_platforms, platforms.data(), NULL);
+
+	for (cl_platform_id platform : platforms)
+	{
+		cl_uint num_devices = 0;
+		if (clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 0, NULL, &num_devices) != CL_SUCCESS || num_devices == 0)
+		{
+			continue;
+		}
+		std::vector<cl_device_id> platform_devices(num_devices);
+		clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, num_devices, platform_devices.data(), NULL);
+
+		for (cl_device_id device : platform_devices)
+		{
+			Device entry;
+			entry.platform = platform;
+			entry.device = device;
+			entry.type = CL_DEVICE_TYPE_DEFAULT;
+			clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(entry.type), &entry.type, NULL);
+			clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(entry.compute_units), &entry.compute_units, NULL);
+			clGetDeviceInfo(device, CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(entry.clock_mhz), &entry.clock_mhz, NULL);
+			entry.name = device_string(device, CL_DEVICE_NAME);
+			entry.platform_name = platform_string(platform, CL_PLATFORM_NAME);
+			found.push_back(entry);
+		}
+	}
+	return found;
+}
+
+DeviceManager::DeviceManager() : DeviceManager(enumerate())
+{
+}
+
+DeviceManager::DeviceManager(const std::vector<Device> &devices) : devices(devices)
+{
+	if (devices.empty())
+	{
+		throw std::runtime_error("No OpenCL devices found");
+	}
+	for (const Device &entry : devices)
+	{
+		managers.emplace_back(new OperationManager(entry.platform, entry.device));
+
+		// Peak rate guess until a split op measures the device
+		estimates.push_back(std::max<cl_uint>(entry.compute_units, 1) * static_cast<double>(std::max<cl_uint>(entry.clock_mhz, 1)));
+		for (int kind = 0; kind < WORK_KINDS; kind++)
+		{
+			throughputs[kind].push_back(0.0);
+			measured[kind].push_back(false);
+		}
+	}
+}
+
+DeviceManager::~DeviceManager() = default;
+
+DeviceManager::work_kinds DeviceManager::work_kind(operation_types op_type)
+{
+	return op_type == operation_types::MATRIX_MULTIPLICATION ? GEMM_WORK : ELEMENTWISE_WORK;
+}
+
+void DeviceManager::set_split_thresholds(double min_gemm_flops, double min_elements)
+{
+	min_split_work[GEMM_WORK] = min_gemm_flops;
+	min_split_work[ELEMENTWISE_WORK] = min_elements;
+}
+
+double DeviceManager::throughput(size_t index, operation_types op_type) const
+{
+	std::lock_guard<std::mutex> lock(state_mutex);
+	return weights(work_kind(op_type)).at(index);
+}
+
+std::vector<double> DeviceManager::weights(work_kinds kind) const
+{
+	// Estimates are not in flop/s or elements/s: convert them with the ratio of
+	// measured rate to estimate over the devices measured so far
+	double measured_rate = 0.0;
+	double measured_estimate = 0.0;
+	for (size_t i = 0; i < devices.size(); i++)
+	{
+		if (measured[kind][i])
+		{
+			measured_rate += throughputs[kind][i];
+			measured_estimate += estimates[i];
+		}
+	}
+	double scale = measured_estimate > 0.0 ? measured_rate / measured_estimate : 1.0;
+
+	std::vector<double> result(devices.size());
+	for (size_t i = 0; i < devices.size(); i++)
+		result[i] = measured[kind][i] ? throughputs[kind][i] : estimates[i] * scale;
+	return result;
+}
+
+size_t DeviceManager::fastest_device() const
+{
+	std::lock_guard<std::mutex> lock(state_mutex);
+	std::vector<double> gemm = weights(GEMM_WORK);
+	return static_cast<size_t>(std::max_element(gemm.begin(), gemm.end()) - gemm.begin());
+}
+
+float *DeviceManager::single_vector_op(operation_types op_type, float *data, int height, int width)
+{
+	return managers[fastest_device()]->single_vector_op(op_type, data, height, width);
+}
+
+float *DeviceManager::multi_vector_op(operation_types op_type, float *lhs, int lheight, int lwidth, float *rhs, int rheight, int rwidth)
+{
+	int result_width;
+	double work_per_row;
+	int align = 1;
+	switch (op_type)
+	{
+	case operation_types::ELEM_WISE_ADD:
+	case operation_types::ELEM_WISE_SUB:
+	case operation_types::ELEM_WISE_MUL:
+	case operation_types::ELEM_WISE_DIV:
+	{
+		if (lheight % rheight != 0 || lwidth % rwidth != 0)
+		{
+			throw std::invalid_argument("Operand shapes cannot be broadcast together");
+		}
+		// Panels start on a repeat of rhs so every device gets all of a broadcast rhs
+		if (rheight != lheight)
+			align = rheight;
+		result_width = lwidth;
+		work_per_row = lwidth;
+		break;
+	}
+	case operation_types::MATRIX_MULTIPLICATION:
+	{
+		if (lwidth != rheight)
+		{
+			throw std::invalid_argument("Inner matrix dimensions must agree");
+		}
+		result_width = rwidth;
+		work_per_row = 2.0 * lwidth * rwidth;
+		break;
+	}
+	default:
+		return managers[fastest_device()]->multi_vector_op(op_type, lhs, lheight, lwidth, rhs, rheight, rwidth);
+	}
+
+	work_kinds kind = work_kind(op_type);
+	if (managers.size() == 1 || work_per_row * lheight < min_split_work[kind])
+	{
+		return managers[fastest_device()]->multi_vector_op(op_type, lhs, lheight, lwidth, rhs, rheight, rwidth);
+	}
+
+	// Devices not measured yet get a panel even when their estimate rounds to none
+	std::vector<double> split_weights;
+	std::vector<bool> unmeasured(managers.size());
+	{
+		std::lock_guard<std::mutex> lock(state_mutex);
+		split_weights = weights(kind);
+		for (size_t i = 0; i < managers.size(); i++)
+			unmeasured[i] = !measured[kind][i];
+	}
+	std::vector<int> bounds = split_rows(lheight, align, split_weights, unmeasured);
+	float *result = static_cast<float *>(malloc(static_cast<size_t>(lheight) * result_width * sizeof(float)));
+	if (!result)
+	{
+		throw std::bad_alloc();
+	}
+
+	// One host thread per device: each blocks on its own queue while the devices run concurrently
+	std::vector<double> seconds(managers.size(), 0.0);
+	std::vector<std::exception_ptr> errors(managers.size());
+	std::vector<std::thread> workers;
+	for (size_t i = 0; i < managers.size(); i++)
+	{
+		int rows = bounds[i + 1] - bounds[i];
+		if (rows == 0)
+			continue;
+		workers.emplace_back([&, i, rows]()
+		{
+			try
+			{
+				auto start = std::chrono::steady_clock::now();
+				size_t row = static_cast<size_t>(bounds[i]);
+				float *panel_rhs = rhs;
+				int panel_rheight = rheight;
+				if (kind == ELEMENTWISE_WORK && rheight == lheight)
+				{
+					panel_rhs = rhs + row * rwidth;
+					panel_rheight = rows;
+				}
+				float *panel = managers[i]->multi_vector_op(op_type, lhs + row * lwidth, rows, lwidth, panel_rhs, panel_rheight, rwidth);
+				std::memcpy(result + row * result_width, panel, static_cast<size_t>(rows) * result_width * sizeof(float));
+				free(panel);
+				std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+				seconds[i] = elapsed.count();
+			}
+			catch (...)
+			{
+				errors[i] = std::current_exception();
+			}
+		});
+	}
+	for (std::thread &worker : workers)
+	{
+		worker.join();
+	}
+	for (std::exception_ptr &error : errors)
+	{
+		if (error)
+		{
+			free(result);
+			std::rethrow_exception(error);
+		}
+	}
+
+	// Exponential moving average so one noisy call does not swing the split
+	std::lock_guard<std::mutex> lock(state_mutex);
+	for (size_t i = 0; i < managers.size(); i++)
+	{
+		if (seconds[i] <= 0.0)
+			continue;
+		double rate = work_per_row * (bounds[i + 1] - bounds[i]) / seconds[i];
+		throughputs[kind][i] = measured[kind][i] ? 0.5 * throughputs[kind][i] + 0.5 * rate : rate;
+		measured[kind][i] = true;
+	}
+	return result;
+}
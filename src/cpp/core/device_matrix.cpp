@@ -0,0 +1,310 @@
+#include "include/device_matrix.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+namespace
+{
+	// Guards the reader lists of every matrix, threads on different lanes may read one matrix at once
+	std::mutex reader_mutex;
+}
+
+DeviceMatrix::DeviceMatrix(std::shared_ptr<BufferPool> pool, cl_command_queue queue, int height, int width)
+	: pool(std::move(pool)), queue(queue), rows(height), cols(width)
+{
+	if (height <= 0 || width <= 0)
+	{
+		throw std::invalid_argument("Matrix dimensions must be positive");
+	}
+
+	// A recycled buffer comes with the event its previous users must finish by
+	mem = this->pool->acquire(bytes(), &ready_event);
+	clRetainCommandQueue(queue);
+}
+
+DeviceMatrix::DeviceMatrix(cl_command_queue queue, cl_mem buffer, int height, int width)
+	: queue(queue), mem(buffer), rows(height), cols(width)
+{
+	if (height <= 0 || width <= 0)
+	{
+		throw std::invalid_argument("Matrix dimensions must be positive");
+	}
+	clRetainCommandQueue(queue);
+}
+
+DeviceMatrix::~DeviceMatrix()
+{
+	release();
+}
+
+DeviceMatrix::DeviceMatrix(DeviceMatrix &&other) noexcept
+	: pool(std::move(other.pool)), queue(other.queue), mem(other.mem), ready_event(other.ready_event),
+	  readers(std::move(other.readers)), rows(other.rows), cols(other.cols)
+{
+	other.queue = nullptr;
+	other.mem = nullptr;
+	other.ready_event = nullptr;
+	other.rows = 0;
+	other.cols = 0;
+}
+
+DeviceMatrix &DeviceMatrix::operator=(DeviceMatrix &&other) noexcept
+{
+	if (this != &other)
+	{
+		release();
+		std::swap(pool, other.pool);
+		std::swap(queue, other.queue);
+		std::swap(mem, other.mem);
+		std::swap(ready_event, other.ready_event);
+		std::swap(readers, other.readers);
+		std::swap(rows, other.rows);
+		std::swap(cols, other.cols);
+	}
+	return *this;
+}
+
+void DeviceMatrix::release()
+{
+	std::vector<cl_event> pending_readers;
+	{
+		std::lock_guard<std::mutex> lock(reader_mutex);
+		pending_readers.swap(readers);
+	}
+
+	if (mem && !pool)
+	{
+		// Deleted once queued commands using it are done
+		clReleaseMemObject(mem);
+	}
+	else if (mem)
+	{
+		// The queue is in order, so the marker completes once every command queued
+		// on it so far is done, as well as the last write and reads on other
+		// queues; the pool waits for it before reuse
+		std::vector<cl_event> events = pending_readers;
+		if (ready_event)
+			events.push_back(ready_event);
+		cl_event reusable_after = nullptr;
+		if (clEnqueueMarkerWithWaitList(queue, static_cast<cl_uint>(events.size()), events.empty() ? NULL : events.data(),
+										&reusable_after) != CL_SUCCESS)
+		{
+			reusable_after = nullptr;
+			clFinish(queue);
+			if (!events.empty())
+				clWaitForEvents(static_cast<cl_uint>(events.size()), events.data());
+		}
+		pool->release(mem, bytes(), reusable_after);
+	}
+	for (cl_event reader : pending_readers)
+		clReleaseEvent(reader);
+	if (ready_event)
+		clReleaseEvent(ready_event);
+	if (queue)
+		clReleaseCommandQueue(queue);
+	ready_event = nullptr;
+	mem = nullptr;
+	queue = nullptr;
+	pool.reset();
+}
+
+void DeviceMatrix::set_event(cl_event event)
+{
+	if (ready_event)
+		clReleaseEvent(ready_event);
+	ready_event = event;
+}
+
+void DeviceMatrix::add_reader(cl_event event) const
+{
+	std::lock_guard<std::mutex> lock(reader_mutex);
+	// Finished readers are dropped, so a matrix read over and over keeps a short list
+	readers.erase(std::remove_if(readers.begin(), readers.end(), [](cl_event reader)
+								 {
+									 cl_int status = CL_COMPLETE;
+									 clGetEventInfo(reader, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, NULL);
+									 if (status != CL_COMPLETE && status >= 0)
+										 return false;
+									 clReleaseEvent(reader);
+									 return true;
+								 }),
+				  readers.end());
+	clRetainEvent(event);
+	readers.push_back(event);
+}
+
+std::vector<cl_event> DeviceMatrix::pending_readers() const
+{
+	std::lock_guard<std::mutex> lock(reader_mutex);
+	for (cl_event reader : readers)
+		clRetainEvent(reader);
+	return readers;
+}
+
+void DeviceMatrix::wait() const
+{
+	if (ready_event && clWaitForEvents(1, &ready_event) != CL_SUCCESS)
+	{
+		throw std::runtime_error("Operation producing this matrix failed");
+	}
+}
+
+bool DeviceMatrix::ready() const
+{
+	if (!ready_event)
+	{
+		return true;
+	}
+	cl_int status;
+	if (clGetEventInfo(ready_event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, NULL) != CL_SUCCESS)
+	{
+		throw std::runtime_error("Failed to query event status");
+	}
+	return status == CL_COMPLETE || status < 0;
+}
+
+void DeviceMatrix::from_host(const float *data)
+{
+	// Writes must not overtake commands still reading the previous contents
+	cl_event write_event;
+	cl_int err = clEnqueueWriteBuffer(queue, mem, CL_TRUE, 0, bytes(), data, ready_event ? 1 : 0,
+									  ready_event ? &ready_event : NULL, &write_event);
+	if (err != CL_SUCCESS)
+	{
+		throw std::runtime_error("Failed to write device buffer");
+	}
+	set_event(write_event);
+}
+
+void DeviceMatrix::from_host_async(const float *data, const std::vector<cl_event> &wait_list)
+{
+	std::vector<cl_event> events = wait_list;
+	if (ready_event)
+		events.push_back(ready_event);
+
+	cl_event write_event;
+	cl_int err = clEnqueueWriteBuffer(queue, mem, CL_FALSE, 0, bytes(), data, static_cast<cl_uint>(events.size()),
+									  events.empty() ? NULL : events.data(), &write_event);
+	if (err != CL_SUCCESS)
+	{
+		throw std::runtime_error("Failed to write device buffer");
+	}
+	set_event(write_event);
+}
+
+void DeviceMatrix::to_host(float *data) const
+{
+	cl_int err = clEnqueueReadBuffer(queue, mem, CL_TRUE, 0, bytes(), data, ready_event ? 1 : 0,
+									 ready_event ? &ready_event : NULL, NULL);
+	if (err != CL_SUCCESS)
+	{
+		throw std::runtime_error("Failed to read results");
+	}
+}
+
+float *DeviceMatrix::to_host() const
+{
+	float *data = (float *)malloc(bytes());
+	if (!data)
+	{
+		throw std::bad_alloc();
+	}
+	try
+	{
+		to_host(data);
+	}
+	catch (...)
+	{
+		free(data);
+		throw;
+	}
+	return data;
+}
+
+OpFuture DeviceMatrix::to_host_async(const std::vector<cl_event> &wait_list) const
+{
+	float *data = (float *)malloc(bytes());
+	if (!data)
+	{
+		throw std::bad_alloc();
+	}
+	cl_event read_event;
+	try
+	{
+		read_event = enqueue_read(data, wait_list);
+	}
+	catch (...)
+	{
+		free(data);
+		throw;
+	}
+	return OpFuture(read_event, data);
+}
+
+OpFuture DeviceMatrix::to_host_async(float *data, const std::vector<cl_event> &wait_list) const
+{
+	return OpFuture(enqueue_read(data, wait_list), nullptr);
+}
+
+cl_event DeviceMatrix::enqueue_read(float *data, const std::vector<cl_event> &wait_list) const
+{
+	std::vector<cl_event> events = wait_list;
+	if (ready_event)
+		events.push_back(ready_event);
+
+	cl_event read_event;
+	cl_int err = clEnqueueReadBuffer(queue, mem, CL_FALSE, 0, bytes(), data, static_cast<cl_uint>(events.size()),
+									 events.empty() ? NULL : events.data(), &read_event);
+	if (err != CL_SUCCESS)
+	{
+		throw std::runtime_error("Failed to read results");
+	}
+	clFlush(queue);
+	return read_event;
+}
+
+bool DeviceMatrix::host_backed() const
+{
+	return pool && mem && pool->host_backed(mem);
+}
+
+OpFuture DeviceMatrix::take_host_async(const std::vector<cl_event> &wait_list)
+{
+	if (!host_backed())
+	{
+		throw std::logic_error("Matrix is not backed by host memory");
+	}
+
+	std::vector<cl_event> events = wait_list;
+	if (ready_event)
+		events.push_back(ready_event);
+
+	// Mapping a CL_MEM_USE_HOST_PTR buffer brings its host memory up to date,
+	// without a copy when the device shares that memory
+	cl_int err;
+	cl_event map_event;
+	void *mapped = clEnqueueMapBuffer(queue, mem, CL_FALSE, CL_MAP_READ, 0, bytes(), static_cast<cl_uint>(events.size()),
+									  events.empty() ? NULL : events.data(), &map_event, &err);
+	if (err != CL_SUCCESS)
+	{
+		throw std::runtime_error("Failed to map results");
+	}
+	cl_event unmap_event;
+	err = clEnqueueUnmapMemObject(queue, mem, mapped, 1, &map_event, &unmap_event);
+	clReleaseEvent(map_event);
+	if (err != CL_SUCCESS)
+	{
+		throw std::runtime_error("Failed to unmap results");
+	}
+	clFlush(queue);
+
+	float *data = pool->detach(mem, bytes());
+	mem = nullptr;
+	release();
+	rows = 0;
+	cols = 0;
+	return OpFuture(unmap_event, data);
+}
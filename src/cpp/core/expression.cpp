@@ -0,0 +1,204 @@
+#include "include/expression.hpp"
+#include <functional>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+struct Expression::Node
+{
+	enum class kinds
+	{
+		MATRIX,
+		SCALAR,
+		BINARY
+	};
+
+	kinds kind;
+	bool scalar = false; // No matrix leaves below, broadcasts like a scalar
+	int height = 1;
+	int width = 1;
+	const DeviceMatrix *matrix = nullptr;
+	float value = 0.0f;
+	operation_types op_type = operation_types::ELEM_WISE_ADD;
+	std::shared_ptr<const Node> lhs;
+	std::shared_ptr<const Node> rhs;
+};
+
+Expression::Expression(const DeviceMatrix &matrix)
+{
+	auto leaf = std::make_shared<Node>();
+	leaf->kind = Node::kinds::MATRIX;
+	leaf->height = matrix.height();
+	leaf->width = matrix.width();
+	leaf->matrix = &matrix;
+	node = leaf;
+}
+
+Expression::Expression(float value)
+{
+	auto leaf = std::make_shared<Node>();
+	leaf->kind = Node::kinds::SCALAR;
+	leaf->scalar = true;
+	leaf->value = value;
+	node = leaf;
+}
+
+Expression::Expression(std::shared_ptr<const Node> node)
+	: node(std::move(node))
+{
+}
+
+int Expression::height() const
+{
+	return node->height;
+}
+
+int Expression::width() const
+{
+	return node->width;
+}
+
+Expression Expression::binary(operation_types op_type, const Expression &lhs, const Expression &rhs)
+{
+	auto combined = std::make_shared<Node>();
+	combined->kind = Node::kinds::BINARY;
+	combined->op_type = op_type;
+	combined->lhs = lhs.node;
+	combined->rhs = rhs.node;
+	combined->scalar = lhs.node->scalar && rhs.node->scalar;
+
+	const Node &shape = lhs.node->scalar ? *rhs.node : *lhs.node;
+	const Node &broadcast = lhs.node->scalar ? *lhs.node : *rhs.node;
+	if (shape.height % broadcast.height != 0 || shape.width % broadcast.width != 0)
+	{
+		throw std::invalid_argument("Operand shapes cannot be broadcast together");
+	}
+	combined->height = shape.height;
+	combined->width = shape.width;
+	return Expression(combined);
+}
+
+Expression::FusedKernel Expression::fuse() const
+{
+	FusedKernel fused;
+	std::ostringstream parameters;
+	std::ostringstream body;
+	std::map<const DeviceMatrix *, std::string> matrix_values;
+	std::map<const Node *, std::string> values;
+
+	// Post-order walk emitting one private value per node, shared nodes only once
+	std::function<std::string(const Node *)> emit = [&](const Node *current) -> std::string
+	{
+		auto computed = values.find(current);
+		if (computed != values.end())
+		{
+			return computed->second;
+		}
+
+		// Named once the node's children are emitted, so names follow emission order
+		std::string value;
+		switch (current->kind)
+		{
+		case Node::kinds::MATRIX:
+		{
+			// Every leaf of the same matrix shares one input and one load
+			auto loaded = matrix_values.find(current->matrix);
+			if (loaded != matrix_values.end())
+			{
+				value = loaded->second;
+				break;
+			}
+			value = "v" + std::to_string(values.size());
+			matrix_values.emplace(current->matrix, value);
+
+			std::string input = "in" + std::to_string(fused.matrices.size());
+			fused.matrices.push_back(current->matrix);
+			parameters << "    __global const float* " << input << ", const int " << input << "_height, const int "
+					   << input << "_width,\n";
+			// Full-shape inputs index directly, smaller ones repeat across the result
+			if (current->height == node->height && current->width == node->width)
+			{
+				body << "    const float " << value << " = " << input << "[idx];\n";
+			}
+			else
+			{
+				body << "    const float " << value << " = " << input << "[(row % " << input << "_height) * " << input
+					 << "_width + col % " << input << "_width];\n";
+			}
+		}
+		break;
+		case Node::kinds::SCALAR:
+		{
+			value = "v" + std::to_string(values.size());
+			std::string scalar = "s" + std::to_string(fused.scalars.size());
+			fused.scalars.push_back(current->value);
+			parameters << "    const float " << scalar << ",\n";
+			body << "    const float " << value << " = " << scalar << ";\n";
+		}
+		break;
+		case Node::kinds::BINARY:
+		{
+			std::string lhs = emit(current->lhs.get());
+			std::string rhs = emit(current->rhs.get());
+			const char *op = "+";
+			switch (current->op_type)
+			{
+			case operation_types::ELEM_WISE_SUB:
+				op = "-";
+				break;
+			case operation_types::ELEM_WISE_MUL:
+				op = "*";
+				break;
+			case operation_types::ELEM_WISE_DIV:
+				op = "/";
+				break;
+			default:
+				break;
+			}
+			value = "v" + std::to_string(values.size());
+			body << "    const float " << value << " = " << lhs << " " << op << " " << rhs << ";\n";
+		}
+		break;
+		}
+		values.emplace(current, value);
+		return value;
+	};
+	std::string output = emit(node.get());
+
+	std::ostringstream source;
+	source << "__kernel void blitz_fused(\n"
+		   << parameters.str()
+		   << "    __global float* result,\n"
+		   << "    const int height,\n"
+		   << "    const int width\n"
+		   << ") {\n"
+		   << "    const int row = get_global_id(0);\n"
+		   << "    const int col = get_global_id(1);\n"
+		   << "    if (row >= height || col >= width) return;\n"
+		   << "    const int idx = row * width + col;\n"
+		   << body.str()
+		   << "    result[idx] = " << output << ";\n"
+		   << "}\n";
+	fused.source = source.str();
+	return fused;
+}
+
+Expression operator+(const Expression &lhs, const Expression &rhs)
+{
+	return Expression::binary(operation_types::ELEM_WISE_ADD, lhs, rhs);
+}
+
+Expression operator-(const Expression &lhs, const Expression &rhs)
+{
+	return Expression::binary(operation_types::ELEM_WISE_SUB, lhs, rhs);
+}
+
+Expression operator*(const Expression &lhs, const Expression &rhs)
+{
+	return Expression::binary(operation_types::ELEM_WISE_MUL, lhs, rhs);
+}
+
+Expression operator/(const Expression &lhs, const Expression &rhs)
+{
+	return Expression::binary(operation_types::ELEM_WISE_DIV, lhs, rhs);
+}
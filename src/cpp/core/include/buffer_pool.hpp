@@ -0,0 +1,103 @@
+#ifndef BUFFER_POOL_HPP
+#define BUFFER_POOL_HPP
+
+#ifndef CL_TARGET_OPENCL_VERSION
+#define CL_TARGET_OPENCL_VERSION 120
+#endif
+#include <CL/cl.h>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// Recycles device buffers across operations so steady-state work avoids
+// clCreateBuffer/clReleaseMemObject. Requests are rounded up to size buckets
+// (four per power of two) and released buffers wait in per-bucket free lists.
+// Every method may be called from several threads.
+class BufferPool
+{
+public:
+	struct Stats
+	{
+		size_t bytes_pooled = 0;	  // Idle bytes held in the free lists
+		size_t bytes_in_use = 0;	  // Bytes currently handed out
+		size_t peak_bytes_in_use = 0; // High-water mark of bytes_in_use
+		size_t hits = 0;			  // Acquires served from the free lists
+		size_t misses = 0;			  // Acquires that created a buffer
+		double create_seconds = 0.0;  // Host time spent creating buffers on misses
+		double hit_rate() const { return hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0; }
+	};
+
+	// host_alignment > 0 backs every buffer with host memory aligned to it
+	// (CL_MEM_USE_HOST_PTR), for devices that share memory with the host
+	explicit BufferPool(cl_context context, size_t host_alignment = 0);
+	~BufferPool(); // Releases every pooled buffer
+
+	BufferPool(const BufferPool &) = delete;
+	BufferPool &operator=(const BufferPool &) = delete;
+
+	// Returns a CL_MEM_READ_WRITE buffer of at least bytes. When the buffer is
+	// recycled, ready receives an event (owned by the caller) that must complete
+	// before the buffer is written, otherwise nullptr.
+	cl_mem acquire(size_t bytes, cl_event *ready);
+
+	// Hands a buffer from acquire(bytes) back. reusable_after (ownership taken,
+	// may be nullptr) completes once no queued command uses the buffer anymore.
+	void release(cl_mem buffer, size_t bytes, cl_event reusable_after);
+
+	// Whether buffer is backed by host memory of this pool
+	bool host_backed(cl_mem buffer) const;
+
+	// Takes a host-backed buffer from acquire(bytes) out of the pool: the cl_mem
+	// is released (deleted once queued commands are done with it) and its host
+	// memory is returned for the caller to free()
+	float *detach(cl_mem buffer, size_t bytes);
+
+	size_t get_host_alignment() const;
+	void set_host_alignment(size_t alignment); // Frees idle buffers of the previous kind
+
+	// Frees idle buffers, largest first, until at most target_bytes stay pooled
+	void trim(size_t target_bytes = 0);
+
+	// Idle bytes kept before released buffers are freed instead, and the
+	// largest single buffer worth pooling
+	void set_limits(size_t max_pooled_bytes, size_t max_buffer_bytes);
+
+	Stats get_stats() const;
+	void reset_stats(); // Clears counters, keeps current usage
+	cl_context get_context() const { return context; }
+
+	static size_t bucket_size(size_t bytes);
+
+private:
+	struct PooledBuffer
+	{
+		cl_mem buffer;
+		cl_event reusable_after;
+	};
+
+	// Host memory of a host-backed buffer, freed by the buffer's destructor callback unless detached
+	struct HostBlock
+	{
+		void *data;
+		bool owned;
+	};
+	static void CL_CALLBACK free_host_block(cl_mem buffer, void *user_data);
+
+	// Callers hold mutex
+	cl_mem create_buffer(size_t size, cl_int *err);
+	void free_buffer(PooledBuffer &pooled);
+	void trim_locked(size_t target_bytes);
+
+	mutable std::mutex mutex; // Guards everything below
+
+	cl_context context;
+	size_t host_alignment = 0;
+	std::map<cl_mem, HostBlock *> host_blocks;
+	std::map<size_t, std::vector<PooledBuffer>> free_lists;
+	size_t max_pooled_bytes = size_t(512) << 20;
+	size_t max_buffer_bytes = size_t(128) << 20;
+	Stats stats;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef DEVICE_MANAGER_HPP
+#define DEVICE_MANAGER_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#ifndef CL_TARGET_OPENCL_VERSION
+#define CL_TARGET_OPENCL_VERSION 120
+#endif
+#include <CL/cl.h>
+
+#include "operation_types.hpp"
+
+class OperationManager;
+
+// Every OpenCL device of every platform, each driven by its own
+// OperationManager (context, queue, caches). Large host GEMM and
+// elementwise ops are split into row panels across the devices in
+// proportion to their measured throughput and gathered into one result.
+class DeviceManager
+{
+public:
+	struct Device
+	{
+		cl_platform_id platform;
+		cl_device_id device;
+		cl_device_type type;
+		std::string name;
+		std::string platform_name;
+		cl_uint compute_units = 0;
+		cl_uint clock_mhz = 0;
+	};
+
+	static std::vector<Device> enumerate(); // Every device of every platform, platform order
+
+	DeviceManager(); // All devices from enumerate()
+	explicit DeviceManager(const std::vector<Device> &devices);
+	~DeviceManager();
+
+	DeviceManager(const DeviceManager &) = delete;
+	DeviceManager &operator=(const DeviceManager &) = delete;
+
+	size_t device_count() const { return devices.size(); }
+	const Device &device(size_t index) const { return devices.at(index); }
+	OperationManager &manager(size_t index) { return *managers.at(index); }
+
+	// Same contract as OperationManager's host ops; GEMM and elementwise
+	// ops above the split thresholds run on all devices at once, everything
+	// else on the device with the best measured GEMM throughput
+	float *multi_vector_op(operation_types op_type, float *lhs, int lheight, int lwidth, float *rhs, int rheight, int rwidth);
+	float *single_vector_op(operation_types op_type, float *data, int height, int width);
+
+	// Smallest ops worth splitting, smaller ones stay on one device
+	void set_split_thresholds(double min_gemm_flops, double min_elements);
+
+	// Work per second last measured for a device (flop/s for GEMM, elements/s
+	// for elementwise ops). Until then it is estimated from compute units and
+	// clock, scaled by how the measured devices compare to their own estimates.
+	double throughput(size_t index, operation_types op_type) const;
+
+private:
+	enum work_kinds
+	{
+		GEMM_WORK,
+		ELEMENTWISE_WORK,
+		WORK_KINDS
+	};
+	static work_kinds work_kind(operation_types op_type);
+
+	size_t fastest_device() const;
+	// Per device throughput() of kind, in one unit. Caller holds state_mutex.
+	std::vector<double> weights(work_kinds kind) const;
+
+	std::vector<Device> devices;
+	std::vector<std::unique_ptr<OperationManager>> managers;
+
+	// Per device throughput of each kind of work, smoothed across calls, and the
+	// compute units x clock guess used for devices not measured yet
+	std::vector<double> throughputs[WORK_KINDS];
+	std::vector<bool> measured[WORK_KINDS];
+	std::vector<double> estimates;
+	mutable std::mutex state_mutex; // Guards throughputs and measured, ops may come from several threads
+
+	double min_split_work[WORK_KINDS] = {2.0 * 512 * 512 * 512, 4.0 * 1024 * 1024};
+};
+
+#endif
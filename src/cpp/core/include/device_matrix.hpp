@@ -0,0 +1,82 @@
+#ifndef DEVICE_MATRIX_HPP
+#define DEVICE_MATRIX_HPP
+
+#ifndef CL_TARGET_OPENCL_VERSION
+#define CL_TARGET_OPENCL_VERSION 120
+#endif
+#include <CL/cl.h>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "buffer_pool.hpp"
+#include "op_future.hpp"
+
+// Row-major float matrix that lives in device memory.
+// Borrows its cl_mem from a BufferPool and keeps the pool and queue it was
+// created on alive, so results of OperationManager ops can be chained
+// without host copies.
+class DeviceMatrix
+{
+public:
+	DeviceMatrix(std::shared_ptr<BufferPool> pool, cl_command_queue queue, int height, int width); // Uninitialised contents
+	// Wraps buffer (at least height * width floats) without a pool, taking ownership of it
+	DeviceMatrix(cl_command_queue queue, cl_mem buffer, int height, int width);
+	~DeviceMatrix();
+
+	DeviceMatrix(DeviceMatrix &&other) noexcept;
+	DeviceMatrix &operator=(DeviceMatrix &&other) noexcept;
+	DeviceMatrix(const DeviceMatrix &) = delete;
+	DeviceMatrix &operator=(const DeviceMatrix &) = delete;
+
+	// Blocking transfers, data must hold height * width floats
+	void from_host(const float *data);
+	void to_host(float *data) const;
+	float *to_host() const; // Caller frees the returned malloc'd array
+
+	// Non-blocking transfers. data must stay valid until event() completes.
+	void from_host_async(const float *data, const std::vector<cl_event> &wait_list = {});
+	OpFuture to_host_async(const std::vector<cl_event> &wait_list = {}) const;
+	// Into data, which stays the caller's: the future's wait() returns nullptr
+	OpFuture to_host_async(float *data, const std::vector<cl_event> &wait_list = {}) const;
+
+	// Whether the buffer lives in host memory (see BufferPool's host_alignment),
+	// in which case take_host_async() hands the contents over without a copy
+	bool host_backed() const;
+	// Maps a host-backed buffer to make its memory current and gives that memory
+	// to the future, leaving this matrix empty
+	OpFuture take_host_async(const std::vector<cl_event> &wait_list = {});
+
+	// Event of the last queued command that writes this matrix (nullptr when
+	// none is pending). Operations reading the matrix wait on it.
+	cl_event event() const { return ready_event; }
+	void set_event(cl_event event); // Takes ownership of event
+	// Records a command queued on another queue that reads this matrix, so the
+	// buffer is not recycled before it runs (retains event)
+	void add_reader(cl_event event) const;
+	// Retained copies of the readers still pending, for a command that overwrites
+	// the matrix and must run after them. The caller releases them.
+	std::vector<cl_event> pending_readers() const;
+	void wait() const;
+	bool ready() const;
+
+	int height() const { return rows; }
+	int width() const { return cols; }
+	size_t size() const { return static_cast<size_t>(rows) * cols; }
+	size_t bytes() const { return size() * sizeof(float); }
+	cl_mem buffer() const { return mem; }
+	cl_command_queue command_queue() const { return queue; }
+
+private:
+	void release();
+	cl_event enqueue_read(float *data, const std::vector<cl_event> &wait_list) const; // Non-blocking, returns the read's event
+
+	std::shared_ptr<BufferPool> pool;
+	cl_command_queue queue = nullptr;
+	cl_mem mem = nullptr;
+	cl_event ready_event = nullptr;
+	mutable std::vector<cl_event> readers; // See add_reader()
+	int rows = 0;
+	int cols = 0;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef EXPRESSION_HPP
+#define EXPRESSION_HPP
+
+#include "device_matrix.hpp"
+#include "operation_types.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+// Lazily recorded elementwise expression over device matrices and scalars.
+// Operators only build a DAG; OperationManager::evaluate() runs the whole
+// thing as one generated kernel that reads each input once and writes only
+// the result, instead of one pass and one temporary per operation.
+//
+// Shapes follow ELEM_WISE_* broadcasting: the result has the lhs shape and
+// the rhs repeats its rows/columns across it; a scalar takes the other
+// operand's shape. Matrix leaves are held by reference and must outlive the
+// evaluation.
+class Expression
+{
+public:
+	Expression(const DeviceMatrix &matrix);
+	Expression(float value);
+
+	int height() const;
+	int width() const;
+
+	// Generated kernel for an expression. The source depends only on the
+	// expression's structure, so it doubles as the cache key.
+	struct FusedKernel
+	{
+		std::string source;							// Defines blitz_fused
+		std::vector<const DeviceMatrix *> matrices; // Distinct matrix leaves, in argument order
+		std::vector<float> scalars;					// Scalar leaves, in argument order after the matrices
+	};
+	FusedKernel fuse() const;
+
+	friend Expression operator+(const Expression &lhs, const Expression &rhs);
+	friend Expression operator-(const Expression &lhs, const Expression &rhs);
+	friend Expression operator*(const Expression &lhs, const Expression &rhs);
+	friend Expression operator/(const Expression &lhs, const Expression &rhs);
+
+private:
+	struct Node;
+	explicit Expression(std::shared_ptr<const Node> node);
+	static Expression binary(operation_types op_type, const Expression &lhs, const Expression &rhs);
+
+	// Shared so subexpressions reused in several places are computed once per element
+	std::shared_ptr<const Node> node;
+};
+
+Expression operator+(const Expression &lhs, const Expression &rhs);
+Expression operator-(const Expression &lhs, const Expression &rhs);
+Expression operator*(const Expression &lhs, const Expression &rhs);
+Expression operator/(const Expression &lhs, const Expression &rhs);
+
+#endif
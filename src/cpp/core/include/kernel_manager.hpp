@@ -7,6 +7,12 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <mutex>
+#ifndef CL_TARGET_OPENCL_VERSION
+#define CL_TARGET_OPENCL_VERSION 120
+#endif
+#include <CL/cl.h>
 #include "operation_types.hpp"
 class KernelManager{
 	public:
@@ -15,9 +21,52 @@ class KernelManager{
 		};
 
 
-		const char** getKernelSource(operation_types binding_name) const;
+		// Source of an operation's kernel file, read once and kept for the manager's lifetime.
+		// Safe to call from several threads.
+		const std::string& getKernelSource(operation_types binding_name) const;
+		std::vector<operation_types> getOperationTypes() const;
+
+		// Builds the kernel program for one device, reusing a binary from the
+		// on-disk cache when one matches the source, options, platform and driver.
+		// Sets from_binary to whether the cached binary was used.
+		cl_program buildProgram(cl_context context, cl_device_id device, operation_types binding_name,
+								const std::string& build_options, bool* from_binary = nullptr) const;
+		// Same for generated source, such as fused expression kernels
+		cl_program buildProgram(cl_context context, cl_device_id device, const std::string& source,
+								const std::string& build_options, bool* from_binary = nullptr) const;
+
+		// Directory used for cached program binaries, an empty path disables the cache.
+		// Defaults to $BLITZMAT_KERNEL_CACHE, then $XDG_CACHE_HOME/blitzmat/kernels,
+		// then $HOME/.cache/blitzmat/kernels.
+		void setBinaryCacheDir(const std::string& directory);
+		std::string getBinaryCacheDir() const;
+
+		// How an elementwise kernel indexes rhs, see elementwise_common.cl
+		enum class Broadcast { GENERIC, NONE, ROW, COLUMN, SCALAR };
+		static Broadcast broadcastKind(int lheight, int lwidth, int rheight, int rwidth);
+		// -D options specializing an elementwise program for broadcast, plus the
+		// sizes as constants when fixedShape is set. The options are the
+		// specialization key, programs are cached per distinct string.
+		static std::string elementwiseOptions(Broadcast broadcast, bool fixedShape, int lheight, int lwidth,
+											  int rheight, int rwidth);
+
+		// Platform, device and driver names and versions: what identifies a device across processes
+		static std::string deviceIdentity(cl_device_id device);
+		// 16 hex digit hash of key, used for cache file names
+		static std::string keyHash(const std::string& key);
+		// Creates every missing directory along path, like mkdir -p
+		static bool createDirectories(const std::string& path);
 
 	private:
+		std::string binaryCacheKey(cl_device_id device, const std::string& source, const std::string& build_options) const;
+		cl_program loadCachedBinary(cl_context context, cl_device_id device, const std::string& path,
+									const std::string& key, const std::string& build_options) const;
+		void storeCachedBinary(cl_program program, const std::string& directory, const std::string& path,
+							   const std::string& key) const;
+
+		std::string binary_cache_dir = defaultBinaryCacheDir();
+		static std::string defaultBinaryCacheDir();
+
 		std::unordered_map<operation_types, std::string> lookup_table = {
 
 		//	Name used in Binding						File Location
@@ -30,11 +79,14 @@ class KernelManager{
 			{operation_types::TRACE,					"src/cpp/core/kernels/trace.cl"},
 			{operation_types::TRANSPOSE,				"src/cpp/core/kernels/transpose.cl"},
 			{operation_types::MATRIX_MULTIPLICATION, 	"src/cpp/core/kernels/mat_mul.cl"},
-			{operation_types::FROBENIUS_NORM, 			"src/cpp/core/kernels/frb_nrm.cl"}
+			{operation_types::FROBENIUS_NORM, 			"src/cpp/core/kernels/frb_nrm.cl"},
+			{operation_types::LU_DECOMPOSITION, 		"src/cpp/core/kernels/lu.cl"}
 		};
+		// Appended to the ELEM_WISE_* files, which only define their operator
+		const std::string elementwise_common_path = "src/cpp/core/kernels/elementwise_common.cl";
+		// Guards kernel_sources and binary_cache_dir
+		mutable std::mutex mutex;
 		mutable std::unordered_map<operation_types, std::string> kernel_sources;
-		mutable const char* current_source;
-    	mutable const char* source_array[1];  // Array of size 1 for OpenCL
 };
 
 
@@ -0,0 +1,74 @@
+#ifndef MAPPED_MATRIX_HPP
+#define MAPPED_MATRIX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+enum class bmat_dtypes : uint32_t
+{
+	FLOAT32 = 1
+};
+
+// Header at the start of a .bmat file, in little-endian byte order. Zero
+// padding follows up to data_offset, then the raw elements. data_offset is a
+// multiple of alignment (the page size when written here), so the data can be
+// mapped and handed to a device without copying it first.
+struct BmatHeader
+{
+	char magic[4];		  // "BMAT"
+	uint32_t version;	  // 1
+	uint32_t dtype;		  // bmat_dtypes
+	uint32_t ndim;		  // 2
+	uint64_t shape[2];	  // Rows, columns
+	uint64_t strides[2];  // Bytes between rows and between columns
+	uint64_t alignment;	  // Bytes, a power of two
+	uint64_t data_offset; // Bytes from the start of the file to the first element
+};
+static_assert(sizeof(BmatHeader) == 64, "BmatHeader must match the on-disk layout");
+
+// Row-major float matrix backed by a memory-mapped file. The OS pages the
+// data in as it is read, so operands larger than RAM can be handed to
+// OperationManager::streaming_gemm, which only touches one panel at a time.
+class MappedMatrix
+{
+public:
+	// Maps height * width floats of an existing file starting offset bytes in
+	static MappedMatrix open(const std::string &path, int height, int width, size_t offset = 0, bool writable = false);
+	// Creates (or truncates) path to hold height * width floats and maps it writable
+	static MappedMatrix create(const std::string &path, int height, int width);
+	// .bmat files, see BmatHeader. Only C-contiguous float32 data can be opened.
+	static MappedMatrix open_bmat(const std::string &path, bool writable = false);
+	static MappedMatrix create_bmat(const std::string &path, int height, int width); // Zero-filled, mapped writable
+	static void save_bmat(const std::string &path, const float *data, int height, int width);
+	~MappedMatrix();
+
+	MappedMatrix(MappedMatrix &&other) noexcept;
+	MappedMatrix &operator=(MappedMatrix &&other) noexcept;
+	MappedMatrix(const MappedMatrix &) = delete;
+	MappedMatrix &operator=(const MappedMatrix &) = delete;
+
+	const float *data() const { return values; }
+	float *data() { return values; } // Only writable when mapped writable
+	int height() const { return rows; }
+	int width() const { return cols; }
+	size_t size() const { return static_cast<size_t>(rows) * cols; }
+	size_t bytes() const { return size() * sizeof(float); }
+	bool writable() const { return read_write; }
+
+	// Writes modified pages of a writable mapping back to the file
+	void sync();
+
+private:
+	MappedMatrix(void *mapping, size_t mapping_bytes, size_t data_offset, int height, int width, bool writable);
+	void unmap();
+
+	void *mapping = nullptr;
+	size_t mapping_bytes = 0;
+	float *values = nullptr;
+	int rows = 0;
+	int cols = 0;
+	bool read_write = false;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef NATIVE_BACKEND_HPP
+#define NATIVE_BACKEND_HPP
+
+#include "operation_types.hpp"
+#include "native_kernels.hpp"
+#include "thread_pool.hpp"
+#include <mutex>
+
+// Host implementation of the operation_types interface for data already in
+// host memory: no OpenCL runtime, JIT or buffer copies. Kernels are picked
+// for the best instruction set the CPU reports at runtime and loops are
+// spread over a thread pool. Results are malloc'd like the OpenCL host ops.
+class NativeBackend
+{
+public:
+	// threads = 0 uses every hardware thread, max_level caps the instruction set (e.g. to compare them)
+	explicit NativeBackend(unsigned threads = 0, simd_levels max_level = simd_levels::AVX512);
+
+	float *multi_vector_op(operation_types op_type, const float *lhs, int lheight, int lwidth, const float *rhs, int rheight, int rwidth);
+	float *single_vector_op(operation_types op_type, const float *data, int height, int width);
+	// Same, writing into result (operation_result_shape() floats) instead of allocating it
+	void multi_vector_op(operation_types op_type, const float *lhs, int lheight, int lwidth, const float *rhs, int rheight, int rwidth,
+						 float *result);
+	void single_vector_op(operation_types op_type, const float *data, int height, int width, float *result);
+	// result = epilogue(alpha * (lhs * rhs) + beta * result), see GemmEpilogue
+	void gemm(float alpha, const float *lhs, int lheight, int lwidth, const float *rhs, int rheight, int rwidth, float beta,
+			  float *result, const HostGemmEpilogue &epilogue = HostGemmEpilogue());
+
+	// Matrices stored back to back as [batch, h, w], computed one after another
+	float *batched_multi_vector_op(operation_types op_type, const float *lhs, int batch, int lheight, int lwidth, const float *rhs,
+								   int rheight, int rwidth);
+	float *batched_single_vector_op(operation_types op_type, const float *data, int batch, int height, int width);
+
+	float *slogdet(const float *data, int height, int width); // 1 x 2 [sign, log|det|]
+
+	simd_levels instruction_set() const { return kernels.level; }
+	const char *instruction_set_name() const { return kernels.name; }
+	unsigned thread_count() const { return pool.size(); }
+
+private:
+	// C (m x n) = A (m x k) * B (k x n), all row-major
+	void gemm(const float *a, const float *b, float *c, int m, int n, int k);
+	void elementwise(char op, const float *lhs, int lheight, int lwidth, const float *rhs, int rheight, int rwidth, float *result);
+	void transpose(const float *data, int height, int width, float *result);
+	double sum_squares(const float *data, size_t count);
+
+	// In-place partially pivoted LU, same packing and pivots as OperationManager::lu_factor.
+	// Returns the number of row swaps.
+	int lu_factor(float *lu, int *pivots, int n);
+	void lu_inverse(const float *lu, const int *pivots, int n, float *result);
+
+	// Cache blocking of gemm: kc x nr strips of B stay in L1, mc x kc blocks of A in L2
+	static const int gemm_kc = 256;
+	static const int gemm_mc = 120;
+	static const int gemm_nc = 3072;
+
+	const NativeKernels &kernels;
+	ThreadPool pool;
+	// Held for the whole of every public op: the pool runs one loop at a time, so
+	// threads sharing a backend take turns. Recursive as ops call each other.
+	std::recursive_mutex op_mutex;
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef NATIVE_KERNELS_HPP
+#define NATIVE_KERNELS_HPP
+
+#include <cstddef>
+
+// Instruction sets the native CPU backend has kernels for, in increasing order
+enum class simd_levels
+{
+	SCALAR,
+	AVX2,	// AVX2 + FMA
+	AVX512	// AVX-512F
+};
+
+// Row-level kernels of the native backend compiled for one instruction set.
+// NativeBackend does the blocking and threading and calls these on
+// contiguous runs of floats.
+struct NativeKernels
+{
+	simd_levels level;
+	const char *name;
+
+	// GEMM register tile: gemm_mr rows by gemm_nr columns of C per micro-kernel call
+	int gemm_mr;
+	int gemm_nr;
+
+	// C[rows x cols] (= or +=) packed A (kc x gemm_mr strip) * packed B (kc x gemm_nr strip),
+	// rows <= gemm_mr and cols <= gemm_nr handle the edges of C
+	void (*gemm_micro)(int kc, const float *a, const float *b, float *c, int ldc, int rows, int cols, bool accumulate);
+
+	// out[i] = lhs[i] op rhs[i] and out[i] = lhs[i] op rhs, op being one of '+', '-', '*', '/'
+	void (*binary)(char op, const float *lhs, const float *rhs, float *out, size_t count);
+	void (*binary_scalar)(char op, const float *lhs, float rhs, float *out, size_t count);
+
+	void (*axpy)(float alpha, const float *x, float *y, size_t count); // y += alpha * x
+	double (*sum_squares)(const float *data, size_t count);
+};
+
+// Best kernels this CPU supports, capped at max_level
+const NativeKernels &select_native_kernels(simd_levels max_level);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef OP_FUTURE_HPP
+#define OP_FUTURE_HPP
+
+#ifndef CL_TARGET_OPENCL_VERSION
+#define CL_TARGET_OPENCL_VERSION 120
+#endif
+#include <CL/cl.h>
+
+// Handle to a host result that is still being produced on the device.
+// Wraps the cl_event of the final read so it can be passed in the wait list
+// of later operations, letting work chain on the device without host syncs.
+class OpFuture
+{
+public:
+	OpFuture(cl_event event, float *result); // Takes ownership of both
+	~OpFuture();								// Waits for the device before freeing an untaken result
+
+	OpFuture(OpFuture &&other) noexcept;
+	OpFuture &operator=(OpFuture &&other) noexcept;
+	OpFuture(const OpFuture &) = delete;
+	OpFuture &operator=(const OpFuture &) = delete;
+
+	// Blocks until the result is on the host and hands its ownership to the
+	// caller (free() it, like the blocking ops). Returns nullptr if already taken.
+	float *wait();
+	bool ready() const; // True once the device has finished, never blocks
+	cl_event event() const { return done_event; }
+
+private:
+	void release();
+
+	cl_event done_event = nullptr;
+	float *result = nullptr;
+};
+
+#endif
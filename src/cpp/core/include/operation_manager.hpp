@@ -7,31 +7,483 @@
 
 #include "kernel_manager.hpp"
 #include "operation_types.hpp"
+#include "device_matrix.hpp"
+#include "op_future.hpp"
+#include "buffer_pool.hpp"
+#include "expression.hpp"
+#include "native_backend.hpp"
+#include "mapped_matrix.hpp"
 #include <cassert>
 #include <vector>
+#include <map>
+#include <set>
+#include <tuple>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
 
+// Operations may be called on one manager from several threads at once. Each
+// calling thread runs its op on a lane of its own (an in-order command queue
+// with private kernel objects) while programs, the buffer pool and the profile
+// are shared. Lanes are created on demand up to max_queues(); more concurrent
+// callers wait for a free one. Device matrices may be passed between threads,
+// their events order the work across queues. Configuration calls (the set_*
+// functions, load_tuning() and autotune()) must not overlap other calls.
 class OperationManager
 {
 public:
 	enum class device_types
 	{
-		CPU_DEVICE,
-		GPU_DEVICE
+		CPU_DEVICE, // OpenCL CPU runtime
+		GPU_DEVICE,
+		NATIVE_CPU	// NativeBackend on the host, no OpenCL; only the host (float *) operations are available
+	};
+	// Which kernel implementation an operation dispatches to
+	enum class kernel_variants
+	{
+		AUTO,	   // Optimized kernel when the problem is large enough to benefit
+		REFERENCE, // Original one-work-item-per-output kernel
+		OPTIMIZED  // Optimized kernel whenever the device supports it
+	};
+
+	// Counters for the compiled program/kernel cache
+	struct CacheStats
+	{
+		size_t kernel_hits = 0;		// Calls served by an already created kernel
+		size_t kernel_misses = 0;	// Calls that had to create a kernel
+		size_t program_builds = 0;	// Programs compiled from source
+		size_t binary_loads = 0;	// Programs loaded from the on-disk binary cache
+		double build_seconds = 0.0; // Total time spent building/loading programs
 	};
-	OperationManager(device_types device_type); // Sets context/queue
-	~OperationManager();						// Releases Queue/Context
+
+	// profiling creates the queues with CL_QUEUE_PROFILING_ENABLE and records every op, see get_profile()
+	OperationManager(device_types device_type, bool profiling = false); // Sets context/queue on the first such device of any platform
+	OperationManager(cl_platform_id platform, cl_device_id device, bool profiling = false); // A specific device, see DeviceManager::enumerate()
+	~OperationManager();						// Releases Kernels/Programs/Queue/Context
 
 	float *multi_vector_op(operation_types op_type, float *lhs, int lheight, int lwidth, float *rhs, int rheight, int rwidth);
 	float *single_vector_op(operation_types op_type, float *data, int height, int width);
+	// Same, writing the result into out (operation_result_shape() floats) instead of allocating it
+	void multi_vector_op(operation_types op_type, const float *lhs, int lheight, int lwidth, const float *rhs, int rheight, int rwidth,
+						 float *out);
+	void single_vector_op(operation_types op_type, const float *data, int height, int width, float *out);
+	// result = epilogue(alpha * (lhs * rhs) + beta * result) in one launch, see
+	// GemmEpilogue. result holds lheight x rwidth floats and is only read when
+	// beta is not 0.
+	void gemm(float alpha, const float *lhs, int lheight, int lwidth, const float *rhs, int rheight, int rwidth, float beta,
+			  float *result, const HostGemmEpilogue &epilogue = HostGemmEpilogue());
+	// Out-of-core lhs * rhs for host operands of any size, such as MappedMatrix
+	// files larger than device memory or RAM. A, B and C are split into panels
+	// that fit device_budget bytes of device memory (0 uses half of it), and the
+	// next panels upload on a second queue while the current ones compute.
+	// The host MATRIX_MULTIPLICATION ops switch to this on their own when an
+	// operand or the result exceeds the device's largest allocation.
+	void streaming_gemm(const float *lhs, int lheight, int lwidth, const float *rhs, int rheight, int rwidth, float *result,
+						size_t device_budget = 0);
+
+	// Device-resident variants, inputs and results stay in device memory so
+	// chained operations skip the host round trip. Use DeviceMatrix::to_host()
+	// to read a result back.
+	// Device ops only enqueue work: the result's event() completes when it is
+	// ready, and later ops on it wait for that event on the device. wait_list
+	// adds extra dependencies (e.g. OpFuture::event() of other work).
+	DeviceMatrix from_host(const float *data, int height, int width);
+	DeviceMatrix from_host_async(const float *data, int height, int width, const std::vector<cl_event> &wait_list = {});
+	// Device copy of a mapped file without a second copy in host memory. Zero-copy
+	// devices use the mapping itself as the buffer, others get it in non-blocking
+	// writes of chunk_bytes each, so the file pages in as the transfer goes.
+	// The mapping is kept alive as long as the device still needs it. A zero-copy
+	// result is read-only to kernels, and gemm() rejects it as its result.
+	DeviceMatrix from_mapped(std::shared_ptr<const MappedMatrix> mapped, size_t chunk_bytes = 64 << 20,
+							 const std::vector<cl_event> &wait_list = {});
+	DeviceMatrix load_bmat(const std::string &path); // from_mapped() of MappedMatrix::open_bmat(path)
+	DeviceMatrix multi_vector_op(operation_types op_type, const DeviceMatrix &lhs, const DeviceMatrix &rhs,
+								 const std::vector<cl_event> &wait_list = {});
+	DeviceMatrix single_vector_op(operation_types op_type, const DeviceMatrix &data,
+								  const std::vector<cl_event> &wait_list = {});
+	// Fused GEMM into an existing result, which must not alias lhs or rhs
+	void gemm(float alpha, const DeviceMatrix &lhs, const DeviceMatrix &rhs, float beta, DeviceMatrix &result,
+			  const DeviceGemmEpilogue &epilogue = DeviceGemmEpilogue(), const std::vector<cl_event> &wait_list = {});
+	// Fused GEMM into a new matrix, i.e. beta = 0
+	DeviceMatrix gemm(const DeviceMatrix &lhs, const DeviceMatrix &rhs, const DeviceGemmEpilogue &epilogue, float alpha = 1.0f,
+					  const std::vector<cl_event> &wait_list = {});
+
+	// Batched variants for many small matrices stored back to back as
+	// [batch, h, w] (a batch * h x w matrix), computed in one launch with one
+	// work-group per matrix. Supports MATRIX_MULTIPLICATION, DETERMINANT
+	// (batch x 1 result), INVERSE and TRANSPOSE on matrices up to
+	// batch_max_size() in each dimension.
+	float *batched_multi_vector_op(operation_types op_type, float *lhs, int batch, int lheight, int lwidth, float *rhs, int rheight, int rwidth);
+	float *batched_single_vector_op(operation_types op_type, float *data, int batch, int height, int width);
+	DeviceMatrix batched_multi_vector_op(operation_types op_type, const DeviceMatrix &lhs, const DeviceMatrix &rhs, int batch,
+										 const std::vector<cl_event> &wait_list = {});
+	DeviceMatrix batched_single_vector_op(operation_types op_type, const DeviceMatrix &data, int batch,
+										  const std::vector<cl_event> &wait_list = {});
+	static int batch_max_size() { return 32; } // BATCH_MAX of the blitz_batched_kernel kernels
+
+	// Runs a lazily built elementwise expression as one fused kernel. The
+	// generated program is cached by the expression's structure, so repeated
+	// evaluations with other matrices or scalar values reuse it.
+	DeviceMatrix evaluate(const Expression &expression, const std::vector<cl_event> &wait_list = {});
+
+	// Partially pivoted LU factors of a square matrix, reusable by later ops
+	struct LUFactors
+	{
+		DeviceMatrix lu;	 // L below the diagonal (unit diagonal implied), U on and above it
+		DeviceMatrix pivots; // 1 x n cl_int row indices, row i was swapped with pivots[i] at step i
+	};
+	LUFactors lu_factor(const DeviceMatrix &data, const std::vector<cl_event> &wait_list = {});
+
+	// Transposes a square matrix without allocating a result
+	void transpose_in_place(DeviceMatrix &matrix, const std::vector<cl_event> &wait_list = {});
+
+	// Inverse from existing factors; a singular matrix yields non-finite entries
+	DeviceMatrix lu_inverse(const LUFactors &factors, const std::vector<cl_event> &wait_list = {});
+
+	// Determinant as a 1 x 2 [sign, log|det|], finite where det itself would
+	// overflow. A singular matrix gives sign 0 and log|det| -inf.
+	float *slogdet(float *data, int height, int width);
+	DeviceMatrix slogdet(const DeviceMatrix &data, const std::vector<cl_event> &wait_list = {});
+	DeviceMatrix slogdet(const LUFactors &factors, const std::vector<cl_event> &wait_list = {});
+
+	// Non-blocking host variants. Inputs must stay valid until the returned
+	// future is ready; wait() then yields the malloc'd result.
+	OpFuture multi_vector_op_async(operation_types op_type, const float *lhs, int lheight, int lwidth, const float *rhs, int rheight, int rwidth,
+								   const std::vector<cl_event> &wait_list = {});
+	OpFuture single_vector_op_async(operation_types op_type, const float *data, int height, int width,
+									const std::vector<cl_event> &wait_list = {});
+
+	// Builds and caches kernels ahead of time so later calls never reach the compiler
+	void warm_up();
+	void warm_up(const std::vector<operation_types> &op_types);
+
+	CacheStats get_cache_stats() const;
+	void reset_cache_stats();
+
+	// Directory for cached program binaries shared across processes, empty disables it
+	void set_binary_cache_dir(const std::string &directory);
+
+	void set_kernel_variant(operation_types op_type, kernel_variants variant);
+	kernel_variants get_kernel_variant(operation_types op_type) const;
+
+	// Elementwise kernels are built per broadcast pattern (REFERENCE keeps the
+	// generic modulo-indexed one). A shape launched min_calls times also gets a
+	// program with its sizes compiled in, for up to max_fixed_shapes() shapes;
+	// 0 turns fixed-shape programs off.
+	void set_shape_specialization(size_t min_calls);
+	static size_t max_fixed_shapes() { return 16; }
+
+	// Times variants of the tiled GEMM (tile and work-per-item), the tiled
+	// transpose (tile and work-group rows), the elementwise work-group shape and
+	// the flat elementwise vector width on this device, keeps the fastest of
+	// each and saves them to tuning_path().
+	// representative_size is the edge of the square test problems, 0 picks one
+	// for the device type. Returns tuning_string() of the winners.
+	std::string autotune(int representative_size = 0);
+	// Tunings are stored per device, and the constructor loads this device's
+	// file when there is one. The directory defaults to $BLITZMAT_TUNING_DIR,
+	// then $XDG_CACHE_HOME/blitzmat/tuning, then $HOME/.cache/blitzmat/tuning.
+	std::string tuning_path() const; // Empty when there is no directory or no OpenCL device
+	void set_tuning_dir(const std::string &directory);
+	// Returns false, keeping the current parameters, if the file is missing,
+	// belongs to another device or holds parameters this device cannot run
+	bool load_tuning(const std::string &path);
+	bool save_tuning(const std::string &path) const;
+	std::string tuning_string() const; // Current parameters, one "gemm", "transpose" and "elementwise" line
+
+	void finish(); // Blocks until every queued operation, on every lane, has completed
+
+	// Upper bound on command queues, and so on threads running ops at the same
+	// time. Lanes already created are kept when it is lowered.
+	size_t max_queues() const;
+	void set_max_queues(size_t count);
+	size_t queue_count() const; // Lanes created so far
+
+	// Timings of one public operation (nested calls count towards the outermost).
+	// Write/kernel/read phases are summed from OpenCL event timestamps, build
+	// and buffer phases are host time.
+	struct OpProfile
+	{
+		std::string name;				   // operation_name() of the op, or e.g. "from_host", "evaluate"
+		int height = 0;					   // Input shape, lhs for two-matrix ops
+		int width = 0;
+		int rhs_height = 0;				   // 0 x 0 for single-matrix ops
+		int rhs_width = 0;
+		size_t bytes_moved = 0;			   // Bytes the op's kernels read and write
+		double flops = 0.0;				   // Floating point operations, 0 for pure data movement
+		double build_seconds = 0.0;		   // Compiling or loading programs
+		double buffer_seconds = 0.0;	   // Creating device buffers
+		double write_seconds = 0.0;		   // Host to device copies
+		double kernel_seconds = 0.0;	   // Kernels and device-side copies
+		double read_seconds = 0.0;		   // Device to host copies
+		double start_seconds = 0.0;		   // Host clock when the op was called, relative to the manager's creation
+		double end_seconds = 0.0;		   // Completion of its last device command on the same clock
+		int queue = 0;					   // Lane (command queue) the op ran on, one per concurrent caller
+
+		// Every device command, device timestamps shifted onto the host clock
+		struct Span
+		{
+			std::string phase; // "write", "kernel" or "read"
+			double start_seconds;
+			double end_seconds;
+		};
+		std::vector<Span> spans;
+
+		double gflops() const { return kernel_seconds > 0.0 ? flops / kernel_seconds * 1e-9 : 0.0; }
+		double gbytes_per_second() const { return kernel_seconds > 0.0 ? bytes_moved / kernel_seconds * 1e-9 : 0.0; }
+	};
+
+	bool profiling_enabled() const { return profiling; }
+	// Records of every op since creation or reset_profile(), in the order the
+	// ops returned. Waits for device work of ops still in flight.
+	std::vector<OpProfile> get_profile();
+	void reset_profile();
+	// Writes get_profile() as Chrome trace JSON (chrome://tracing, Perfetto): per queue, ops on
+	// one track and their device commands on another. Returns false if the file cannot be written.
+	bool export_chrome_trace(const std::string &path);
+
+	// Zero-copy host operations, on by default when the device shares host
+	// memory (CPU runtimes, most integrated GPUs). Inputs aligned to
+	// host_alignment() are used in place instead of copied, and results are
+	// computed in host memory that is returned as is. Enabling it on other
+	// devices is allowed but usually slower.
+	bool zero_copy_enabled() const { return zero_copy; }
+	void set_zero_copy(bool enabled);
+	size_t host_alignment() const { return base_alignment; } // CL_DEVICE_MEM_BASE_ADDR_ALIGN in bytes
+	// Page-aligned memory for height x width floats that always takes the
+	// zero-copy path, free() it like op results
+	float *alloc_host(int height, int width) const;
+
+	// Device buffers are recycled through a size-bucketed pool
+	BufferPool::Stats get_pool_stats() const;
+	void trim_pool(size_t target_bytes = 0); // Frees idle buffers down to target_bytes
+	void set_pool_limits(size_t max_pooled_bytes, size_t max_buffer_bytes);
 
 private:
+	void init(cl_platform_id platform_id, cl_device_id device_id); // Creates context, first lane and pool for device
+
+	// Profiling state, records stay pending until their events are resolved
+	struct ProfileEvent
+	{
+		const char *phase;
+		cl_event event;
+	};
+	struct PendingProfile
+	{
+		OpProfile profile;
+		std::vector<ProfileEvent> events;
+	};
+
+	// A command queue with its own kernel objects, used by one thread at a time
+	// since clSetKernelArg on a shared cl_kernel is not thread-safe
+	struct Lane
+	{
+		const OperationManager *owner;
+		int index;				 // Position in lanes, reported as OpProfile::queue
+		cl_command_queue queue;
+		std::map<std::tuple<operation_types, std::string, std::string>, cl_kernel> kernels;
+		std::map<std::string, cl_kernel> fused_kernels; // Keyed by generated source
+		int depth = 0;				 // Nesting of OpScopes on the lane, the outermost owns it
+		bool profiled = false;		 // Whether the outermost op is recording
+		PendingProfile open_profile; // Record of the outermost op while it runs
+	};
+	static thread_local Lane *active_lane; // Lane of the innermost op running on this thread
+
+	// Opened by every public op: binds the calling thread to a lane until the
+	// outermost op on it returns (nested ops share it), and records the op when profiling
+	class OpScope
+	{
+	public:
+		OpScope(OperationManager &manager, const std::string &name, int height, int width, int rhs_height = 0, int rhs_width = 0,
+				double flops = 0.0, size_t bytes_moved = 0);
+		OpScope(OperationManager &manager, operation_types op_type, int height, int width, int rhs_height = 0, int rhs_width = 0,
+				int batch = 1);
+		~OpScope();
+		OpScope(const OpScope &) = delete;
+		OpScope &operator=(const OpScope &) = delete;
+
+	private:
+		OperationManager &manager;
+		Lane *previous; // active_lane before this scope, restored on exit
+		Lane *lane;
+		double build_start = 0.0;
+		double buffer_start = 0.0;
+	};
+
+	Lane *acquire_lane(); // Idle lane, a new one while under max_queues, otherwise waits
+	void release_lane(Lane *lane);
+	Lane &current_lane() const; // Lane of the op running on this thread
+	cl_command_queue queue() const { return current_lane().queue; }
+
+	// Retains event as a phase of the open profile record, if any
+	void record_event(const char *phase, cl_event event);
+	// Blocking read of a host op's result, recording the read when profiling.
+	// Zero-copy results hand over their host memory and leave result empty.
+	float *read_result(DeviceMatrix &result);
+	void read_result(const DeviceMatrix &result, float *out);
+	OpFuture read_result_async(DeviceMatrix &result);
+	// A host op's input, wrapping data itself when zero-copy applies and copying it otherwise
+	DeviceMatrix host_input(const float *data, int height, int width, bool blocking = true,
+							const std::vector<cl_event> &wait_list = {});
+	size_t page_alignment() const; // Of zero-copy pool buffers and alloc_host(), never below host_alignment()
+	void resolve_profiles(); // Turns the events of pending records into timings
+	double host_seconds() const;
+
+	// Tile shape of blitz_kernel_tiled in mat_mul.cl, passed to the program as -D options
+	struct GemmTiling
+	{
+		int tsm = 64;  // Result rows per work-group
+		int tsn = 64;  // Result columns per work-group
+		int tsk = 16;  // Shared dimension per local memory tile
+		int wptm = 4;  // Result rows per work-item
+		int wptn = 4;  // Result columns per work-item
+		std::string build_options() const;
+	};
+
+	// Tile shape of blitz_kernel_tiled/blitz_kernel_inplace in transpose.cl. All
+	// transpose kernels share one program built with these options.
+	struct TransposeTiling
+	{
+		int tile = 32; // Edge of the square tile staged in local memory
+		int rows = 8;  // Work-group rows, each work-item moves tile / rows elements
+		std::string build_options() const;
+	};
+
+	// Work-group shape of the 2-D elementwise kernels, 0 x 0 leaves it to the
+	// driver, and floats per work-item of the flat same-shape kernel
+	struct ElementwiseLaunch
+	{
+		size_t rows = 0;	  // Local size along result rows (dimension 0)
+		size_t cols = 0;	  // Local size along result columns
+		int vector_width = 4; // 4, 8 or 16, passed to the program as -DVECTOR_WIDTH
+		std::string build_options() const;
+	};
+
+	// Whether the device can launch these parameters at all
+	bool valid_tiling(const GemmTiling &tiling) const;
+	bool valid_tiling(const TransposeTiling &tiling) const;
+	bool valid_launch(const ElementwiseLaunch &launch) const;
+
+	// Fastest of a warm-up then three timed runs of fn, each run waiting for the queue
+	double time_runs(const std::function<void()> &fn);
+	// Drops cached programs/kernels of op_type built with options other than keep
+	void evict_programs(operation_types op_type, const std::vector<std::string> &keep);
+	static std::string default_tuning_dir();
+
+	// Panel width of the blocked LU in lu.cl and the tile edge of its trailing update
+	struct LUBlocking
+	{
+		int panel = 32;
+		size_t tile = 16;
+		std::string build_options(size_t work_group) const;
+	};
+
+	// Options of the program holding an operation's blitz_kernel and blitz_batched_kernel
+	std::string program_options(operation_types op_type) const;
+	// Every (op, build options) program an operation may dispatch to
+	std::vector<std::pair<operation_types, std::string>> dispatch_programs(operation_types op_type) const;
+
+	bool use_optimized_kernel(operation_types op_type, bool worthwhile) const;
+	// Counts an elementwise launch of this shape, true once it has a fixed-shape program
+	bool hot_shape(int lheight, int lwidth, int rheight, int rwidth);
+	size_t kernel_work_group_size(cl_kernel kernel) const;
+
+	// Enqueues kernel after wait_list and the pending writes of inputs, recording the launch on result
+	void enqueue_kernel(cl_kernel kernel, cl_uint work_dim, const size_t *global_work_size, const size_t *local_work_size,
+						const std::vector<cl_event> &wait_list, const std::vector<const DeviceMatrix *> &inputs,
+						DeviceMatrix &result);
+
+	std::string reduce_build_options() const;
+
+	// Same-shape elementwise op as one 1-D launch of blitz_kernel_flat, vector_width floats per work-item
+	DeviceMatrix enqueue_flat_elementwise(operation_types op_type, const DeviceMatrix &lhs, const DeviceMatrix &rhs,
+										  const std::string &build_options, const std::vector<cl_event> &wait_list);
+
+	// Edge of the square panels streaming_gemm splits matrices into
+	int streaming_panel(size_t device_budget) const;
+	bool needs_streaming(int lheight, int lwidth, int rwidth) const;
+	// Non-blocking copies between a block of a host matrix (host_width floats per
+	// row) at (row, col) and a panel of the same shape, queued on transfer
+	void upload_block(cl_command_queue transfer, const float *host, int host_width, int row, int col, DeviceMatrix &panel);
+	void download_block(cl_command_queue transfer, DeviceMatrix &panel, float *host, int host_width, int row, int col);
+
+	// Picks the tiled or reference GEMM kernel and enqueues it into result.
+	// The plain product skips the epilogue specialization entirely.
+	void enqueue_gemm(const DeviceMatrix &lhs, const DeviceMatrix &rhs, DeviceMatrix &result, const DeviceGemmEpilogue &epilogue,
+					  float alpha, float beta, const std::vector<cl_event> &wait_list);
+	// -D options selecting the epilogue steps of mat_mul.cl, empty for the plain product
+	static std::string gemm_epilogue_options(const DeviceGemmEpilogue &epilogue, float alpha, float beta);
+
+	// Two-pass multi-work-group sum (FROBENIUS_NORM/TRACE) over length elements
+	DeviceMatrix parallel_reduction(cl_kernel partial_kernel, cl_kernel finalize_kernel, const DeviceMatrix &data,
+									size_t length, const std::vector<cl_event> &wait_list);
+
+	// One work-group per matrix, sized to cover elements per matrix without idling most of the group
+	void enqueue_batched(cl_kernel kernel, int batch, int elements, const std::vector<cl_event> &wait_list,
+						 const std::vector<const DeviceMatrix *> &inputs, DeviceMatrix &result);
+
+	// Enqueues blitz_lu_logdet, det_only selects a 1 x 1 determinant over 1 x 2 [sign, log|det|]
+	DeviceMatrix lu_determinant(const LUFactors &factors, int det_only, const std::vector<cl_event> &wait_list);
+
+	// Returns a cached kernel, building its program on first use
+	cl_kernel get_kernel(operation_types op_type, const std::string &build_options = "", const std::string &kernel_name = "blitz_kernel");
+	cl_program get_program(operation_types op_type, const std::string &build_options);
+	cl_kernel get_fused_kernel(const std::string &source);
+	// Builds source through the binary cache, recording the build in cache_stats. Callers hold program_mutex.
+	cl_program build_program(const std::string &source, const std::string &build_options);
+	void count_kernel_lookup(bool hit);
+
 	KernelManager kernel_manager;
 
+	// Programs belong to this manager's context/device pair and are shared by
+	// every lane, kernels are created per lane from them
+	std::mutex program_mutex; // Held while a program builds, so each is compiled once
+	std::map<std::pair<operation_types, std::string>, cl_program> program_cache;
+	std::map<std::string, cl_program> fused_programs; // Keyed by generated source
+	mutable std::mutex state_mutex; // Guards cache_stats, pending_profiles, profiles and the shape counters
+	CacheStats cache_stats;
+	std::map<std::tuple<int, int, int, int>, size_t> shape_calls; // Elementwise launches per (lheight, lwidth, rheight, rwidth)
+	std::set<std::tuple<int, int, int, int>> fixed_shapes;		  // Shapes that reached fixed_shape_calls
+	size_t fixed_shape_calls = 16;
+
+	std::map<operation_types, kernel_variants> selected_variants;
+	GemmTiling gemm_tiling;
+	TransposeTiling transpose_tiling;
+	ElementwiseLaunch elementwise_launch;
+	LUBlocking lu_blocking;
+	size_t reduce_work_group = 256; // Work-group size of the reduction kernels, a power of two
+	cl_uint compute_units = 1;
+	size_t max_work_group_size = 1;
+	size_t max_work_item_sizes[3] = {1, 1, 1};
+	cl_ulong local_memory_size = 0;
+	cl_ulong global_memory_size = 0;
+	cl_ulong max_alloc_size = 0; // Largest single buffer the device allows
+	size_t base_alignment = 64;
+	bool zero_copy = false;
+	std::string tuning_dir = default_tuning_dir();
+
 	cl_platform_id platform;
 	cl_device_id device;
-	cl_uint num_platforms, num_devices;
 	cl_context context;
-	cl_command_queue queue;
+	std::shared_ptr<BufferPool> buffer_pool;
+
+	mutable std::mutex lane_mutex; // Guards lanes, idle_lanes and max_lanes
+	std::condition_variable lane_idle;
+	cl_command_queue_properties queue_properties = 0;
+	std::vector<std::unique_ptr<Lane>> lanes;
+	std::vector<Lane *> idle_lanes;
+	size_t max_lanes = 8;
+
+	bool profiling = false;
+	std::vector<PendingProfile> pending_profiles; // Finished ops whose events are not resolved yet
+	std::vector<OpProfile> profiles;
+	std::chrono::steady_clock::time_point created = std::chrono::steady_clock::now();
+	double device_clock_offset = 0.0; // Host seconds minus device seconds, measured in init()
+
+	std::unique_ptr<NativeBackend> native; // Set for NATIVE_CPU, which has no OpenCL state
+	void require_opencl() const;
 };
 
 #endif
\ No newline at end of file
@@ -1,6 +1,12 @@
 #ifndef OPERATION_TYPES_HPP
 #define OPERATION_TYPES_HPP
 
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+
+class DeviceMatrix;
+
 enum class operation_types{	
 	//Multi vector oeprations
 	ELEM_WISE_ADD,
@@ -15,7 +21,125 @@ enum class operation_types{
 	TRACE,
 
 	INVERSE,
-	TRANSPOSE
+	TRANSPOSE,
+	LU_DECOMPOSITION
+};
+
+// Elementwise steps fused into a GEMM before its result is stored, applied in
+// the order below after alpha * (lhs * rhs) + beta * result. Null operands and
+// clamp = false skip their step.
+template <typename Operand>
+struct GemmEpilogue
+{
+	Operand row_bias = nullptr;	   // 1 x width, added to every row
+	Operand column_bias = nullptr; // height x 1, added to every column
+	Operand scale = nullptr;	   // height x width, multiplies elementwise
+	bool clamp = false;			   // Clamps to [clamp_min, clamp_max] last
+	float clamp_min = 0.0f;
+	float clamp_max = 0.0f;
 };
+using HostGemmEpilogue = GemmEpilogue<const float *>;
+using DeviceGemmEpilogue = GemmEpilogue<const DeviceMatrix *>;
+
+// Enumerator name, e.g. "MATRIX_MULTIPLICATION"
+inline const char *operation_name(operation_types op_type)
+{
+	switch (op_type)
+	{
+	case operation_types::ELEM_WISE_ADD:
+		return "ELEM_WISE_ADD";
+	case operation_types::ELEM_WISE_SUB:
+		return "ELEM_WISE_SUB";
+	case operation_types::ELEM_WISE_DIV:
+		return "ELEM_WISE_DIV";
+	case operation_types::ELEM_WISE_MUL:
+		return "ELEM_WISE_MUL";
+	case operation_types::MATRIX_MULTIPLICATION:
+		return "MATRIX_MULTIPLICATION";
+	case operation_types::DETERMINANT:
+		return "DETERMINANT";
+	case operation_types::FROBENIUS_NORM:
+		return "FROBENIUS_NORM";
+	case operation_types::TRACE:
+		return "TRACE";
+	case operation_types::INVERSE:
+		return "INVERSE";
+	case operation_types::TRANSPOSE:
+		return "TRANSPOSE";
+	case operation_types::LU_DECOMPOSITION:
+		return "LU_DECOMPOSITION";
+	}
+	return "UNKNOWN";
+}
+
+// Height and width of an op's result, rhs_width is 0 for single-matrix ops
+inline std::pair<int, int> operation_result_shape(operation_types op_type, int height, int width, int rhs_width = 0)
+{
+	switch (op_type)
+	{
+	case operation_types::MATRIX_MULTIPLICATION:
+		return {height, rhs_width};
+	case operation_types::DETERMINANT:
+	case operation_types::FROBENIUS_NORM:
+	case operation_types::TRACE:
+		return {1, 1};
+	case operation_types::TRANSPOSE:
+		return {width, height};
+	default:
+		return {height, width};
+	}
+}
+
+// Nominal floating point work and kernel memory traffic of one op, for
+// GFLOP/s and GB/s figures. rhs_* are 0 for single-matrix ops.
+inline double operation_flops(operation_types op_type, int height, int width, int rhs_width)
+{
+	double n = height;
+	switch (op_type)
+	{
+	case operation_types::ELEM_WISE_ADD:
+	case operation_types::ELEM_WISE_SUB:
+	case operation_types::ELEM_WISE_MUL:
+	case operation_types::ELEM_WISE_DIV:
+		return static_cast<double>(height) * width;
+	case operation_types::MATRIX_MULTIPLICATION:
+		return 2.0 * height * width * static_cast<double>(rhs_width);
+	case operation_types::FROBENIUS_NORM:
+		return 2.0 * height * width;
+	case operation_types::TRACE:
+		return std::min(height, width);
+	case operation_types::DETERMINANT:
+	case operation_types::LU_DECOMPOSITION:
+		return 2.0 / 3.0 * n * n * n;
+	case operation_types::INVERSE:
+		return 2.0 * n * n * n;
+	default:
+		return 0.0;
+	}
+}
+
+inline size_t operation_bytes(operation_types op_type, int height, int width, int rhs_height, int rhs_width)
+{
+	size_t input = static_cast<size_t>(height) * width;
+	size_t rhs = static_cast<size_t>(rhs_height) * rhs_width;
+	size_t output;
+	switch (op_type)
+	{
+	case operation_types::MATRIX_MULTIPLICATION:
+		output = static_cast<size_t>(height) * rhs_width;
+		break;
+	case operation_types::DETERMINANT:
+	case operation_types::FROBENIUS_NORM:
+	case operation_types::TRACE:
+		output = 1;
+		break;
+	default:
+		output = input;
+		break;
+	}
+	if (op_type == operation_types::TRACE)
+		input = static_cast<size_t>(std::min(height, width));
+	return (input + rhs + output) * sizeof(float);
+}
 
 #endif
\ No newline at end of file
@@ -4,6 +4,13 @@
 #include "kernel_manager.hpp"
 #include "operation_manager.hpp"
 #include "operation_types.hpp"
+#include "buffer_pool.hpp"
+#include "device_matrix.hpp"
+#include "op_future.hpp"
+#include "expression.hpp"
+#include "native_backend.hpp"
+#include "device_manager.hpp"
+#include "mapped_matrix.hpp"
 
 
 
@@ -0,0 +1,51 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel loops on the host.
+// The calling thread takes part in every loop, so a pool of size 1 has no
+// workers and runs everything inline.
+class ThreadPool
+{
+public:
+	explicit ThreadPool(unsigned threads = 0); // 0 uses every hardware thread
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	unsigned size() const { return static_cast<unsigned>(workers.size()) + 1; }
+
+	// Splits [0, count) into contiguous chunks of at least grain items, runs
+	// fn(begin, end) for each across the pool and returns once all are done.
+	// fn must not throw or call parallel_for itself, and only one thread may be
+	// inside parallel_for at a time (NativeBackend serializes its ops for this).
+	void parallel_for(size_t count, size_t grain, const std::function<void(size_t, size_t)> &fn);
+
+private:
+	void worker_loop();
+	void run_chunks();
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	bool stopping = false;
+	size_t generation = 0; // Bumped for every loop handed to the workers
+	unsigned busy = 0;	   // Workers still inside the current loop
+
+	// Current loop, only written while no worker is inside it
+	const std::function<void(size_t, size_t)> *job = nullptr;
+	size_t job_count = 0;
+	size_t job_chunk = 0;
+	std::atomic<size_t> next_index{0};
+};
+
+#endif
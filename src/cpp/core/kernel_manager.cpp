@@ -1,31 +1,360 @@
 #include "include/kernel_manager.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <cerrno>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <functional>
+#include <thread>
 
-const char** KernelManager::getKernelSource(operation_types binding_name) const {
+namespace {
+
+const char BINARY_CACHE_MAGIC[4] = {'B', 'L', 'Z', 'K'};
+const uint32_t BINARY_CACHE_VERSION = 1;
+
+uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 14695981039346656037ULL) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+std::string deviceString(cl_device_id device, cl_device_info param) {
+    size_t size = 0;
+    if (clGetDeviceInfo(device, param, 0, NULL, &size) != CL_SUCCESS || size == 0) {
+        return "";
+    }
+    std::vector<char> value(size);
+    clGetDeviceInfo(device, param, size, value.data(), NULL);
+    return std::string(value.data());
+}
+
+std::string platformString(cl_platform_id platform, cl_platform_info param) {
+    size_t size = 0;
+    if (clGetPlatformInfo(platform, param, 0, NULL, &size) != CL_SUCCESS || size == 0) {
+        return "";
+    }
+    std::vector<char> value(size);
+    clGetPlatformInfo(platform, param, size, value.data(), NULL);
+    return std::string(value.data());
+}
+
+std::string buildLog(cl_program program, cl_device_id device) {
+    size_t log_size = 0;
+    clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+    std::vector<char> build_log(log_size + 1, '\0');
+    clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_size, build_log.data(), NULL);
+    return std::string(build_log.data());
+}
+
+std::string readKernelFile(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open kernel file: " + path);
+    }
+
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+}
+
+} // namespace
+
+const std::string& KernelManager::getKernelSource(operation_types binding_name) const {
     auto location = lookup_table.find(binding_name);
     if (location == lookup_table.end()) {
         throw std::runtime_error("Kernel binding name not found");
     }
 
-    // Check if we already have the kernel source loaded
+    // Check if we already have the kernel source loaded. Map nodes never move,
+    // so the returned reference stays valid while other sources are added.
+    std::lock_guard<std::mutex> lock(mutex);
     auto existing_source = kernel_sources.find(binding_name);
     if (existing_source == kernel_sources.end()) {
         // Only load the file if we haven't already
-        std::ifstream file(location->second);
+        std::string source = readKernelFile(location->second);
+        // Elementwise files only define ELEM_OP, the kernels using it follow
+        if (binding_name == operation_types::ELEM_WISE_ADD || binding_name == operation_types::ELEM_WISE_SUB ||
+            binding_name == operation_types::ELEM_WISE_MUL || binding_name == operation_types::ELEM_WISE_DIV) {
+            source += "\n" + readKernelFile(elementwise_common_path);
+        }
+
+        // Store the source
+        existing_source = kernel_sources.insert({binding_name, source}).first;
+    }
+    return existing_source->second;
+}
+
+std::vector<operation_types> KernelManager::getOperationTypes() const {
+    std::vector<operation_types> op_types;
+    op_types.reserve(lookup_table.size());
+    for (const auto& entry : lookup_table) {
+        op_types.push_back(entry.first);
+    }
+    return op_types;
+}
+
+std::string KernelManager::defaultBinaryCacheDir() {
+    if (const char* configured = std::getenv("BLITZMAT_KERNEL_CACHE")) {
+        return configured;
+    }
+    if (const char* xdg_cache = std::getenv("XDG_CACHE_HOME")) {
+        return std::string(xdg_cache) + "/blitzmat/kernels";
+    }
+    if (const char* home = std::getenv("HOME")) {
+        return std::string(home) + "/.cache/blitzmat/kernels";
+    }
+    return "";
+}
+
+void KernelManager::setBinaryCacheDir(const std::string& directory) {
+    std::lock_guard<std::mutex> lock(mutex);
+    binary_cache_dir = directory;
+}
+
+std::string KernelManager::getBinaryCacheDir() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return binary_cache_dir;
+}
+
+std::string KernelManager::deviceIdentity(cl_device_id device) {
+    cl_platform_id platform = NULL;
+    clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, NULL);
+
+    std::string identity;
+    identity += platformString(platform, CL_PLATFORM_NAME) + '\n';
+    identity += platformString(platform, CL_PLATFORM_VERSION) + '\n';
+    identity += deviceString(device, CL_DEVICE_NAME) + '\n';
+    identity += deviceString(device, CL_DEVICE_VERSION) + '\n';
+    identity += deviceString(device, CL_DRIVER_VERSION) + '\n';
+    return identity;
+}
+
+std::string KernelManager::keyHash(const std::string& key) {
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(fnv1a(key.data(), key.size())));
+    return hash;
+}
+
+KernelManager::Broadcast KernelManager::broadcastKind(int lheight, int lwidth, int rheight, int rwidth) {
+    if (rheight == lheight && rwidth == lwidth) {
+        return Broadcast::NONE;
+    }
+    if (rheight == 1 && rwidth == 1) {
+        return Broadcast::SCALAR;
+    }
+    if (rheight == 1 && rwidth == lwidth) {
+        return Broadcast::ROW;
+    }
+    if (rwidth == 1 && rheight == lheight) {
+        return Broadcast::COLUMN;
+    }
+    return Broadcast::GENERIC;
+}
+
+std::string KernelManager::elementwiseOptions(Broadcast broadcast, bool fixedShape, int lheight, int lwidth,
+                                              int rheight, int rwidth) {
+    std::ostringstream options;
+    switch (broadcast) {
+    case Broadcast::NONE:
+        options << "-DBROADCAST_NONE";
+        break;
+    case Broadcast::ROW:
+        options << "-DBROADCAST_ROW";
+        break;
+    case Broadcast::COLUMN:
+        options << "-DBROADCAST_COLUMN";
+        break;
+    case Broadcast::SCALAR:
+        options << "-DBROADCAST_SCALAR";
+        break;
+    default:
+        break;
+    }
+    if (fixedShape) {
+        if (options.tellp() > 0) {
+            options << " ";
+        }
+        options << "-DFIXED_LHEIGHT=" << lheight << " -DFIXED_LWIDTH=" << lwidth
+                << " -DFIXED_RHEIGHT=" << rheight << " -DFIXED_RWIDTH=" << rwidth;
+    }
+    return options.str();
+}
+
+bool KernelManager::createDirectories(const std::string& path) {
+    for (size_t pos = 1; pos <= path.size(); pos++) {
+        if (pos == path.size() || path[pos] == '/') {
+            std::string partial = path.substr(0, pos);
+            if (mkdir(partial.c_str(), 0755) != 0 && errno != EEXIST) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+std::string KernelManager::binaryCacheKey(cl_device_id device, const std::string& source,
+                                          const std::string& build_options) const {
+    // Everything that can change the compiled binary goes into the key
+    std::string key = deviceIdentity(device);
+    key += build_options + '\n';
+    key += source;
+    return key;
+}
+
+cl_program KernelManager::loadCachedBinary(cl_context context, cl_device_id device, const std::string& path,
+                                           const std::string& key, const std::string& build_options) const {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return NULL;
+    }
+
+    // Layout: magic, version, key size, key, binary size, binary, binary checksum
+    char magic[4];
+    uint32_t version = 0;
+    uint64_t key_size = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    file.read(reinterpret_cast<char*>(&key_size), sizeof(key_size));
+    if (!file || std::string(magic, 4) != std::string(BINARY_CACHE_MAGIC, 4) ||
+        version != BINARY_CACHE_VERSION || key_size != key.size()) {
+        return NULL;
+    }
+
+    // The full key is stored so hash collisions and stale entries are rejected
+    std::string stored_key(key_size, '\0');
+    file.read(&stored_key[0], key_size);
+    if (!file || stored_key != key) {
+        return NULL;
+    }
+
+    uint64_t binary_size = 0;
+    file.read(reinterpret_cast<char*>(&binary_size), sizeof(binary_size));
+    if (!file || binary_size == 0) {
+        return NULL;
+    }
+    std::vector<unsigned char> binary(binary_size);
+    uint64_t checksum = 0;
+    file.read(reinterpret_cast<char*>(binary.data()), binary_size);
+    file.read(reinterpret_cast<char*>(&checksum), sizeof(checksum));
+    if (!file || checksum != fnv1a(binary.data(), binary.size())) {
+        return NULL;
+    }
+
+    cl_int err;
+    cl_int binary_status;
+    size_t size = binary.size();
+    const unsigned char* binary_ptr = binary.data();
+    cl_program program = clCreateProgramWithBinary(context, 1, &device, &size, &binary_ptr, &binary_status, &err);
+    if (err != CL_SUCCESS || binary_status != CL_SUCCESS) {
+        if (program) {
+            clReleaseProgram(program);
+        }
+        return NULL;
+    }
+
+    if (clBuildProgram(program, 1, &device, build_options.c_str(), NULL, NULL) != CL_SUCCESS) {
+        clReleaseProgram(program);
+        return NULL;
+    }
+    return program;
+}
+
+void KernelManager::storeCachedBinary(cl_program program, const std::string& directory, const std::string& path,
+                                      const std::string& key) const {
+    // Programs are built for a single device, so there is exactly one binary
+    size_t binary_size = 0;
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(binary_size), &binary_size, NULL) != CL_SUCCESS ||
+        binary_size == 0) {
+        return;
+    }
+    std::vector<unsigned char> binary(binary_size);
+    unsigned char* binary_ptr = binary.data();
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binary_ptr), &binary_ptr, NULL) != CL_SUCCESS) {
+        return;
+    }
+
+    if (!createDirectories(directory)) {
+        return;
+    }
+
+    // Write to a private file and rename so concurrent processes (or managers on
+    // other threads of this one) never see a partial entry
+    std::string temp_path = path + ".tmp." + std::to_string(getpid()) + "." +
+                            std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
         if (!file.is_open()) {
-            throw std::runtime_error("Failed to open kernel file: " + location->second);
+            return;
+        }
+        uint64_t key_size = key.size();
+        uint64_t stored_size = binary_size;
+        uint64_t checksum = fnv1a(binary.data(), binary.size());
+        file.write(BINARY_CACHE_MAGIC, sizeof(BINARY_CACHE_MAGIC));
+        file.write(reinterpret_cast<const char*>(&BINARY_CACHE_VERSION), sizeof(BINARY_CACHE_VERSION));
+        file.write(reinterpret_cast<const char*>(&key_size), sizeof(key_size));
+        file.write(key.data(), key.size());
+        file.write(reinterpret_cast<const char*>(&stored_size), sizeof(stored_size));
+        file.write(reinterpret_cast<const char*>(binary.data()), binary.size());
+        file.write(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+        if (!file) {
+            file.close();
+            std::remove(temp_path.c_str());
+            return;
         }
+    }
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::remove(temp_path.c_str());
+    }
+}
 
-        std::stringstream buffer;
-        buffer << file.rdbuf();
-        file.close();
+cl_program KernelManager::buildProgram(cl_context context, cl_device_id device, operation_types binding_name,
+                                       const std::string& build_options, bool* from_binary) const {
+    return buildProgram(context, device, getKernelSource(binding_name), build_options, from_binary);
+}
 
-        // Store the source
-        kernel_sources.insert({binding_name, buffer.str()});
+cl_program KernelManager::buildProgram(cl_context context, cl_device_id device, const std::string& source,
+                                       const std::string& build_options, bool* from_binary) const {
+    if (from_binary) {
+        *from_binary = false;
     }
 
-    // Update the pointer to the persistent string data
-    current_source = kernel_sources.at(binding_name).c_str();
-    source_array[0] = current_source;
+    std::string cache_dir = getBinaryCacheDir();
+    std::string key;
+    std::string cache_path;
+    if (!cache_dir.empty()) {
+        key = binaryCacheKey(device, source, build_options);
+        cache_path = cache_dir + "/" + keyHash(key) + ".bin";
 
-    return source_array;
+        // A missing, stale or corrupt entry falls through to a source build
+        cl_program cached = loadCachedBinary(context, device, cache_path, key, build_options);
+        if (cached) {
+            if (from_binary) {
+                *from_binary = true;
+            }
+            return cached;
+        }
+    }
+
+    cl_int err;
+    const char* source_text = source.c_str();
+    cl_program program = clCreateProgramWithSource(context, 1, &source_text, NULL, &err);
+    if (err != CL_SUCCESS) {
+        throw KernelError("Failed to create program");
+    }
+
+    err = clBuildProgram(program, 1, &device, build_options.c_str(), NULL, NULL);
+    if (err != CL_SUCCESS) {
+        std::string log = buildLog(program, device);
+        clReleaseProgram(program);
+        throw KernelError("Failed to build program: " + log);
+    }
+
+    if (!cache_path.empty()) {
+        storeCachedBinary(program, cache_dir, cache_path, key);
+    }
+    return program;
 }
\ No newline at end of file
@@ -72,4 +72,71 @@ __kernel void blitz_kernel(__global const float* input, __global float* result,
         }
         *result *= sign;
     }
-}
\ No newline at end of file
+}
+#ifndef BATCH_MAX
+#define BATCH_MAX 32
+#endif
+
+// Batched determinant of small square matrices stored back to back
+// ([batch, n, n], n at most BATCH_MAX). One work-group per matrix runs a
+// partially pivoted LU in local memory and writes one value to result.
+__kernel void blitz_batched_kernel(__global const float* input, __global float* result,
+                                   const int height, const int width) {
+    __local float a[BATCH_MAX][BATCH_MAX + 1];
+    __local int pivot_row;
+    __local float det;
+    const size_t matrix = get_group_id(0);
+    const int lid = get_local_id(0);
+    const int threads = get_local_size(0);
+    const int n = height;
+
+    input += matrix * n * n;
+    for (int i = lid; i < n * n; i += threads) {
+        a[i / n][i % n] = input[i];
+    }
+    if (lid == 0) {
+        det = 1.0f;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int k = 0; k < n; k++) {
+        if (lid == 0) {
+            int best = k;
+            for (int i = k + 1; i < n; i++) {
+                if (fabs(a[i][k]) > fabs(a[best][k])) {
+                    best = i;
+                }
+            }
+            pivot_row = best;
+            // A row swap flips the sign
+            det *= (best != k) ? -a[best][k] : a[k][k];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        const int p = pivot_row;
+        if (p != k) {
+            for (int c = lid; c < n; c += threads) {
+                float swapped = a[k][c];
+                a[k][c] = a[p][c];
+                a[p][c] = swapped;
+            }
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        // Zero pivot: det is already 0, the whole group stops together
+        const float pivot = a[k][k];
+        if (pivot == 0.0f) break;
+
+        const int trailing = n - k - 1;
+        for (int i = lid; i < trailing * trailing; i += threads) {
+            const int r = k + 1 + i / trailing;
+            const int c = k + 1 + i % trailing;
+            a[r][c] -= a[r][k] / pivot * a[k][c];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (lid == 0) {
+        result[matrix] = det;
+    }
+}
@@ -0,0 +1,88 @@
+// Kernels shared by the elementwise ops. Each op's file defines ELEM_OP(a, b)
+// and KernelManager appends this file to it, so the kernels compute
+// ELEM_OP(lhs, rhs) on floats and on float vectors alike.
+//
+// rhs is broadcast across lhs by repeating its rows and columns. The host
+// specializes each program through -D options:
+//   BROADCAST_NONE    rhs has lhs's shape
+//   BROADCAST_ROW     rhs is one row, repeated down every row
+//   BROADCAST_COLUMN  rhs is one column, repeated across every column
+//   BROADCAST_SCALAR  rhs is 1 x 1
+// and otherwise falls back to modulo indexing. FIXED_LHEIGHT, FIXED_LWIDTH,
+// FIXED_RHEIGHT and FIXED_RWIDTH turn the size arguments into constants for
+// shapes the host launches often; the arguments are then ignored.
+#ifdef FIXED_LHEIGHT
+#define LHEIGHT FIXED_LHEIGHT
+#define LWIDTH FIXED_LWIDTH
+#define RHEIGHT FIXED_RHEIGHT
+#define RWIDTH FIXED_RWIDTH
+#else
+#define LHEIGHT lheight
+#define LWIDTH lwidth
+#define RHEIGHT rheight
+#define RWIDTH rwidth
+#endif
+
+#if defined(BROADCAST_NONE)
+#define RHS_INDEX(row, col, idx) (idx)
+#elif defined(BROADCAST_ROW)
+#define RHS_INDEX(row, col, idx) (col)
+#elif defined(BROADCAST_COLUMN)
+#define RHS_INDEX(row, col, idx) (row)
+#elif defined(BROADCAST_SCALAR)
+#define RHS_INDEX(row, col, idx) 0
+#else
+#define RHS_INDEX(row, col, idx) (((row) % RHEIGHT) * RWIDTH + (col) % RWIDTH)
+#endif
+
+__kernel void blitz_kernel(
+    __global const float* lhs,
+    __global const float* rhs,
+    __global float* result,
+    const int lheight,
+    const int lwidth,
+    const int rheight,
+    const int rwidth
+) {
+    const int row = get_global_id(0);
+    const int col = get_global_id(1);
+    
+    if (row >= LHEIGHT || col >= LWIDTH) return;
+    
+    const int idx = row * LWIDTH + col;
+    result[idx] = ELEM_OP(lhs[idx], rhs[RHS_INDEX(row, col, idx)]);
+}
+
+// Same-shape operands read as one flat array: each work-item handles
+// VECTOR_WIDTH (4, 8 or 16) consecutive floats, and the work-item after the
+// last full vector handles the count % VECTOR_WIDTH floats left over.
+#ifndef VECTOR_WIDTH
+#define VECTOR_WIDTH 4
+#endif
+#define CONCAT_(a, b) a##b
+#define CONCAT(a, b) CONCAT_(a, b)
+#define VLOAD CONCAT(vload, VECTOR_WIDTH)
+#define VSTORE CONCAT(vstore, VECTOR_WIDTH)
+#ifdef FIXED_LHEIGHT
+#define COUNT (FIXED_LHEIGHT * FIXED_LWIDTH)
+#else
+#define COUNT count
+#endif
+
+__kernel void blitz_kernel_flat(
+    __global const float* lhs,
+    __global const float* rhs,
+    __global float* result,
+    const int count
+) {
+    const int i = get_global_id(0);
+    const int vectors = COUNT / VECTOR_WIDTH;
+
+    if (i < vectors) {
+        VSTORE(ELEM_OP(VLOAD(i, lhs), VLOAD(i, rhs)), i, result);
+    } else if (i == vectors) {
+        for (int idx = vectors * VECTOR_WIDTH; idx < COUNT; idx++) {
+            result[idx] = ELEM_OP(lhs[idx], rhs[idx]);
+        }
+    }
+}
@@ -1,47 +1,164 @@
-__kernel void blitz_kernel(
-    __global const float* input,   // Input matrix
-    __global float* result,        // Output matrix
-    const int height,              // Height of input matrix
-    const int width               // Width of input matrix
-) {
-    int row = get_global_id(0);
-    
-    // Each work item processes one row
-    if (row < height) {
-        // First, copy input to result and create augmented matrix
-        for (int col = 0; col < width; col++) {
-            // Copy original matrix
-            result[row * 2*width + col] = input[row * width + col];
-            // Create identity matrix in augmented portion
-            result[row * 2*width + width + col] = (row == col) ? 1.0f : 0.0f;
-        }
-        
-        barrier(CLK_GLOBAL_MEM_FENCE);
-        
-        // For each pivot element (diagonal)
-        for (int pivot = 0; pivot < height; pivot++) {
-            barrier(CLK_GLOBAL_MEM_FENCE);
-            
-            // If this is the pivot row
-            if (row == pivot) {
-                // Normalize the pivot row
-                float pivot_val = result[row * 2*width + pivot];
-                if (fabs(pivot_val) > 1e-10) {  // Check if not too close to zero
-                    for (int col = 0; col < 2*width; col++) {
-                        result[row * 2*width + col] /= pivot_val;
-                    }
-                }
+// Inverse from the LU factors of lu.cl: solves A X = I as L Y = P I followed
+// by U X = Y. The host walks blocks of rows, forwards for L and backwards for
+// U. blitz_inverse_block solves a block's diagonal triangle one column per
+// work-item, then blitz_inverse_update removes the block from the rows still
+// to be solved.
+#ifndef LU_TILE
+#define LU_TILE 16
+#endif
+
+// x = P * I: one work-item per column follows its unit entry through the pivot swaps
+__kernel void blitz_inverse_permute(__global const int* pivots, __global float* x, const int n) {
+    const int col = get_global_id(0);
+    if (col >= n) return;
+
+    int one_row = col;
+    for (int i = 0; i < n; i++) {
+        const int swapped = pivots[i];
+        if (one_row == i) {
+            one_row = swapped;
+        } else if (one_row == swapped) {
+            one_row = i;
+        }
+    }
+    for (int r = 0; r < n; r++) {
+        x[r * n + col] = (r == one_row) ? 1.0f : 0.0f;
+    }
+}
+
+// One work-item per column: substitution over rows [block_start, block_end)
+// with the unit lower triangle of lu (upper == 0) or its upper triangle
+__kernel void blitz_inverse_block(__global const float* lu, __global float* x, const int n,
+                                  const int block_start, const int block_end, const int upper) {
+    const int col = get_global_id(0);
+    if (col >= n) return;
+
+    if (upper) {
+        for (int r = block_end - 1; r >= block_start; r--) {
+            float sum = x[r * n + col];
+            for (int t = r + 1; t < block_end; t++) {
+                sum -= lu[r * n + t] * x[t * n + col];
+            }
+            // A zero pivot (singular input) leaves non-finite values
+            x[r * n + col] = sum / lu[r * n + r];
+        }
+    } else {
+        for (int r = block_start + 1; r < block_end; r++) {
+            float sum = x[r * n + col];
+            for (int t = block_start; t < r; t++) {
+                sum -= lu[r * n + t] * x[t * n + col];
             }
-            
-            barrier(CLK_GLOBAL_MEM_FENCE);
-            
-            // Eliminate pivot element from other rows
-            if (row != pivot) {
-                float factor = result[row * 2*width + pivot];
-                for (int col = 0; col < 2*width; col++) {
-                    result[row * 2*width + col] -= factor * result[pivot * 2*width + col];
+            x[r * n + col] = sum;
+        }
+    }
+}
+
+// x[row_start, row_end) -= lu[row_start, row_end)[block] * x[block], staging
+// LU_TILE x LU_TILE tiles in local memory. Launch with local size
+// {LU_TILE, LU_TILE} over n columns by the row range, both rounded up.
+__kernel void blitz_inverse_update(__global const float* lu, __global float* x, const int n,
+                                   const int block_start, const int block_end,
+                                   const int row_start, const int row_end) {
+    __local float lu_tile[LU_TILE][LU_TILE];
+    __local float x_tile[LU_TILE][LU_TILE + 1];
+    const int tx = get_local_id(0);
+    const int ty = get_local_id(1);
+    const int col = get_global_id(0);
+    const int row = row_start + get_global_id(1);
+
+    float acc = 0.0f;
+    for (int t = block_start; t < block_end; t += LU_TILE) {
+        const int lu_col = t + tx;
+        const int x_row = t + ty;
+        lu_tile[ty][tx] = (row < row_end && lu_col < block_end) ? lu[row * n + lu_col] : 0.0f;
+        x_tile[ty][tx] = (x_row < block_end && col < n) ? x[x_row * n + col] : 0.0f;
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int k = 0; k < LU_TILE; k++) {
+            acc = mad(lu_tile[ty][k], x_tile[k][tx], acc);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (row < row_end && col < n) {
+        x[row * n + col] -= acc;
+    }
+}
+
+#ifndef BATCH_MAX
+#define BATCH_MAX 32
+#endif
+
+// Batched inverse of small square matrices stored back to back ([batch, n, n],
+// n at most BATCH_MAX). One work-group per matrix runs Gauss-Jordan with
+// partial pivoting on the [A | I] augmented matrix in local memory.
+__kernel void blitz_batched_kernel(__global const float* input, __global float* result,
+                                   const int height, const int width) {
+    __local float a[BATCH_MAX][2 * BATCH_MAX + 1];
+    __local float factors[BATCH_MAX];
+    __local int pivot_row;
+    const size_t matrix = get_group_id(0);
+    const int lid = get_local_id(0);
+    const int threads = get_local_size(0);
+    const int n = height;
+    const int augmented = 2 * n;
+
+    input += matrix * n * n;
+    result += matrix * n * n;
+    for (int i = lid; i < n * n; i += threads) {
+        const int r = i / n;
+        const int c = i % n;
+        a[r][c] = input[i];
+        a[r][n + c] = (r == c) ? 1.0f : 0.0f;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int k = 0; k < n; k++) {
+        if (lid == 0) {
+            int best = k;
+            for (int i = k + 1; i < n; i++) {
+                if (fabs(a[i][k]) > fabs(a[best][k])) {
+                    best = i;
                 }
             }
+            pivot_row = best;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        const int p = pivot_row;
+        if (p != k) {
+            for (int c = lid; c < augmented; c += threads) {
+                float swapped = a[k][c];
+                a[k][c] = a[p][c];
+                a[p][c] = swapped;
+            }
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        // A zero pivot (singular input) leaves non-finite values
+        const float inverse_pivot = 1.0f / a[k][k];
+        for (int r = lid; r < n; r += threads) {
+            factors[r] = a[r][k];
         }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        // Eliminate column k from the other rows while the pivot row is still unscaled
+        for (int i = lid; i < n * augmented; i += threads) {
+            const int r = i / augmented;
+            const int c = i % augmented;
+            if (r != k) {
+                a[r][c] -= factors[r] * inverse_pivot * a[k][c];
+            }
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int c = lid; c < augmented; c += threads) {
+            a[k][c] *= inverse_pivot;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    for (int i = lid; i < n * n; i += threads) {
+        result[i] = a[i / n][n + i % n];
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,175 @@
+// Blocked right-looking LU factorization with partial pivoting, in place on a
+// row-major n x n matrix. The host walks panels of columns: for each column of
+// a panel blitz_lu_pivot picks and swaps the pivot row and blitz_lu_panel
+// eliminates below it inside the panel, then blitz_lu_trsm forms the block of
+// U right of the panel and blitz_lu_update applies the panel to the trailing
+// submatrix. On completion L (unit diagonal, not stored) sits below the
+// diagonal and U on and above it, with pivots[i] the row swapped into row i.
+#ifndef LU_WG
+#define LU_WG 256
+#endif
+#ifndef LU_TILE
+#define LU_TILE 16
+#endif
+
+// Single work-group: finds the largest |lu[i][col]| for i >= col, records its
+// row in pivots[col] and swaps that row with row col across all columns
+__kernel void blitz_lu_pivot(__global float* lu, __global int* pivots, const int n, const int col) {
+    __local float best_value[LU_WG];
+    __local int best_row[LU_WG];
+    const int lid = get_local_id(0);
+
+    float value = -1.0f;
+    int row = col;
+    for (int i = col + lid; i < n; i += LU_WG) {
+        float candidate = fabs(lu[i * n + col]);
+        if (candidate > value) {
+            value = candidate;
+            row = i;
+        }
+    }
+    best_value[lid] = value;
+    best_row[lid] = row;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int stride = LU_WG / 2; stride > 0; stride >>= 1) {
+        if (lid < stride) {
+            float other_value = best_value[lid + stride];
+            int other_row = best_row[lid + stride];
+            // Ties go to the lower row so the choice does not depend on scheduling
+            if (other_value > best_value[lid] ||
+                (other_value == best_value[lid] && other_row < best_row[lid])) {
+                best_value[lid] = other_value;
+                best_row[lid] = other_row;
+            }
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    const int pivot = best_row[0];
+    if (lid == 0) {
+        pivots[col] = pivot;
+    }
+    if (pivot != col) {
+        for (int c = lid; c < n; c += LU_WG) {
+            float swapped = lu[col * n + c];
+            lu[col * n + c] = lu[pivot * n + c];
+            lu[pivot * n + c] = swapped;
+        }
+    }
+}
+
+// One work-item per row below col: stores the multiplier for that row and
+// eliminates it from the remaining panel columns (col, panel_end)
+__kernel void blitz_lu_panel(__global float* lu, const int n, const int col, const int panel_end) {
+    const int row = col + 1 + get_global_id(0);
+    if (row >= n) return;
+
+    // A zero pivot means the whole column below is zero already
+    const float pivot = lu[col * n + col];
+    if (pivot == 0.0f) return;
+
+    const float multiplier = lu[row * n + col] / pivot;
+    lu[row * n + col] = multiplier;
+    for (int c = col + 1; c < panel_end; c++) {
+        lu[row * n + c] -= multiplier * lu[col * n + c];
+    }
+}
+
+// One work-item per column right of the panel: forward substitution with the
+// unit lower triangle of the panel's diagonal block turns those rows into U
+__kernel void blitz_lu_trsm(__global float* lu, const int n, const int panel_start, const int panel_end) {
+    const int c = panel_end + get_global_id(0);
+    if (c >= n) return;
+
+    for (int r = panel_start + 1; r < panel_end; r++) {
+        float sum = lu[r * n + c];
+        for (int t = panel_start; t < r; t++) {
+            sum -= lu[r * n + t] * lu[t * n + c];
+        }
+        lu[r * n + c] = sum;
+    }
+}
+
+// Trailing update A22 -= L21 * U12, staging LU_TILE x LU_TILE blocks of both
+// factors in local memory. Launch with local size {LU_TILE, LU_TILE} over the
+// trailing submatrix rounded up to whole tiles; dimension 0 walks columns.
+__kernel void blitz_lu_update(__global float* lu, const int n, const int panel_start, const int panel_end) {
+    __local float l_tile[LU_TILE][LU_TILE];
+    __local float u_tile[LU_TILE][LU_TILE + 1];
+    const int tx = get_local_id(0);
+    const int ty = get_local_id(1);
+    const int col = panel_end + get_global_id(0);
+    const int row = panel_end + get_global_id(1);
+
+    float acc = 0.0f;
+    for (int t = panel_start; t < panel_end; t += LU_TILE) {
+        const int l_col = t + tx;
+        const int u_row = t + ty;
+        l_tile[ty][tx] = (row < n && l_col < panel_end) ? lu[row * n + l_col] : 0.0f;
+        u_tile[ty][tx] = (u_row < panel_end && col < n) ? lu[u_row * n + col] : 0.0f;
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int k = 0; k < LU_TILE; k++) {
+            acc = mad(l_tile[ty][k], u_tile[k][tx], acc);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (row < n && col < n) {
+        lu[row * n + col] -= acc;
+    }
+}
+
+// Single work-group: sign and log|det| from the factors. The diagonal product
+// is carried as mantissa * 2^exponent so it cannot overflow for large n.
+// With det_only set result[0] = det, otherwise result[0] = sign and
+// result[1] = log|det| (-INFINITY for a singular matrix).
+__kernel void blitz_lu_logdet(__global const float* lu, __global const int* pivots, __global float* result,
+                              const int n, const int det_only) {
+    __local float mantissas[LU_WG];
+    __local int exponents[LU_WG];
+    __local int swaps[LU_WG];
+    const int lid = get_local_id(0);
+
+    float mantissa = 1.0f;
+    int exponent = 0;
+    int swap_count = 0;
+    for (int i = lid; i < n; i += LU_WG) {
+        int e;
+        mantissa = frexp(mantissa * lu[i * n + i], &e);
+        exponent += e;
+        if (pivots[i] != i) {
+            swap_count++;
+        }
+    }
+    mantissas[lid] = mantissa;
+    exponents[lid] = exponent;
+    swaps[lid] = swap_count;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int stride = LU_WG / 2; stride > 0; stride >>= 1) {
+        if (lid < stride) {
+            int e;
+            mantissas[lid] = frexp(mantissas[lid] * mantissas[lid + stride], &e);
+            exponents[lid] += exponents[lid + stride] + e;
+            swaps[lid] += swaps[lid + stride];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (lid == 0) {
+        const float m = mantissas[0];
+        const int e = exponents[0];
+        float sign = (m > 0.0f) ? 1.0f : ((m < 0.0f) ? -1.0f : 0.0f);
+        if (swaps[0] & 1) {
+            sign = -sign;
+        }
+        if (det_only) {
+            result[0] = (m == 0.0f) ? 0.0f : sign * ldexp(fabs(m), e);
+        } else {
+            result[0] = sign;
+            result[1] = (m == 0.0f) ? -INFINITY : log(fabs(m)) + e * M_LN2_F;
+        }
+    }
+}
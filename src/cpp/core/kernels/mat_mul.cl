@@ -1,3 +1,49 @@
+// Fused GEMM epilogue, compiled in with -DGEMM_EPILOGUE. The kernels then take
+// seven more arguments and store alpha * (lhs * rhs) + beta * result instead of
+// the plain product. Each step below is only compiled in when its option is
+// set; operands of steps left out may be passed as NULL:
+//   GEMM_BETA         reads the previous result (C) before it is overwritten
+//   GEMM_ROW_BIAS     adds row_bias[col], a 1 x rwidth vector, to every row
+//   GEMM_COLUMN_BIAS  adds column_bias[row], an lheight x 1 vector, to every column
+//   GEMM_SCALE        multiplies by scale, lheight x rwidth, elementwise
+//   GEMM_CLAMP        clamps to [clamp_min, clamp_max]
+#ifdef GEMM_EPILOGUE
+#define GEMM_EPILOGUE_ARGS ,                                                                     \
+    const float alpha, const float beta, __global const float* row_bias,                        \
+    __global const float* column_bias, __global const float* scale, const float clamp_min,      \
+    const float clamp_max
+
+inline float gemm_epilogue(float value, __global const float* result, const int row, const int col, const int rwidth,
+                           const float alpha, const float beta, __global const float* row_bias,
+                           __global const float* column_bias, __global const float* scale, const float clamp_min,
+                           const float clamp_max) {
+    value *= alpha;
+#ifdef GEMM_BETA
+    value = mad(beta, result[row * rwidth + col], value);
+#endif
+#ifdef GEMM_ROW_BIAS
+    value += row_bias[col];
+#endif
+#ifdef GEMM_COLUMN_BIAS
+    value += column_bias[row];
+#endif
+#ifdef GEMM_SCALE
+    value *= scale[row * rwidth + col];
+#endif
+#ifdef GEMM_CLAMP
+    value = clamp(value, clamp_min, clamp_max);
+#endif
+    return value;
+}
+
+#define GEMM_STORE(row, col, value)                                                              \
+    result[(row) * rwidth + (col)] = gemm_epilogue((value), result, (row), (col), rwidth, alpha, beta, \
+                                                   row_bias, column_bias, scale, clamp_min, clamp_max)
+#else
+#define GEMM_EPILOGUE_ARGS
+#define GEMM_STORE(row, col, value) result[(row) * rwidth + (col)] = (value)
+#endif
+
 __kernel void blitz_kernel(
     __global const float* lhs,     // First input matrix
     __global const float* rhs,     // Second input matrix
@@ -6,6 +52,7 @@ __kernel void blitz_kernel(
     const int lwidth,              // Width of first matrix
     const int rheight,             // Height of second matrix
     const int rwidth               // Width of second matrix
+    GEMM_EPILOGUE_ARGS
 ) {
     // Get global position in the result matrix
     int row = get_global_id(0);    // Row index
@@ -23,6 +70,179 @@ __kernel void blitz_kernel(
         }
         
         // Store the result
-        result[row * rwidth + col] = sum;
+        GEMM_STORE(row, col, sum);
     }
-}
\ No newline at end of file
+}
+
+// Tiled GEMM: each work-group computes a TSM x TSN block of the result, staging
+// TSM x TSK tiles of lhs and TSK x TSN tiles of rhs in local memory. Each
+// work-item accumulates a WPTM x WPTN block in registers. Tiles are loaded with
+// float4 reads and zero-filled past the matrix edges, so any size is valid.
+// Launch with local size {TSN / WPTN, TSM / WPTM}; dimension 0 walks columns so
+// neighbouring work-items touch neighbouring addresses.
+#ifndef TSM
+#define TSM 64
+#endif
+#ifndef TSN
+#define TSN 64
+#endif
+#ifndef TSK
+#define TSK 16
+#endif
+#ifndef WPTM
+#define WPTM 4
+#endif
+#ifndef WPTN
+#define WPTN 4
+#endif
+
+#define RTSM (TSM / WPTM)
+#define RTSN (TSN / WPTN)
+#define LPTA ((TSK * TSM) / (RTSM * RTSN))    // lhs floats loaded per work-item
+#define LPTB ((TSK * TSN) / (RTSM * RTSN))    // rhs floats loaded per work-item
+
+__kernel void blitz_kernel_tiled(
+    __global const float* lhs,     // lheight x lwidth
+    __global const float* rhs,     // rheight x rwidth
+    __global float* result,        // lheight x rwidth
+    const int lheight,
+    const int lwidth,
+    const int rheight,
+    const int rwidth
+    GEMM_EPILOGUE_ARGS
+) {
+    const int tidn = get_local_id(0);
+    const int tidm = get_local_id(1);
+    const int tid = tidm * RTSN + tidn;
+    const int offset_m = get_group_id(1) * TSM;
+    const int offset_n = get_group_id(0) * TSN;
+
+    // lhs tile is stored k-major so the inner loop reads it contiguously
+    __local float lhs_tile[TSK][TSM + 1];
+    __local float rhs_tile[TSK][TSN];
+
+    float acc[WPTM][WPTN];
+    for (int wm = 0; wm < WPTM; wm++) {
+        for (int wn = 0; wn < WPTN; wn++) {
+            acc[wm][wn] = 0.0f;
+        }
+    }
+
+    for (int t = 0; t < lwidth; t += TSK) {
+        // Load the lhs tile, four consecutive k values per read
+        for (int l = 0; l < LPTA / 4; l++) {
+            const int v = tid + l * RTSM * RTSN;
+            const int row = v / (TSK / 4);
+            const int k = (v % (TSK / 4)) * 4;
+            const int grow = offset_m + row;
+            const int gk = t + k;
+            float4 values;
+            if (grow < lheight && gk + 3 < lwidth) {
+                values = vload4(0, lhs + grow * lwidth + gk);
+            } else {
+                values.x = (grow < lheight && gk < lwidth) ? lhs[grow * lwidth + gk] : 0.0f;
+                values.y = (grow < lheight && gk + 1 < lwidth) ? lhs[grow * lwidth + gk + 1] : 0.0f;
+                values.z = (grow < lheight && gk + 2 < lwidth) ? lhs[grow * lwidth + gk + 2] : 0.0f;
+                values.w = (grow < lheight && gk + 3 < lwidth) ? lhs[grow * lwidth + gk + 3] : 0.0f;
+            }
+            lhs_tile[k][row] = values.x;
+            lhs_tile[k + 1][row] = values.y;
+            lhs_tile[k + 2][row] = values.z;
+            lhs_tile[k + 3][row] = values.w;
+        }
+
+        // Load the rhs tile, four consecutive columns per read
+        for (int l = 0; l < LPTB / 4; l++) {
+            const int v = tid + l * RTSM * RTSN;
+            const int k = v / (TSN / 4);
+            const int col = (v % (TSN / 4)) * 4;
+            const int gk = t + k;
+            const int gcol = offset_n + col;
+            float4 values;
+            if (gk < lwidth && gcol + 3 < rwidth) {
+                values = vload4(0, rhs + gk * rwidth + gcol);
+            } else {
+                values.x = (gk < lwidth && gcol < rwidth) ? rhs[gk * rwidth + gcol] : 0.0f;
+                values.y = (gk < lwidth && gcol + 1 < rwidth) ? rhs[gk * rwidth + gcol + 1] : 0.0f;
+                values.z = (gk < lwidth && gcol + 2 < rwidth) ? rhs[gk * rwidth + gcol + 2] : 0.0f;
+                values.w = (gk < lwidth && gcol + 3 < rwidth) ? rhs[gk * rwidth + gcol + 3] : 0.0f;
+            }
+            rhs_tile[k][col] = values.x;
+            rhs_tile[k][col + 1] = values.y;
+            rhs_tile[k][col + 2] = values.z;
+            rhs_tile[k][col + 3] = values.w;
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int k = 0; k < TSK; k++) {
+            float rhs_reg[WPTN];
+            for (int wn = 0; wn < WPTN; wn++) {
+                rhs_reg[wn] = rhs_tile[k][tidn + wn * RTSN];
+            }
+            for (int wm = 0; wm < WPTM; wm++) {
+                const float lhs_reg = lhs_tile[k][tidm + wm * RTSM];
+                for (int wn = 0; wn < WPTN; wn++) {
+                    acc[wm][wn] = mad(lhs_reg, rhs_reg[wn], acc[wm][wn]);
+                }
+            }
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    for (int wm = 0; wm < WPTM; wm++) {
+        const int row = offset_m + tidm + wm * RTSM;
+        for (int wn = 0; wn < WPTN; wn++) {
+            const int col = offset_n + tidn + wn * RTSN;
+            if (row < lheight && col < rwidth) {
+                GEMM_STORE(row, col, acc[wm][wn]);
+            }
+        }
+    }
+}
+
+#ifndef BATCH_MAX
+#define BATCH_MAX 32
+#endif
+
+// Batched product of small matrices stored back to back ([batch, h, w]).
+// One work-group per pair stages both operands in local memory, then its
+// work-items stride over the outputs. Every dimension is at most BATCH_MAX.
+__kernel void blitz_batched_kernel(
+    __global const float* lhs,
+    __global const float* rhs,
+    __global float* result,
+    const int lheight,
+    const int lwidth,
+    const int rheight,
+    const int rwidth
+) {
+    __local float lhs_tile[BATCH_MAX][BATCH_MAX + 1];
+    __local float rhs_tile[BATCH_MAX][BATCH_MAX + 1];
+    const size_t matrix = get_group_id(0);
+    const int lid = get_local_id(0);
+    const int threads = get_local_size(0);
+
+    lhs += matrix * lheight * lwidth;
+    rhs += matrix * rheight * rwidth;
+    result += matrix * lheight * rwidth;
+
+    for (int i = lid; i < lheight * lwidth; i += threads) {
+        lhs_tile[i / lwidth][i % lwidth] = lhs[i];
+    }
+    for (int i = lid; i < rheight * rwidth; i += threads) {
+        rhs_tile[i / rwidth][i % rwidth] = rhs[i];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int i = lid; i < lheight * rwidth; i += threads) {
+        const int row = i / rwidth;
+        const int col = i % rwidth;
+        float acc = 0.0f;
+        for (int k = 0; k < lwidth; k++) {
+            acc = mad(lhs_tile[row][k], rhs_tile[k][col], acc);
+        }
+        result[i] = acc;
+    }
+}
@@ -1,4 +1,4 @@
-__kernel void blitz_kernel(__kernel const float* input, __global float* result,
+__kernel void blitz_kernel(__global const float* input, __global float* result,
                     const int height, const int width) {
     float sum = 0.0;
     
@@ -10,4 +10,70 @@ __kernel void blitz_kernel(__kernel const float* input, __global float* result,
         }
         *result = sum;
     }
-}
\ No newline at end of file
+}
+
+// Parallel version in two passes. blitz_kernel_partial has every work-group
+// reduce a grid-strided slice of the diagonal to one partial sum, then
+// blitz_kernel_finalize reduces the partials with a single work-group.
+// Work-items accumulate with Kahan compensation and work-groups combine with
+// a pairwise tree, so the error stays small at large sizes.
+#ifndef REDUCE_WG
+#define REDUCE_WG 256
+#endif
+
+__kernel void blitz_kernel_partial(__global const float* input, __global float* partials,
+                                   const int height, const int width) {
+    __local float scratch[REDUCE_WG];
+    const int lid = get_local_id(0);
+    const int count = (height < width) ? height : width;
+
+    float sum = 0.0f;
+    float c = 0.0f;  // Kahan compensation
+    for (int i = get_global_id(0); i < count; i += get_global_size(0)) {
+        float y = input[i * width + i] - c;
+        float t = sum + y;
+        c = (t - sum) - y;
+        sum = t;
+    }
+
+    scratch[lid] = sum;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (int stride = REDUCE_WG / 2; stride > 0; stride >>= 1) {
+        if (lid < stride) {
+            scratch[lid] += scratch[lid + stride];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (lid == 0) {
+        partials[get_group_id(0)] = scratch[0];
+    }
+}
+
+__kernel void blitz_kernel_finalize(__global const float* partials, __global float* result,
+                                    const int count) {
+    __local float scratch[REDUCE_WG];
+    const int lid = get_local_id(0);
+
+    float sum = 0.0f;
+    float c = 0.0f;
+    for (int i = lid; i < count; i += REDUCE_WG) {
+        float y = partials[i] - c;
+        float t = sum + y;
+        c = (t - sum) - y;
+        sum = t;
+    }
+
+    scratch[lid] = sum;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (int stride = REDUCE_WG / 2; stride > 0; stride >>= 1) {
+        if (lid < stride) {
+            scratch[lid] += scratch[lid + stride];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (lid == 0) {
+        *result = scratch[0];
+    }
+}
@@ -13,4 +13,120 @@ __kernel void blitz_kernel(
         // and writing to result[col + row * height]
         result[col + row * height] = input[row + col * width];
     }
-}
\ No newline at end of file
+}
+
+#ifndef TRANSPOSE_TILE
+#define TRANSPOSE_TILE 32
+#endif
+#ifndef TRANSPOSE_ROWS
+#define TRANSPOSE_ROWS 8
+#endif
+
+// Tiled transpose: a TRANSPOSE_TILE x TRANSPOSE_ROWS work-group moves one
+// TRANSPOSE_TILE square tile through local memory, so both the global reads
+// and the global writes walk consecutive addresses. The padding column puts
+// the column-wise reads of the tile on distinct local memory banks.
+// Dimension 0 walks input columns.
+__kernel void blitz_kernel_tiled(
+    __global const float* input,
+    __global float* result,
+    const int height,
+    const int width
+) {
+    __local float tile[TRANSPOSE_TILE][TRANSPOSE_TILE + 1];
+    const int tx = get_local_id(0);
+    const int ty = get_local_id(1);
+    const int tile_col = get_group_id(0) * TRANSPOSE_TILE;
+    const int tile_row = get_group_id(1) * TRANSPOSE_TILE;
+
+    const int col = tile_col + tx;
+    for (int r = ty; r < TRANSPOSE_TILE; r += TRANSPOSE_ROWS) {
+        const int row = tile_row + r;
+        if (row < height && col < width) {
+            tile[r][tx] = input[row * width + col];
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Rows of the result are columns of the input
+    const int result_col = tile_row + tx;
+    for (int r = ty; r < TRANSPOSE_TILE; r += TRANSPOSE_ROWS) {
+        const int result_row = tile_col + r;
+        if (result_row < width && result_col < height) {
+            result[result_row * height + result_col] = tile[tx][r];
+        }
+    }
+}
+
+// In-place transpose of a square n x n matrix, launched like
+// blitz_kernel_tiled over the whole matrix. The work-group at tile (by, bx)
+// above the diagonal swaps it with its mirror tile (bx, by), transposing both;
+// diagonal tiles transpose themselves and groups below the diagonal exit.
+__kernel void blitz_kernel_inplace(
+    __global float* matrix,
+    const int n
+) {
+    __local float upper[TRANSPOSE_TILE][TRANSPOSE_TILE + 1];
+    __local float lower[TRANSPOSE_TILE][TRANSPOSE_TILE + 1];
+    const int tx = get_local_id(0);
+    const int ty = get_local_id(1);
+    const int bx = get_group_id(0);
+    const int by = get_group_id(1);
+    if (bx < by) return;
+
+    const int upper_col = bx * TRANSPOSE_TILE + tx;
+    const int lower_col = by * TRANSPOSE_TILE + tx;
+    for (int r = ty; r < TRANSPOSE_TILE; r += TRANSPOSE_ROWS) {
+        const int upper_row = by * TRANSPOSE_TILE + r;
+        const int lower_row = bx * TRANSPOSE_TILE + r;
+        if (upper_row < n && upper_col < n) {
+            upper[r][tx] = matrix[upper_row * n + upper_col];
+        }
+        if (bx != by && lower_row < n && lower_col < n) {
+            lower[r][tx] = matrix[lower_row * n + lower_col];
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int r = ty; r < TRANSPOSE_TILE; r += TRANSPOSE_ROWS) {
+        const int lower_row = bx * TRANSPOSE_TILE + r;
+        const int upper_row = by * TRANSPOSE_TILE + r;
+        if (lower_row < n && lower_col < n) {
+            matrix[lower_row * n + lower_col] = upper[tx][r];
+        }
+        if (bx != by && upper_row < n && upper_col < n) {
+            matrix[upper_row * n + upper_col] = lower[tx][r];
+        }
+    }
+}
+
+#ifndef BATCH_MAX
+#define BATCH_MAX 32
+#endif
+
+// Batched transpose of small matrices stored back to back ([batch, h, w],
+// both at most BATCH_MAX). One work-group per matrix stages it in padded
+// local memory so the reads and the writes of each matrix are contiguous.
+__kernel void blitz_batched_kernel(
+    __global const float* input,
+    __global float* result,
+    const int height,
+    const int width
+) {
+    __local float tile[BATCH_MAX][BATCH_MAX + 1];
+    const size_t matrix = get_group_id(0);
+    const int lid = get_local_id(0);
+    const int threads = get_local_size(0);
+
+    input += matrix * height * width;
+    result += matrix * height * width;
+    for (int i = lid; i < height * width; i += threads) {
+        tile[i / width][i % width] = input[i];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // The transposed matrix is width x height
+    for (int i = lid; i < height * width; i += threads) {
+        result[i] = tile[i % height][i / height];
+    }
+}
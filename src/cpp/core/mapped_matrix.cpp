@@ -0,0 +1,238 @@
+#include "include/mapped_matrix.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace
+{
+	std::runtime_error file_error(const std::string &what, const std::string &path)
+	{
+		return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+	}
+
+	// Maps bytes of fd starting at offset, which need not be page aligned.
+	// Returns the mapping and sets data_offset to where offset lands in it.
+	void *map_range(int fd, size_t offset, size_t bytes, bool writable, size_t *mapping_bytes, size_t *data_offset)
+	{
+		size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		size_t start = offset / page * page;
+		*data_offset = offset - start;
+		*mapping_bytes = *data_offset + bytes;
+		return mmap(nullptr, *mapping_bytes, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd,
+					static_cast<off_t>(start));
+	}
+}
+
+MappedMatrix MappedMatrix::open(const std::string &path, int height, int width, size_t offset, bool writable)
+{
+	if (height <= 0 || width <= 0)
+	{
+		throw std::invalid_argument("Matrix dimensions must be positive");
+	}
+	int fd = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+	if (fd < 0)
+	{
+		throw file_error("Cannot open", path);
+	}
+
+	// Checked without forming offset + bytes, which could wrap
+	uint64_t rows = static_cast<uint64_t>(height);
+	uint64_t row_bytes = static_cast<uint64_t>(width) * sizeof(float);
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size < 0 || offset > static_cast<uint64_t>(info.st_size) ||
+		rows > (static_cast<uint64_t>(info.st_size) - offset) / row_bytes)
+	{
+		::close(fd);
+		throw std::invalid_argument("File " + path + " is smaller than the requested matrix");
+	}
+	size_t bytes = static_cast<size_t>(rows * row_bytes);
+
+	size_t mapping_bytes, data_offset;
+	void *mapping = map_range(fd, offset, bytes, writable, &mapping_bytes, &data_offset);
+	::close(fd); // The mapping keeps its own reference to the file
+	if (mapping == MAP_FAILED)
+	{
+		throw file_error("Cannot map", path);
+	}
+	return MappedMatrix(mapping, mapping_bytes, data_offset, height, width, writable);
+}
+
+MappedMatrix MappedMatrix::create(const std::string &path, int height, int width)
+{
+	if (height <= 0 || width <= 0)
+	{
+		throw std::invalid_argument("Matrix dimensions must be positive");
+	}
+	int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		throw file_error("Cannot create", path);
+	}
+	// Sparse until written, creating a large result does not touch the disk up front
+	size_t bytes = static_cast<size_t>(height) * width * sizeof(float);
+	if (ftruncate(fd, static_cast<off_t>(bytes)) != 0)
+	{
+		::close(fd);
+		throw file_error("Cannot resize", path);
+	}
+
+	size_t mapping_bytes, data_offset;
+	void *mapping = map_range(fd, 0, bytes, true, &mapping_bytes, &data_offset);
+	::close(fd);
+	if (mapping == MAP_FAILED)
+	{
+		throw file_error("Cannot map", path);
+	}
+	return MappedMatrix(mapping, mapping_bytes, data_offset, height, width, true);
+}
+
+MappedMatrix MappedMatrix::open_bmat(const std::string &path, bool writable)
+{
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		throw file_error("Cannot open", path);
+	}
+	BmatHeader header;
+	ssize_t read_bytes = pread(fd, &header, sizeof(header), 0);
+	struct stat info;
+	bool sized = fstat(fd, &info) == 0 && info.st_size >= 0;
+	::close(fd);
+	if (!sized)
+	{
+		throw file_error("Cannot stat", path);
+	}
+	uint64_t file_bytes = static_cast<uint64_t>(info.st_size);
+	if (read_bytes != static_cast<ssize_t>(sizeof(header)) || std::memcmp(header.magic, "BMAT", 4) != 0)
+	{
+		throw std::invalid_argument(path + " is not a .bmat file");
+	}
+	if (header.version != 1 || header.dtype != static_cast<uint32_t>(bmat_dtypes::FLOAT32) || header.ndim != 2)
+	{
+		throw std::invalid_argument(path + ": only version 1 two-dimensional float32 .bmat files are supported");
+	}
+	uint64_t limit = static_cast<uint64_t>(std::numeric_limits<int>::max());
+	if (header.shape[0] == 0 || header.shape[1] == 0 || header.shape[0] > limit || header.shape[1] > limit)
+	{
+		throw std::invalid_argument(path + ": matrix dimensions must be positive and fit in an int");
+	}
+	if (header.strides[0] != header.shape[1] * sizeof(float) || header.strides[1] != sizeof(float))
+	{
+		throw std::invalid_argument(path + ": only C-contiguous .bmat data is supported");
+	}
+	if (header.alignment == 0 || (header.alignment & (header.alignment - 1)) != 0 || header.data_offset % header.alignment != 0 ||
+		header.data_offset < sizeof(header))
+	{
+		throw std::invalid_argument(path + ": invalid .bmat data alignment");
+	}
+	// shape[0] * strides[0] must fit after data_offset, compared by division so nothing wraps
+	if (header.data_offset > file_bytes || header.shape[0] > (file_bytes - header.data_offset) / header.strides[0])
+	{
+		throw std::invalid_argument(path + ": .bmat file is shorter than its header describes");
+	}
+	return open(path, static_cast<int>(header.shape[0]), static_cast<int>(header.shape[1]), static_cast<size_t>(header.data_offset),
+				writable);
+}
+
+MappedMatrix MappedMatrix::create_bmat(const std::string &path, int height, int width)
+{
+	if (height <= 0 || width <= 0)
+	{
+		throw std::invalid_argument("Matrix dimensions must be positive");
+	}
+	size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	BmatHeader header;
+	std::memcpy(header.magic, "BMAT", 4);
+	header.version = 1;
+	header.dtype = static_cast<uint32_t>(bmat_dtypes::FLOAT32);
+	header.ndim = 2;
+	header.shape[0] = static_cast<uint64_t>(height);
+	header.shape[1] = static_cast<uint64_t>(width);
+	header.strides[0] = static_cast<uint64_t>(width) * sizeof(float);
+	header.strides[1] = sizeof(float);
+	header.alignment = page;
+	header.data_offset = page; // The header fits in the first page, the data starts on the next
+
+	int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		throw file_error("Cannot create", path);
+	}
+	size_t bytes = static_cast<size_t>(height) * width * sizeof(float);
+	if (pwrite(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+		ftruncate(fd, static_cast<off_t>(page + bytes)) != 0)
+	{
+		::close(fd);
+		throw file_error("Cannot write", path);
+	}
+	::close(fd);
+	return open(path, height, width, page, true);
+}
+
+void MappedMatrix::save_bmat(const std::string &path, const float *data, int height, int width)
+{
+	MappedMatrix file = create_bmat(path, height, width);
+	std::memcpy(file.data(), data, file.bytes());
+	file.sync();
+}
+
+MappedMatrix::MappedMatrix(void *mapping, size_t mapping_bytes, size_t data_offset, int height, int width, bool writable)
+	: mapping(mapping), mapping_bytes(mapping_bytes),
+	  values(reinterpret_cast<float *>(static_cast<char *>(mapping) + data_offset)), rows(height), cols(width),
+	  read_write(writable)
+{
+}
+
+MappedMatrix::~MappedMatrix()
+{
+	unmap();
+}
+
+MappedMatrix::MappedMatrix(MappedMatrix &&other) noexcept
+	: mapping(other.mapping), mapping_bytes(other.mapping_bytes), values(other.values), rows(other.rows), cols(other.cols),
+	  read_write(other.read_write)
+{
+	other.mapping = nullptr;
+	other.mapping_bytes = 0;
+	other.values = nullptr;
+	other.rows = 0;
+	other.cols = 0;
+}
+
+MappedMatrix &MappedMatrix::operator=(MappedMatrix &&other) noexcept
+{
+	if (this != &other)
+	{
+		unmap();
+		std::swap(mapping, other.mapping);
+		std::swap(mapping_bytes, other.mapping_bytes);
+		std::swap(values, other.values);
+		std::swap(rows, other.rows);
+		std::swap(cols, other.cols);
+		std::swap(read_write, other.read_write);
+	}
+	return *this;
+}
+
+void MappedMatrix::sync()
+{
+	if (mapping && read_write && msync(mapping, mapping_bytes, MS_SYNC) != 0)
+	{
+		throw std::runtime_error(std::string("Cannot sync mapped matrix: ") + std::strerror(errno));
+	}
+}
+
+void MappedMatrix::unmap()
+{
+	if (mapping)
+	{
+		munmap(mapping, mapping_bytes);
+		mapping = nullptr;
+	}
+}
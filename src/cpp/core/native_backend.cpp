@@ -0,0 +1,537 @@
+#include "include/native_backend.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+
+// Smallest amount of work (in floats touched) worth handing to another thread
+const size_t parallel_grain = 16384;
+
+float *allocate_result(size_t count)
+{
+	float *result = static_cast<float *>(malloc(std::max<size_t>(count, 1) * sizeof(float)));
+	if (!result)
+	{
+		throw std::bad_alloc();
+	}
+	return result;
+}
+
+char elementwise_symbol(operation_types op_type)
+{
+	switch (op_type)
+	{
+	case operation_types::ELEM_WISE_ADD:
+		return '+';
+	case operation_types::ELEM_WISE_SUB:
+		return '-';
+	case operation_types::ELEM_WISE_MUL:
+		return '*';
+	default:
+		return '/';
+	}
+}
+
+} // namespace
+
+const int NativeBackend::gemm_kc;
+const int NativeBackend::gemm_mc;
+const int NativeBackend::gemm_nc;
+
+NativeBackend::NativeBackend(unsigned threads, simd_levels max_level)
+	: kernels(select_native_kernels(max_level)), pool(threads)
+{
+}
+
+float *NativeBackend::multi_vector_op(operation_types op_type, const float *lhs, int lheight, int lwidth, const float *rhs, int rheight,
+									  int rwidth)
+{
+	std::lock_guard<std::recursive_mutex> lock(op_mutex);
+	std::pair<int, int> shape = operation_result_shape(op_type, lheight, lwidth, rwidth);
+	float *result = allocate_result(static_cast<size_t>(shape.first) * shape.second);
+	try
+	{
+		multi_vector_op(op_type, lhs, lheight, lwidth, rhs, rheight, rwidth, result);
+	}
+	catch (...)
+	{
+		free(result);
+		throw;
+	}
+	return result;
+}
+
+float *NativeBackend::single_vector_op(operation_types op_type, const float *data, int height, int width)
+{
+	std::lock_guard<std::recursive_mutex> lock(op_mutex);
+	std::pair<int, int> shape = operation_result_shape(op_type, height, width);
+	float *result = allocate_result(static_cast<size_t>(shape.first) * shape.second);
+	try
+	{
+		single_vector_op(op_type, data, height, width, result);
+	}
+	catch (...)
+	{
+		free(result);
+		throw;
+	}
+	return result;
+}
+
+void NativeBackend::multi_vector_op(operation_types op_type, const float *lhs, int lheight, int lwidth, const float *rhs, int rheight,
+									int rwidth, float *result)
+{
+	std::lock_guard<std::recursive_mutex> lock(op_mutex);
+	switch (op_type)
+	{
+	case operation_types::ELEM_WISE_ADD:
+	case operation_types::ELEM_WISE_SUB:
+	case operation_types::ELEM_WISE_MUL:
+	case operation_types::ELEM_WISE_DIV:
+	{
+		// rhs is broadcast across lhs by repeating its rows/columns
+		if (lheight % rheight != 0 || lwidth % rwidth != 0)
+		{
+			throw std::invalid_argument("Operand shapes cannot be broadcast together");
+		}
+		elementwise(elementwise_symbol(op_type), lhs, lheight, lwidth, rhs, rheight, rwidth, result);
+		return;
+	}
+	case operation_types::MATRIX_MULTIPLICATION:
+	{
+		if (lwidth != rheight)
+		{
+			throw std::invalid_argument("Inner matrix dimensions must agree");
+		}
+		gemm(lhs, rhs, result, lheight, rwidth, lwidth);
+		return;
+	}
+	default:
+		throw std::runtime_error("Incorrect Operation Type");
+	}
+}
+
+void NativeBackend::gemm(float alpha, const float *lhs, int lheight, int lwidth, const float *rhs, int rheight, int rwidth, float beta,
+						 float *result, const HostGemmEpilogue &epilogue)
+{
+	std::lock_guard<std::recursive_mutex> lock(op_mutex);
+	if (lwidth != rheight)
+	{
+		throw std::invalid_argument("Inner matrix dimensions must agree");
+	}
+	if (epilogue.clamp && epilogue.clamp_min > epilogue.clamp_max)
+	{
+		throw std::invalid_argument("GEMM clamp_min must not exceed clamp_max");
+	}
+
+	// The product only needs its own buffer while result still holds C
+	std::vector<float> scratch;
+	float *product = result;
+	if (beta != 0.0f)
+	{
+		scratch.resize(static_cast<size_t>(lheight) * rwidth);
+		product = scratch.data();
+	}
+	gemm(lhs, rhs, product, lheight, rwidth, lwidth);
+
+	// Epilogue in one pass over the product while it is still in cache per row
+	size_t grain = std::max<size_t>(1, parallel_grain / std::max(rwidth, 1));
+	pool.parallel_for(lheight, grain, [&](size_t begin, size_t end) {
+		for (size_t row = begin; row < end; row++)
+		{
+			const float *product_row = product + row * rwidth;
+			float *result_row = result + row * rwidth;
+			const float *scale_row = epilogue.scale ? epilogue.scale + row * rwidth : nullptr;
+			float column_bias = epilogue.column_bias ? epilogue.column_bias[row] : 0.0f;
+			for (int col = 0; col < rwidth; col++)
+			{
+				float value = alpha * product_row[col];
+				if (beta != 0.0f)
+					value += beta * result_row[col];
+				if (epilogue.row_bias)
+					value += epilogue.row_bias[col];
+				value += column_bias;
+				if (scale_row)
+					value *= scale_row[col];
+				if (epilogue.clamp)
+					value = std::min(std::max(value, epilogue.clamp_min), epilogue.clamp_max);
+				result_row[col] = value;
+			}
+		}
+	});
+}
+
+void NativeBackend::single_vector_op(operation_types op_type, const float *data, int height, int width, float *result)
+{
+	std::lock_guard<std::recursive_mutex> lock(op_mutex);
+	if (op_type == operation_types::DETERMINANT || op_type == operation_types::INVERSE ||
+		op_type == operation_types::LU_DECOMPOSITION)
+	{
+		if (height != width)
+		{
+			throw std::invalid_argument("Operation requires square matrix");
+		}
+	}
+
+	size_t count = static_cast<size_t>(height) * width;
+	switch (op_type)
+	{
+	case operation_types::DETERMINANT:
+	{
+		std::vector<float> lu(data, data + count);
+		std::vector<int> pivots(height);
+		int swaps = lu_factor(lu.data(), pivots.data(), height);
+		double det = swaps % 2 ? -1.0 : 1.0;
+		for (int i = 0; i < height; i++)
+		{
+			det *= lu[static_cast<size_t>(i) * width + i];
+		}
+		*result = static_cast<float>(det);
+		return;
+	}
+	case operation_types::FROBENIUS_NORM:
+	{
+		*result = static_cast<float>(std::sqrt(sum_squares(data, count)));
+		return;
+	}
+	case operation_types::TRACE:
+	{
+		double sum = 0.0;
+		for (int i = 0; i < std::min(height, width); i++)
+		{
+			sum += data[static_cast<size_t>(i) * width + i];
+		}
+		*result = static_cast<float>(sum);
+		return;
+	}
+	case operation_types::INVERSE:
+	{
+		std::vector<float> lu(data, data + count);
+		std::vector<int> pivots(height);
+		lu_factor(lu.data(), pivots.data(), height);
+		lu_inverse(lu.data(), pivots.data(), height, result);
+		return;
+	}
+	case operation_types::TRANSPOSE:
+	{
+		transpose(data, height, width, result);
+		return;
+	}
+	case operation_types::LU_DECOMPOSITION:
+	{
+		std::copy(data, data + count, result);
+		std::vector<int> pivots(height);
+		lu_factor(result, pivots.data(), height);
+		return;
+	}
+	default:
+		throw std::runtime_error("Incorrect Operation Type");
+	}
+}
+
+float *NativeBackend::batched_multi_vector_op(operation_types op_type, const float *lhs, int batch, int lheight, int lwidth,
+											  const float *rhs, int rheight, int rwidth)
+{
+	std::lock_guard<std::recursive_mutex> lock(op_mutex);
+	if (op_type != operation_types::MATRIX_MULTIPLICATION)
+	{
+		throw std::runtime_error("Incorrect Operation Type");
+	}
+	if (lwidth != rheight)
+	{
+		throw std::invalid_argument("Inner matrix dimensions must agree");
+	}
+	size_t lhs_size = static_cast<size_t>(lheight) * lwidth;
+	size_t rhs_size = static_cast<size_t>(rheight) * rwidth;
+	size_t result_size = static_cast<size_t>(lheight) * rwidth;
+	float *result = allocate_result(result_size * batch);
+	for (int b = 0; b < batch; b++)
+	{
+		gemm(lhs + b * lhs_size, rhs + b * rhs_size, result + b * result_size, lheight, rwidth, lwidth);
+	}
+	return result;
+}
+
+float *NativeBackend::batched_single_vector_op(operation_types op_type, const float *data, int batch, int height, int width)
+{
+	std::lock_guard<std::recursive_mutex> lock(op_mutex);
+	if (op_type != operation_types::DETERMINANT && op_type != operation_types::INVERSE && op_type != operation_types::TRANSPOSE)
+	{
+		throw std::runtime_error("Incorrect Operation Type");
+	}
+	size_t size = static_cast<size_t>(height) * width;
+	size_t result_size = op_type == operation_types::DETERMINANT ? 1 : size;
+	float *result = allocate_result(result_size * batch);
+	for (int b = 0; b < batch; b++)
+	{
+		float *single = single_vector_op(op_type, data + b * size, height, width);
+		std::copy(single, single + result_size, result + b * result_size);
+		free(single);
+	}
+	return result;
+}
+
+float *NativeBackend::slogdet(const float *data, int height, int width)
+{
+	std::lock_guard<std::recursive_mutex> lock(op_mutex);
+	if (height != width)
+	{
+		throw std::invalid_argument("Operation requires square matrix");
+	}
+	std::vector<float> lu(data, data + static_cast<size_t>(height) * width);
+	std::vector<int> pivots(height);
+	int swaps = lu_factor(lu.data(), pivots.data(), height);
+
+	float sign = swaps % 2 ? -1.0f : 1.0f;
+	double log_abs = 0.0;
+	for (int i = 0; i < height; i++)
+	{
+		float pivot = lu[static_cast<size_t>(i) * width + i];
+		if (pivot == 0.0f)
+		{
+			sign = 0.0f;
+			log_abs = -std::numeric_limits<double>::infinity();
+			break;
+		}
+		if (pivot < 0.0f)
+			sign = -sign;
+		log_abs += std::log(std::fabs(static_cast<double>(pivot)));
+	}
+	float *result = allocate_result(2);
+	result[0] = sign;
+	result[1] = static_cast<float>(log_abs);
+	return result;
+}
+
+void NativeBackend::gemm(const float *a, const float *b, float *c, int m, int n, int k)
+{
+	if (k == 0)
+	{
+		std::fill(c, c + static_cast<size_t>(m) * n, 0.0f);
+		return;
+	}
+	const int mr = kernels.gemm_mr;
+	const int nr = kernels.gemm_nr;
+	const int row_strips = (m + mr - 1) / mr;
+	std::vector<float> packed_a(static_cast<size_t>(row_strips) * mr * gemm_kc);
+	std::vector<float> packed_b(static_cast<size_t>((std::min(n, gemm_nc) + nr - 1) / nr) * nr * gemm_kc);
+
+	for (int jc = 0; jc < n; jc += gemm_nc)
+	{
+		const int nc = std::min(gemm_nc, n - jc);
+		const int col_strips = (nc + nr - 1) / nr;
+		for (int pc = 0; pc < k; pc += gemm_kc)
+		{
+			const int kc = std::min(gemm_kc, k - pc);
+
+			// B[pc:pc+kc, jc:jc+nc] as kc x nr strips, zero padded past column n
+			pool.parallel_for(col_strips, 1, [&](size_t begin, size_t end) {
+				for (size_t strip = begin; strip < end; strip++)
+				{
+					int col = jc + static_cast<int>(strip) * nr;
+					int cols = std::min(nr, jc + nc - col);
+					float *out = packed_b.data() + strip * nr * kc;
+					for (int p = 0; p < kc; p++)
+					{
+						const float *row = b + static_cast<size_t>(pc + p) * n + col;
+						std::copy(row, row + cols, out);
+						std::fill(out + cols, out + nr, 0.0f);
+						out += nr;
+					}
+				}
+			});
+			// A[:, pc:pc+kc] as kc x mr strips, zero padded past row m
+			pool.parallel_for(row_strips, 1, [&](size_t begin, size_t end) {
+				for (size_t strip = begin; strip < end; strip++)
+				{
+					int row = static_cast<int>(strip) * mr;
+					int rows = std::min(mr, m - row);
+					float *out = packed_a.data() + strip * mr * kc;
+					for (int p = 0; p < kc; p++)
+					{
+						for (int i = 0; i < mr; i++)
+						{
+							out[i] = i < rows ? a[static_cast<size_t>(row + i) * k + pc + p] : 0.0f;
+						}
+						out += mr;
+					}
+				}
+			});
+
+			// One task per (mc row block, nr column strip): the B strip is reused across the block's row strips
+			const int row_blocks = (m + gemm_mc - 1) / gemm_mc;
+			const bool accumulate = pc > 0;
+			pool.parallel_for(static_cast<size_t>(row_blocks) * col_strips, 1, [&](size_t begin, size_t end) {
+				for (size_t task = begin; task < end; task++)
+				{
+					int block = static_cast<int>(task / col_strips);
+					int strip = static_cast<int>(task % col_strips);
+					int col = jc + strip * nr;
+					int cols = std::min(nr, jc + nc - col);
+					const float *b_strip = packed_b.data() + static_cast<size_t>(strip) * nr * kc;
+					int block_end = std::min(m, (block + 1) * gemm_mc);
+					for (int row = block * gemm_mc; row < block_end; row += mr)
+					{
+						const float *a_strip = packed_a.data() + static_cast<size_t>(row / mr) * mr * kc;
+						kernels.gemm_micro(kc, a_strip, b_strip, c + static_cast<size_t>(row) * n + col, n,
+										   std::min(mr, m - row), cols, accumulate);
+					}
+				}
+			});
+		}
+	}
+}
+
+void NativeBackend::elementwise(char op, const float *lhs, int lheight, int lwidth, const float *rhs, int rheight, int rwidth,
+								float *result)
+{
+	size_t grain = std::max<size_t>(1, parallel_grain / std::max(lwidth, 1));
+	pool.parallel_for(lheight, grain, [&](size_t begin, size_t end) {
+		for (size_t row = begin; row < end; row++)
+		{
+			const float *lhs_row = lhs + row * lwidth;
+			const float *rhs_row = rhs + (row % rheight) * rwidth;
+			float *result_row = result + row * lwidth;
+			if (rwidth == 1)
+			{
+				kernels.binary_scalar(op, lhs_row, rhs_row[0], result_row, lwidth);
+				continue;
+			}
+			for (int col = 0; col < lwidth; col += rwidth)
+			{
+				kernels.binary(op, lhs_row + col, rhs_row, result_row + col, rwidth);
+			}
+		}
+	});
+}
+
+void NativeBackend::transpose(const float *data, int height, int width, float *result)
+{
+	const int tile = 32;
+	int tile_rows = (height + tile - 1) / tile;
+	pool.parallel_for(tile_rows, 1, [&](size_t begin, size_t end) {
+		for (size_t tile_row = begin; tile_row < end; tile_row++)
+		{
+			int row_start = static_cast<int>(tile_row) * tile;
+			int row_end = std::min(height, row_start + tile);
+			for (int col_start = 0; col_start < width; col_start += tile)
+			{
+				int col_end = std::min(width, col_start + tile);
+				for (int row = row_start; row < row_end; row++)
+				{
+					for (int col = col_start; col < col_end; col++)
+					{
+						result[static_cast<size_t>(col) * height + row] = data[static_cast<size_t>(row) * width + col];
+					}
+				}
+			}
+		}
+	});
+}
+
+double NativeBackend::sum_squares(const float *data, size_t count)
+{
+	// Fixed blocks so the result does not depend on the thread count
+	size_t blocks = (count + parallel_grain - 1) / parallel_grain;
+	std::vector<double> partials(blocks);
+	pool.parallel_for(blocks, 1, [&](size_t begin, size_t end) {
+		for (size_t block = begin; block < end; block++)
+		{
+			size_t start = block * parallel_grain;
+			partials[block] = kernels.sum_squares(data + start, std::min(parallel_grain, count - start));
+		}
+	});
+	double sum = 0.0;
+	for (double partial : partials)
+		sum += partial;
+	return sum;
+}
+
+int NativeBackend::lu_factor(float *lu, int *pivots, int n)
+{
+	int swaps = 0;
+	for (int k = 0; k < n; k++)
+	{
+		int pivot = k;
+		float largest = std::fabs(lu[static_cast<size_t>(k) * n + k]);
+		for (int i = k + 1; i < n; i++)
+		{
+			float candidate = std::fabs(lu[static_cast<size_t>(i) * n + k]);
+			if (candidate > largest)
+			{
+				largest = candidate;
+				pivot = i;
+			}
+		}
+		pivots[k] = pivot;
+		if (pivot != k)
+		{
+			std::swap_ranges(lu + static_cast<size_t>(k) * n, lu + static_cast<size_t>(k + 1) * n, lu + static_cast<size_t>(pivot) * n);
+			swaps++;
+		}
+		// A zero column leaves U singular, the remaining steps still run
+		if (largest == 0.0f)
+			continue;
+
+		const float *pivot_row = lu + static_cast<size_t>(k) * n;
+		float pivot_value = pivot_row[k];
+		int trailing = n - k - 1;
+		size_t grain = std::max<size_t>(1, parallel_grain / std::max(trailing, 1));
+		pool.parallel_for(trailing, grain, [&](size_t begin, size_t end) {
+			for (size_t offset = begin; offset < end; offset++)
+			{
+				float *row = lu + (k + 1 + offset) * n;
+				row[k] /= pivot_value;
+				kernels.axpy(-row[k], pivot_row + k + 1, row + k + 1, trailing);
+			}
+		});
+	}
+	return swaps;
+}
+
+void NativeBackend::lu_inverse(const float *lu, const int *pivots, int n, float *result)
+{
+	// P * I, then L Y = P and U X = Y on independent column slices of the result
+	size_t count = static_cast<size_t>(n) * n;
+	std::fill(result, result + count, 0.0f);
+	std::vector<int> rows(n);
+	for (int i = 0; i < n; i++)
+		rows[i] = i;
+	for (int i = 0; i < n; i++)
+		std::swap(rows[i], rows[pivots[i]]);
+	for (int i = 0; i < n; i++)
+		result[static_cast<size_t>(i) * n + rows[i]] = 1.0f;
+
+	const int slice = 64;
+	int slices = (n + slice - 1) / slice;
+	pool.parallel_for(slices, 1, [&](size_t begin, size_t end) {
+		for (size_t s = begin; s < end; s++)
+		{
+			int col = static_cast<int>(s) * slice;
+			int cols = std::min(slice, n - col);
+			for (int k = 0; k < n; k++)
+			{
+				const float *x_k = result + static_cast<size_t>(k) * n + col;
+				for (int i = k + 1; i < n; i++)
+				{
+					kernels.axpy(-lu[static_cast<size_t>(i) * n + k], x_k, result + static_cast<size_t>(i) * n + col, cols);
+				}
+			}
+			for (int k = n - 1; k >= 0; k--)
+			{
+				float *x_k = result + static_cast<size_t>(k) * n + col;
+				kernels.binary_scalar('/', x_k, lu[static_cast<size_t>(k) * n + k], x_k, cols);
+				for (int i = 0; i < k; i++)
+				{
+					kernels.axpy(-lu[static_cast<size_t>(i) * n + k], x_k, result + static_cast<size_t>(i) * n + col, cols);
+				}
+			}
+		}
+	});
+}
@@ -0,0 +1,315 @@
+#include "include/native_kernels.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLITZ_X86 1
+#endif
+
+namespace
+{
+
+// Portable versions, also used for the tails of the vector loops
+
+inline float apply(char op, float lhs, float rhs)
+{
+	switch (op)
+	{
+	case '+':
+		return lhs + rhs;
+	case '-':
+		return lhs - rhs;
+	case '*':
+		return lhs * rhs;
+	default:
+		return lhs / rhs;
+	}
+}
+
+void binary_scalar_isa(char op, const float *lhs, const float *rhs, float *out, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		out[i] = apply(op, lhs[i], rhs[i]);
+}
+
+void binary_scalar_value_isa(char op, const float *lhs, float rhs, float *out, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		out[i] = apply(op, lhs[i], rhs);
+}
+
+void axpy_scalar_isa(float alpha, const float *x, float *y, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		y[i] += alpha * x[i];
+}
+
+double sum_squares_scalar_isa(const float *data, size_t count)
+{
+	double sum = 0.0;
+	for (size_t i = 0; i < count; i++)
+		sum += static_cast<double>(data[i]) * data[i];
+	return sum;
+}
+
+// Writes a finished register tile, only the rows x cols corner at the edges of C
+inline void store_tile(const float *tile, int tile_nr, float *c, int ldc, int rows, int cols, bool accumulate)
+{
+	for (int i = 0; i < rows; i++)
+	{
+		for (int j = 0; j < cols; j++)
+		{
+			c[i * ldc + j] = accumulate ? c[i * ldc + j] + tile[i * tile_nr + j] : tile[i * tile_nr + j];
+		}
+	}
+}
+
+const int scalar_mr = 6;
+const int scalar_nr = 16;
+
+void gemm_micro_scalar(int kc, const float *a, const float *b, float *c, int ldc, int rows, int cols, bool accumulate)
+{
+	float tile[scalar_mr * scalar_nr] = {};
+	for (int p = 0; p < kc; p++)
+	{
+		for (int i = 0; i < scalar_mr; i++)
+		{
+			for (int j = 0; j < scalar_nr; j++)
+				tile[i * scalar_nr + j] += a[i] * b[j];
+		}
+		a += scalar_mr;
+		b += scalar_nr;
+	}
+	store_tile(tile, scalar_nr, c, ldc, rows, cols, accumulate);
+}
+
+#ifdef BLITZ_X86
+
+// AVX2: 6 x 16 tile held in 12 ymm accumulators
+
+__attribute__((target("avx2,fma"))) void gemm_micro_avx2(int kc, const float *a, const float *b, float *c, int ldc, int rows,
+														 int cols, bool accumulate)
+{
+	__m256 acc[6][2];
+	for (int i = 0; i < 6; i++)
+	{
+		acc[i][0] = _mm256_setzero_ps();
+		acc[i][1] = _mm256_setzero_ps();
+	}
+	for (int p = 0; p < kc; p++)
+	{
+		__m256 b0 = _mm256_loadu_ps(b);
+		__m256 b1 = _mm256_loadu_ps(b + 8);
+		for (int i = 0; i < 6; i++)
+		{
+			__m256 ai = _mm256_broadcast_ss(a + i);
+			acc[i][0] = _mm256_fmadd_ps(ai, b0, acc[i][0]);
+			acc[i][1] = _mm256_fmadd_ps(ai, b1, acc[i][1]);
+		}
+		a += 6;
+		b += 16;
+	}
+
+	if (rows == 6 && cols == 16)
+	{
+		for (int i = 0; i < 6; i++)
+		{
+			float *row = c + i * ldc;
+			if (accumulate)
+			{
+				acc[i][0] = _mm256_add_ps(acc[i][0], _mm256_loadu_ps(row));
+				acc[i][1] = _mm256_add_ps(acc[i][1], _mm256_loadu_ps(row + 8));
+			}
+			_mm256_storeu_ps(row, acc[i][0]);
+			_mm256_storeu_ps(row + 8, acc[i][1]);
+		}
+		return;
+	}
+	float tile[6 * 16];
+	for (int i = 0; i < 6; i++)
+	{
+		_mm256_storeu_ps(tile + i * 16, acc[i][0]);
+		_mm256_storeu_ps(tile + i * 16 + 8, acc[i][1]);
+	}
+	store_tile(tile, 16, c, ldc, rows, cols, accumulate);
+}
+
+__attribute__((target("avx2,fma"))) void binary_avx2(char op, const float *lhs, const float *rhs, float *out, size_t count)
+{
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 l = _mm256_loadu_ps(lhs + i);
+		__m256 r = _mm256_loadu_ps(rhs + i);
+		__m256 v;
+		switch (op)
+		{
+		case '+':
+			v = _mm256_add_ps(l, r);
+			break;
+		case '-':
+			v = _mm256_sub_ps(l, r);
+			break;
+		case '*':
+			v = _mm256_mul_ps(l, r);
+			break;
+		default:
+			v = _mm256_div_ps(l, r);
+			break;
+		}
+		_mm256_storeu_ps(out + i, v);
+	}
+	binary_scalar_isa(op, lhs + i, rhs + i, out + i, count - i);
+}
+
+__attribute__((target("avx2,fma"))) void binary_value_avx2(char op, const float *lhs, float rhs, float *out, size_t count)
+{
+	__m256 r = _mm256_set1_ps(rhs);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 l = _mm256_loadu_ps(lhs + i);
+		__m256 v;
+		switch (op)
+		{
+		case '+':
+			v = _mm256_add_ps(l, r);
+			break;
+		case '-':
+			v = _mm256_sub_ps(l, r);
+			break;
+		case '*':
+			v = _mm256_mul_ps(l, r);
+			break;
+		default:
+			v = _mm256_div_ps(l, r);
+			break;
+		}
+		_mm256_storeu_ps(out + i, v);
+	}
+	binary_scalar_value_isa(op, lhs + i, rhs, out + i, count - i);
+}
+
+__attribute__((target("avx2,fma"))) void axpy_avx2(float alpha, const float *x, float *y, size_t count)
+{
+	__m256 a = _mm256_set1_ps(alpha);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		_mm256_storeu_ps(y + i, _mm256_fmadd_ps(a, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+	}
+	axpy_scalar_isa(alpha, x + i, y + i, count - i);
+}
+
+__attribute__((target("avx2,fma"))) double sum_squares_avx2(const float *data, size_t count)
+{
+	// Float lanes over short blocks, folded into a double between blocks
+	double sum = 0.0;
+	size_t i = 0;
+	while (i + 8 <= count)
+	{
+		__m256 acc = _mm256_setzero_ps();
+		size_t block_end = i + 1024 < count ? i + 1024 : count;
+		for (; i + 8 <= block_end; i += 8)
+		{
+			__m256 v = _mm256_loadu_ps(data + i);
+			acc = _mm256_fmadd_ps(v, v, acc);
+		}
+		float lanes[8];
+		_mm256_storeu_ps(lanes, acc);
+		for (float lane : lanes)
+			sum += lane;
+	}
+	return sum + sum_squares_scalar_isa(data + i, count - i);
+}
+
+// AVX-512: 6 x 32 tile held in 12 zmm accumulators
+
+__attribute__((target("avx512f"))) void gemm_micro_avx512(int kc, const float *a, const float *b, float *c, int ldc, int rows,
+														  int cols, bool accumulate)
+{
+	__m512 acc[6][2];
+	for (int i = 0; i < 6; i++)
+	{
+		acc[i][0] = _mm512_setzero_ps();
+		acc[i][1] = _mm512_setzero_ps();
+	}
+	for (int p = 0; p < kc; p++)
+	{
+		__m512 b0 = _mm512_loadu_ps(b);
+		__m512 b1 = _mm512_loadu_ps(b + 16);
+		for (int i = 0; i < 6; i++)
+		{
+			__m512 ai = _mm512_set1_ps(a[i]);
+			acc[i][0] = _mm512_fmadd_ps(ai, b0, acc[i][0]);
+			acc[i][1] = _mm512_fmadd_ps(ai, b1, acc[i][1]);
+		}
+		a += 6;
+		b += 32;
+	}
+
+	if (rows == 6 && cols == 32)
+	{
+		for (int i = 0; i < 6; i++)
+		{
+			float *row = c + i * ldc;
+			if (accumulate)
+			{
+				acc[i][0] = _mm512_add_ps(acc[i][0], _mm512_loadu_ps(row));
+				acc[i][1] = _mm512_add_ps(acc[i][1], _mm512_loadu_ps(row + 16));
+			}
+			_mm512_storeu_ps(row, acc[i][0]);
+			_mm512_storeu_ps(row + 16, acc[i][1]);
+		}
+		return;
+	}
+	float tile[6 * 32];
+	for (int i = 0; i < 6; i++)
+	{
+		_mm512_storeu_ps(tile + i * 32, acc[i][0]);
+		_mm512_storeu_ps(tile + i * 32 + 16, acc[i][1]);
+	}
+	store_tile(tile, 32, c, ldc, rows, cols, accumulate);
+}
+
+__attribute__((target("avx512f"))) void axpy_avx512(float alpha, const float *x, float *y, size_t count)
+{
+	__m512 a = _mm512_set1_ps(alpha);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		_mm512_storeu_ps(y + i, _mm512_fmadd_ps(a, _mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i)));
+	}
+	axpy_scalar_isa(alpha, x + i, y + i, count - i);
+}
+
+#endif
+
+const NativeKernels scalar_kernels = {simd_levels::SCALAR, "scalar", scalar_mr, scalar_nr, gemm_micro_scalar,
+									  binary_scalar_isa, binary_scalar_value_isa, axpy_scalar_isa, sum_squares_scalar_isa};
+
+#ifdef BLITZ_X86
+const NativeKernels avx2_kernels = {simd_levels::AVX2, "avx2", 6, 16, gemm_micro_avx2,
+									binary_avx2, binary_value_avx2, axpy_avx2, sum_squares_avx2};
+
+// Streaming kernels are memory bound, the AVX2 versions already saturate bandwidth
+const NativeKernels avx512_kernels = {simd_levels::AVX512, "avx512", 6, 32, gemm_micro_avx512,
+									  binary_avx2, binary_value_avx2, axpy_avx512, sum_squares_avx2};
+#endif
+
+} // namespace
+
+const NativeKernels &select_native_kernels(simd_levels max_level)
+{
+#ifdef BLITZ_X86
+	__builtin_cpu_init();
+	if (max_level >= simd_levels::AVX512 && __builtin_cpu_supports("avx512f"))
+	{
+		return avx512_kernels;
+	}
+	if (max_level >= simd_levels::AVX2 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+	{
+		return avx2_kernels;
+	}
+#endif
+	return scalar_kernels;
+}
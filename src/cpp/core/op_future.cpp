@@ -0,0 +1,77 @@
+#include "include/op_future.hpp"
+#include <cstdlib>
+#include <stdexcept>
+#include <utility>
+
+OpFuture::OpFuture(cl_event event, float *result)
+	: done_event(event), result(result)
+{
+}
+
+OpFuture::~OpFuture()
+{
+	release();
+}
+
+OpFuture::OpFuture(OpFuture &&other) noexcept
+	: done_event(other.done_event), result(other.result)
+{
+	other.done_event = nullptr;
+	other.result = nullptr;
+}
+
+OpFuture &OpFuture::operator=(OpFuture &&other) noexcept
+{
+	if (this != &other)
+	{
+		release();
+		std::swap(done_event, other.done_event);
+		std::swap(result, other.result);
+	}
+	return *this;
+}
+
+void OpFuture::release()
+{
+	if (done_event)
+	{
+		// The device may still be writing into result
+		if (result)
+			clWaitForEvents(1, &done_event);
+		clReleaseEvent(done_event);
+	}
+	free(result);
+	done_event = nullptr;
+	result = nullptr;
+}
+
+float *OpFuture::wait()
+{
+	if (done_event)
+	{
+		cl_int err = clWaitForEvents(1, &done_event);
+		if (err != CL_SUCCESS)
+		{
+			throw std::runtime_error("Asynchronous operation failed");
+		}
+	}
+	float *taken = result;
+	result = nullptr;
+	return taken;
+}
+
+bool OpFuture::ready() const
+{
+	if (!done_event)
+	{
+		return true;
+	}
+	cl_int status;
+	cl_int err = clGetEventInfo(done_event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, NULL);
+	if (err != CL_SUCCESS)
+	{
+		throw std::runtime_error("Failed to query event status");
+	}
+	// Negative statuses are errors, which wait() reports
+	return status == CL_COMPLETE || status < 0;
+}
@@ -1,310 +1,2642 @@
 #include "include/operation_manager.hpp"
+#include "include/device_manager.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <new>
+#include <sstream>
+#include <unistd.h>
 
-OperationManager::OperationManager(device_types device_type)
+namespace
 {
+	// Drop the reference from_mapped() holds on a mapping once the device is done with it
+	void CL_CALLBACK release_mapping(cl_mem, void *user_data)
+	{
+		delete static_cast<std::shared_ptr<const MappedMatrix> *>(user_data);
+	}
+
+	void CL_CALLBACK release_mapping_after(cl_event, cl_int, void *user_data)
+	{
+		delete static_cast<std::shared_ptr<const MappedMatrix> *>(user_data);
+	}
+}
+
+thread_local OperationManager::Lane *OperationManager::active_lane = nullptr;
+
+OperationManager::OperationManager(device_types device_type, bool profiling) : profiling(profiling)
+{
+	if (device_type == device_types::NATIVE_CPU)
+	{
+		native.reset(new NativeBackend());
+		this->profiling = false; // Profiles come from OpenCL events
+		return;
+	}
+
+	// First device of the requested type on any platform
+	cl_device_type wanted = device_type == device_types::GPU_DEVICE ? CL_DEVICE_TYPE_GPU : CL_DEVICE_TYPE_CPU;
+	for (const DeviceManager::Device &candidate : DeviceManager::enumerate())
+	{
+		if (candidate.type & wanted)
+		{
+			init(candidate.platform, candidate.device);
+			return;
+		}
+	}
+	throw std::runtime_error(device_type == device_types::GPU_DEVICE ? "No OpenCL GPU device found" : "No OpenCL CPU device found");
+}
+
+OperationManager::OperationManager(cl_platform_id platform_id, cl_device_id device_id, bool profiling) : profiling(profiling)
+{
+	init(platform_id, device_id);
+}
+
+void OperationManager::init(cl_platform_id platform_id, cl_device_id device_id)
+{
+	platform = platform_id;
+	device = device_id;
+
+	// Step 2: Create Context and the first lane's Command Queue, more lanes are added as threads need them
+	context = clCreateContext(NULL, 1, &device, NULL, NULL, NULL);
+	queue_properties = profiling ? CL_QUEUE_PROFILING_ENABLE : 0;
+	Lane *first_lane = acquire_lane();
+
+	// Devices sharing host memory skip the copies of host operations
+	cl_bool unified_memory = CL_FALSE;
+	cl_uint base_align_bits = 0;
+	clGetDeviceInfo(device, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(unified_memory), &unified_memory, NULL);
+	clGetDeviceInfo(device, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(base_align_bits), &base_align_bits, NULL);
+	base_alignment = std::max<size_t>(base_align_bits / 8, sizeof(float));
+	zero_copy = unified_memory == CL_TRUE;
+	buffer_pool = std::make_shared<BufferPool>(context, zero_copy ? page_alignment() : 0);
+
+	if (profiling)
+	{
+		// Device timestamps use their own clock: line it up with the host clock
+		// through a marker queued between two host readings
+		double before = host_seconds();
+		cl_event marker;
+		if (clEnqueueMarkerWithWaitList(first_lane->queue, 0, NULL, &marker) == CL_SUCCESS)
+		{
+			double after = host_seconds();
+			clWaitForEvents(1, &marker);
+			cl_ulong queued = 0;
+			clGetEventProfilingInfo(marker, CL_PROFILING_COMMAND_QUEUED, sizeof(queued), &queued, NULL);
+			device_clock_offset = (before + after) / 2 - queued * 1e-9;
+			clReleaseEvent(marker);
+		}
+	}
+	release_lane(first_lane);
+
+	// Device limits used to shape launches
+	clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(max_work_group_size), &max_work_group_size, NULL);
+	clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(max_work_item_sizes), max_work_item_sizes, NULL);
+	clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(local_memory_size), &local_memory_size, NULL);
+	clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(global_memory_size), &global_memory_size, NULL);
+	clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(max_alloc_size), &max_alloc_size, NULL);
+	clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(compute_units), &compute_units, NULL);
+	// Wide SIMD CPUs report 8 or 16, most GPUs 1 but still load float4 in one transaction
+	cl_uint preferred_width = 0;
+	clGetDeviceInfo(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT, sizeof(preferred_width), &preferred_width, NULL);
+	elementwise_launch.vector_width = preferred_width >= 8 ? 8 : 4;
+	while (reduce_work_group > max_work_group_size && reduce_work_group > 1)
+	{
+		reduce_work_group /= 2;
+	}
+	while (lu_blocking.tile * lu_blocking.tile > max_work_group_size && lu_blocking.tile > 1)
+	{
+		lu_blocking.tile /= 2;
+	}
+
+	// Parameters from an earlier autotune() of this device, defaults otherwise
+	std::string path = tuning_path();
+	if (!path.empty())
+	{
+		load_tuning(path);
+	}
+}
+
+OperationManager::~OperationManager()
+{
+	if (native)
+	{
+		return;
+	}
+	for (PendingProfile &pending : pending_profiles)
+	{
+		for (ProfileEvent &recorded : pending.events)
+			clReleaseEvent(recorded.event);
+	}
+	for (std::unique_ptr<Lane> &lane : lanes)
+	{
+		for (auto &entry : lane->kernels)
+			clReleaseKernel(entry.second);
+		for (auto &entry : lane->fused_kernels)
+			clReleaseKernel(entry.second);
+	}
+	for (auto &entry : program_cache)
+	{
+		clReleaseProgram(entry.second);
+	}
+	for (auto &entry : fused_programs)
+	{
+		clReleaseProgram(entry.second);
+	}
+	// Device matrices still alive keep their own reference to the pool
+	buffer_pool.reset();
+	for (std::unique_ptr<Lane> &lane : lanes)
+	{
+		clReleaseCommandQueue(lane->queue);
+	}
+	clReleaseContext(context);
+}
+
+OperationManager::Lane *OperationManager::acquire_lane()
+{
+	std::unique_lock<std::mutex> lock(lane_mutex);
+	while (true)
+	{
+		if (!idle_lanes.empty())
+		{
+			Lane *lane = idle_lanes.back();
+			idle_lanes.pop_back();
+			return lane;
+		}
+		if (lanes.size() < max_lanes)
+		{
+			cl_int err;
+			cl_command_queue lane_queue = clCreateCommandQueue(context, device, queue_properties, &err);
+			if (err == CL_SUCCESS)
+			{
+				std::unique_ptr<Lane> lane(new Lane());
+				lane->owner = this;
+				lane->index = static_cast<int>(lanes.size());
+				lane->queue = lane_queue;
+				lanes.push_back(std::move(lane));
+				return lanes.back().get();
+			}
+			if (lanes.empty())
+			{
+				throw std::runtime_error("Failed to create command queue");
+			}
+			// The device is out of queues, make do with the lanes there are
+			max_lanes = lanes.size();
+		}
+		lane_idle.wait(lock);
+	}
+}
+
+void OperationManager::release_lane(Lane *lane)
+{
+	// Ops on other lanes may wait on this lane's events, which only progress once submitted
+	clFlush(lane->queue);
+	{
+		std::lock_guard<std::mutex> lock(lane_mutex);
+		idle_lanes.push_back(lane);
+	}
+	lane_idle.notify_one();
+}
+
+OperationManager::Lane &OperationManager::current_lane() const
+{
+	// Set by the OpScope every public op opens before it touches a queue or kernel
+	if (!active_lane || active_lane->owner != this)
+	{
+		throw std::runtime_error("Operation has no command queue bound");
+	}
+	return *active_lane;
+}
+
+size_t OperationManager::max_queues() const
+{
+	std::lock_guard<std::mutex> lock(lane_mutex);
+	return max_lanes;
+}
+
+void OperationManager::set_max_queues(size_t count)
+{
+	{
+		std::lock_guard<std::mutex> lock(lane_mutex);
+		max_lanes = std::max<size_t>(count, 1);
+	}
+	// Callers waiting for a lane may now create one
+	lane_idle.notify_all();
+}
+
+size_t OperationManager::queue_count() const
+{
+	std::lock_guard<std::mutex> lock(lane_mutex);
+	return lanes.size();
+}
+
+cl_program OperationManager::get_program(operation_types op_type, const std::string &build_options)
+{
+	std::lock_guard<std::mutex> lock(program_mutex);
+	auto key = std::make_pair(op_type, build_options);
+	auto cached = program_cache.find(key);
+	if (cached != program_cache.end())
+	{
+		return cached->second;
+	}
+
+	cl_program program = build_program(kernel_manager.getKernelSource(op_type), build_options);
+	program_cache.emplace(key, program);
+	return program;
+}
+
+cl_program OperationManager::build_program(const std::string &source, const std::string &build_options)
+{
+	auto build_start = std::chrono::steady_clock::now();
+
+	bool from_binary = false;
+	cl_program program = kernel_manager.buildProgram(context, device, source, build_options, &from_binary);
+	std::chrono::duration<double> build_time = std::chrono::steady_clock::now() - build_start;
+	if (!program)
+	{
+		throw std::runtime_error("Failed to build program");
+	}
+
+	// Only reached with a built program, a failed build threw above and is not counted
+	std::lock_guard<std::mutex> lock(state_mutex);
+	if (from_binary)
+	{
+		cache_stats.binary_loads++;
+	}
+	else
+	{
+		cache_stats.program_builds++;
+	}
+	cache_stats.build_seconds += build_time.count();
+	return program;
+}
+
+void OperationManager::count_kernel_lookup(bool hit)
+{
+	std::lock_guard<std::mutex> lock(state_mutex);
+	if (hit)
+	{
+		cache_stats.kernel_hits++;
+	}
+	else
+	{
+		cache_stats.kernel_misses++;
+	}
+}
+
+cl_kernel OperationManager::get_kernel(operation_types op_type, const std::string &build_options, const std::string &kernel_name)
+{
+	// Kernels are per lane, their arguments belong to the one thread using it
+	Lane &lane = current_lane();
+	auto key = std::make_tuple(op_type, build_options, kernel_name);
+	auto cached = lane.kernels.find(key);
+	if (cached != lane.kernels.end())
+	{
+		count_kernel_lookup(true);
+		return cached->second;
+	}
+	count_kernel_lookup(false);
+
+	cl_int err;
+	cl_program program = get_program(op_type, build_options);
+	cl_kernel kernel = clCreateKernel(program, kernel_name.c_str(), &err);
+	if (err != CL_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create kernel: " + kernel_name);
+	}
+
+	lane.kernels.emplace(key, kernel);
+	return kernel;
+}
+
+cl_kernel OperationManager::get_fused_kernel(const std::string &source)
+{
+	Lane &lane = current_lane();
+	auto cached = lane.fused_kernels.find(source);
+	if (cached != lane.fused_kernels.end())
+	{
+		count_kernel_lookup(true);
+		return cached->second;
+	}
+	count_kernel_lookup(false);
+
+	cl_int err;
+	cl_kernel kernel;
+	{
+		std::lock_guard<std::mutex> lock(program_mutex);
+		auto program = fused_programs.find(source);
+		if (program == fused_programs.end())
+		{
+			program = fused_programs.emplace(source, build_program(source, "")).first;
+		}
+		kernel = clCreateKernel(program->second, "blitz_fused", &err);
+	}
+	if (err != CL_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create kernel: blitz_fused");
+	}
+
+	lane.fused_kernels.emplace(source, kernel);
+	return kernel;
+}
+
+void OperationManager::warm_up()
+{
+	warm_up(kernel_manager.getOperationTypes());
+}
+
+void OperationManager::warm_up(const std::vector<operation_types> &op_types)
+{
+	if (native)
+	{
+		return; // Nothing is compiled at runtime
+	}
+	for (operation_types op_type : op_types)
+	{
+		for (const auto &program : dispatch_programs(op_type))
+		{
+			get_program(program.first, program.second);
+		}
+	}
+}
+
+std::string OperationManager::program_options(operation_types op_type) const
+{
+	switch (op_type)
+	{
+	case operation_types::TRANSPOSE:
+		return transpose_tiling.build_options();
+	case operation_types::INVERSE:
+		return lu_blocking.build_options(reduce_work_group);
+	default:
+		return "";
+	}
+}
+
+std::vector<std::pair<operation_types, std::string>> OperationManager::dispatch_programs(operation_types op_type) const
+{
+	switch (op_type)
+	{
+	case operation_types::MATRIX_MULTIPLICATION:
+		return {{op_type, ""}, {op_type, gemm_tiling.build_options()}};
+	case operation_types::FROBENIUS_NORM:
+	case operation_types::TRACE:
+		return {{op_type, ""}, {op_type, reduce_build_options()}};
+	case operation_types::DETERMINANT:
+		return {{op_type, ""}, {operation_types::LU_DECOMPOSITION, lu_blocking.build_options(reduce_work_group)}};
+	case operation_types::ELEM_WISE_ADD:
+	case operation_types::ELEM_WISE_SUB:
+	case operation_types::ELEM_WISE_MUL:
+	case operation_types::ELEM_WISE_DIV:
+		return {{op_type, ""},
+				{op_type, KernelManager::elementwiseOptions(KernelManager::Broadcast::NONE, false, 0, 0, 0, 0) + " " +
+							  elementwise_launch.build_options()}};
+	case operation_types::TRANSPOSE:
+		return {{op_type, program_options(op_type)}};
+	case operation_types::INVERSE:
+		return {{operation_types::LU_DECOMPOSITION, lu_blocking.build_options(reduce_work_group)},
+				{op_type, program_options(op_type)}};
+	case operation_types::LU_DECOMPOSITION:
+		return {{op_type, lu_blocking.build_options(reduce_work_group)}};
+	default:
+		return {{op_type, ""}};
+	}
+}
+
+OperationManager::CacheStats OperationManager::get_cache_stats() const
+{
+	std::lock_guard<std::mutex> lock(state_mutex);
+	return cache_stats;
+}
+
+void OperationManager::reset_cache_stats()
+{
+	std::lock_guard<std::mutex> lock(state_mutex);
+	cache_stats = CacheStats();
+}
+
+void OperationManager::set_binary_cache_dir(const std::string &directory)
+{
+	kernel_manager.setBinaryCacheDir(directory);
+}
+
+void OperationManager::set_kernel_variant(operation_types op_type, kernel_variants variant)
+{
+	selected_variants[op_type] = variant;
+}
+
+OperationManager::kernel_variants OperationManager::get_kernel_variant(operation_types op_type) const
+{
+	auto selected = selected_variants.find(op_type);
+	return selected == selected_variants.end() ? kernel_variants::AUTO : selected->second;
+}
+
+void OperationManager::set_shape_specialization(size_t min_calls)
+{
+	std::lock_guard<std::mutex> lock(state_mutex);
+	fixed_shape_calls = min_calls;
+}
+
+bool OperationManager::hot_shape(int lheight, int lwidth, int rheight, int rwidth)
+{
+	std::lock_guard<std::mutex> lock(state_mutex);
+	if (fixed_shape_calls == 0)
+	{
+		return false;
+	}
+	auto key = std::make_tuple(lheight, lwidth, rheight, rwidth);
+	if (fixed_shapes.count(key))
+	{
+		return true;
+	}
+	if (fixed_shapes.size() >= max_fixed_shapes())
+	{
+		return false;
+	}
+	// Bounds the counters when many shapes pass through once
+	if (shape_calls.size() >= 256 && !shape_calls.count(key))
+	{
+		shape_calls.clear();
+	}
+	if (++shape_calls[key] < fixed_shape_calls)
+	{
+		return false;
+	}
+	shape_calls.erase(key);
+	fixed_shapes.insert(key);
+	return true;
+}
+
+bool OperationManager::use_optimized_kernel(operation_types op_type, bool worthwhile) const
+{
+	switch (get_kernel_variant(op_type))
+	{
+	case kernel_variants::REFERENCE:
+		return false;
+	case kernel_variants::OPTIMIZED:
+		return true;
+	default:
+		return worthwhile;
+	}
+}
+
+size_t OperationManager::kernel_work_group_size(cl_kernel kernel) const
+{
+	size_t work_group_size = 0;
+	clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(work_group_size), &work_group_size, NULL);
+	return work_group_size;
+}
+
+bool OperationManager::valid_tiling(const GemmTiling &tiling) const
+{
+	if (tiling.tsm <= 0 || tiling.tsn <= 0 || tiling.tsk <= 0 || tiling.wptm <= 0 || tiling.wptn <= 0 ||
+		tiling.tsm % tiling.wptm != 0 || tiling.tsn % tiling.wptn != 0 || tiling.tsk % 4 != 0 || tiling.tsn % 4 != 0)
+	{
+		return false;
+	}
+	// Every work-item loads a whole number of float4s of both tiles
+	size_t group_cols = static_cast<size_t>(tiling.tsn / tiling.wptn);
+	size_t group_rows = static_cast<size_t>(tiling.tsm / tiling.wptm);
+	size_t loads = 4 * group_cols * group_rows;
+	if (static_cast<size_t>(tiling.tsk * tiling.tsm) % loads != 0 || static_cast<size_t>(tiling.tsk * tiling.tsn) % loads != 0)
+	{
+		return false;
+	}
+	cl_ulong local_bytes = static_cast<cl_ulong>(tiling.tsk * (tiling.tsm + 1) + tiling.tsk * tiling.tsn) * sizeof(float);
+	return group_cols * group_rows <= max_work_group_size && group_cols <= max_work_item_sizes[0] &&
+		   group_rows <= max_work_item_sizes[1] && local_bytes <= local_memory_size;
+}
+
+bool OperationManager::valid_tiling(const TransposeTiling &tiling) const
+{
+	if (tiling.tile <= 0 || tiling.rows <= 0 || tiling.tile % tiling.rows != 0)
+	{
+		return false;
+	}
+	// blitz_kernel_inplace stages two tiles
+	cl_ulong local_bytes = 2 * static_cast<cl_ulong>(tiling.tile) * (tiling.tile + 1) * sizeof(float);
+	size_t tile = static_cast<size_t>(tiling.tile);
+	size_t rows = static_cast<size_t>(tiling.rows);
+	return tile * rows <= max_work_group_size && tile <= max_work_item_sizes[0] && rows <= max_work_item_sizes[1] &&
+		   local_bytes <= local_memory_size;
+}
+
+bool OperationManager::valid_launch(const ElementwiseLaunch &launch) const
+{
+	if (launch.vector_width != 4 && launch.vector_width != 8 && launch.vector_width != 16)
+	{
+		return false;
+	}
+	if (launch.rows == 0 && launch.cols == 0)
+	{
+		return true;
+	}
+	return launch.rows > 0 && launch.cols > 0 && launch.rows * launch.cols <= max_work_group_size &&
+		   launch.rows <= max_work_item_sizes[0] && launch.cols <= max_work_item_sizes[1];
+}
+
+double OperationManager::time_runs(const std::function<void()> &fn)
+{
+	fn(); // Builds the program outside the timed runs
+	clFinish(queue());
+
+	double best = std::numeric_limits<double>::infinity();
+	for (int run = 0; run < 3; run++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		fn();
+		clFinish(queue());
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		best = std::min(best, elapsed.count());
+	}
+	return best;
+}
+
+void OperationManager::evict_programs(operation_types op_type, const std::vector<std::string> &keep)
+{
+	auto kept = [&keep](const std::string &options)
+	{ return std::find(keep.begin(), keep.end(), options) != keep.end(); };
+
+	{
+		std::lock_guard<std::mutex> lock(lane_mutex);
+		for (std::unique_ptr<Lane> &lane : lanes)
+		{
+			for (auto entry = lane->kernels.begin(); entry != lane->kernels.end();)
+			{
+				if (std::get<0>(entry->first) == op_type && !kept(std::get<1>(entry->first)))
+				{
+					clReleaseKernel(entry->second);
+					entry = lane->kernels.erase(entry);
+				}
+				else
+				{
+					++entry;
+				}
+			}
+		}
+	}
+	std::lock_guard<std::mutex> lock(program_mutex);
+	for (auto entry = program_cache.begin(); entry != program_cache.end();)
+	{
+		if (entry->first.first == op_type && !kept(entry->first.second))
+		{
+			clReleaseProgram(entry->second);
+			entry = program_cache.erase(entry);
+		}
+		else
+		{
+			++entry;
+		}
+	}
+}
+
+std::string OperationManager::autotune(int representative_size)
+{
+	require_opencl();
+	cl_device_type type = 0;
+	clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+	bool gpu = (type & CL_DEVICE_TYPE_GPU) != 0;
+	int gemm_size = representative_size > 0 ? representative_size : (gpu ? 1024 : 512);
+	int copy_size = representative_size > 0 ? representative_size : (gpu ? 2048 : 1024);
+
+	std::vector<GemmTiling> gemm_candidates = {gemm_tiling};
+	for (int tile : {32, 64, 128})
+	{
+		for (int tsk : {16, 32})
+		{
+			for (int work : {2, 4, 8})
+			{
+				GemmTiling candidate;
+				candidate.tsm = candidate.tsn = tile;
+				candidate.tsk = tsk;
+				candidate.wptm = candidate.wptn = work;
+				gemm_candidates.push_back(candidate);
+			}
+		}
+	}
+	std::vector<TransposeTiling> transpose_candidates = {transpose_tiling};
+	for (int tile : {16, 32, 64})
+	{
+		for (int rows : {2, 4, 8, 16})
+		{
+			TransposeTiling candidate;
+			candidate.tile = tile;
+			candidate.rows = rows;
+			transpose_candidates.push_back(candidate);
+		}
+	}
+	std::vector<ElementwiseLaunch> launch_candidates = {{0, 0}, {1, 64}, {1, 128}, {1, 256}, {4, 64}, {8, 32}, {16, 16}};
+
+	// Timed runs are neither profiled nor written to the binary cache, only the winners are worth keeping
+	std::string binary_cache_dir = kernel_manager.getBinaryCacheDir();
+	bool was_profiling = profiling;
+	kernel_variants gemm_variant = get_kernel_variant(operation_types::MATRIX_MULTIPLICATION);
+	kernel_variants transpose_variant = get_kernel_variant(operation_types::TRANSPOSE);
+	kernel_manager.setBinaryCacheDir("");
+	profiling = false;
+	set_kernel_variant(operation_types::MATRIX_MULTIPLICATION, kernel_variants::OPTIMIZED);
+	set_kernel_variant(operation_types::TRANSPOSE, kernel_variants::OPTIMIZED);
+	OpScope scope(*this, "autotune", gemm_size, gemm_size); // One lane for every timed run
+
+	GemmTiling best_gemm = gemm_tiling;
+	TransposeTiling best_transpose = transpose_tiling;
+	ElementwiseLaunch best_launch = elementwise_launch;
+	auto restore = [&]()
+	{
+		gemm_tiling = best_gemm;
+		transpose_tiling = best_transpose;
+		elementwise_launch = best_launch;
+		kernel_manager.setBinaryCacheDir(binary_cache_dir);
+		profiling = was_profiling;
+		set_kernel_variant(operation_types::MATRIX_MULTIPLICATION, gemm_variant);
+		set_kernel_variant(operation_types::TRANSPOSE, transpose_variant);
+	};
+
+	try
+	{
+		std::vector<float> values(static_cast<size_t>(std::max(gemm_size, copy_size)) * std::max(gemm_size, copy_size));
+		for (size_t i = 0; i < values.size(); i++)
+		{
+			values[i] = static_cast<float>(i % 17) * 0.25f + 1.0f;
+		}
+
+		// A variant the compiler rejects, or whose compiled kernel cannot hold the
+		// work-group (dispatch would quietly fall back to another kernel), is skipped
+		DeviceMatrix gemm_input = from_host(values.data(), gemm_size, gemm_size);
+		double best_seconds = std::numeric_limits<double>::infinity();
+		for (const GemmTiling &candidate : gemm_candidates)
+		{
+			if (!valid_tiling(candidate))
+				continue;
+			try
+			{
+				gemm_tiling = candidate;
+				cl_kernel kernel = get_kernel(operation_types::MATRIX_MULTIPLICATION, candidate.build_options(), "blitz_kernel_tiled");
+				if (kernel_work_group_size(kernel) < static_cast<size_t>((candidate.tsm / candidate.wptm) * (candidate.tsn / candidate.wptn)))
+					continue;
+				double seconds = time_runs([&]()
+										   { multi_vector_op(operation_types::MATRIX_MULTIPLICATION, gemm_input, gemm_input); });
+				if (seconds < best_seconds)
+				{
+					best_seconds = seconds;
+					best_gemm = candidate;
+				}
+			}
+			catch (const std::exception &)
+			{
+			}
+		}
+		gemm_tiling = best_gemm;
+
+		DeviceMatrix copy_input = from_host(values.data(), copy_size, copy_size);
+		best_seconds = std::numeric_limits<double>::infinity();
+		for (const TransposeTiling &candidate : transpose_candidates)
+		{
+			if (!valid_tiling(candidate))
+				continue;
+			try
+			{
+				transpose_tiling = candidate;
+				size_t group = static_cast<size_t>(candidate.tile * candidate.rows);
+				std::string options = candidate.build_options();
+				if (kernel_work_group_size(get_kernel(operation_types::TRANSPOSE, options, "blitz_kernel_tiled")) < group ||
+					kernel_work_group_size(get_kernel(operation_types::TRANSPOSE, options, "blitz_kernel_inplace")) < group)
+					continue;
+				double seconds = time_runs([&]()
+										   { single_vector_op(operation_types::TRANSPOSE, copy_input); });
+				if (seconds < best_seconds)
+				{
+					best_seconds = seconds;
+					best_transpose = candidate;
+				}
+			}
+			catch (const std::exception &)
+			{
+			}
+		}
+		transpose_tiling = best_transpose;
+
+		// The 2-D work-group shape only serves broadcasting operands, time it on a repeated row
+		DeviceMatrix row_input = from_host(values.data(), 1, copy_size);
+		best_seconds = std::numeric_limits<double>::infinity();
+		for (ElementwiseLaunch candidate : launch_candidates)
+		{
+			candidate.vector_width = best_launch.vector_width;
+			if (!valid_launch(candidate))
+				continue;
+			try
+			{
+				elementwise_launch = candidate;
+				if (kernel_work_group_size(get_kernel(operation_types::ELEM_WISE_ADD)) < candidate.rows * candidate.cols)
+					continue;
+				double seconds = time_runs([&]()
+										   { multi_vector_op(operation_types::ELEM_WISE_ADD, copy_input, row_input); });
+				if (seconds < best_seconds)
+				{
+					best_seconds = seconds;
+					best_launch = candidate;
+				}
+			}
+			catch (const std::exception &)
+			{
+			}
+		}
+
+		best_seconds = std::numeric_limits<double>::infinity();
+		for (int width : {4, 8, 16})
+		{
+			ElementwiseLaunch candidate = best_launch;
+			candidate.vector_width = width;
+			try
+			{
+				elementwise_launch = candidate;
+				double seconds = time_runs([&]()
+										   { multi_vector_op(operation_types::ELEM_WISE_ADD, copy_input, copy_input); });
+				if (seconds < best_seconds)
+				{
+					best_seconds = seconds;
+					best_launch = candidate;
+				}
+			}
+			catch (const std::exception &)
+			{
+			}
+		}
+	}
+	catch (...)
+	{
+		restore();
+		throw;
+	}
+	restore();
+
+	evict_programs(operation_types::MATRIX_MULTIPLICATION, {"", gemm_tiling.build_options()});
+	evict_programs(operation_types::TRANSPOSE, {program_options(operation_types::TRANSPOSE)});
+	// The vector width sweep left a program per width behind
+	for (operation_types op_type : {operation_types::ELEM_WISE_ADD, operation_types::ELEM_WISE_SUB, operation_types::ELEM_WISE_MUL,
+									operation_types::ELEM_WISE_DIV})
+	{
+		std::vector<std::string> keep;
+		for (const auto &program : dispatch_programs(op_type))
+			keep.push_back(program.second);
+		evict_programs(op_type, keep);
+	}
+
+	std::string path = tuning_path();
+	if (!path.empty() && KernelManager::createDirectories(tuning_dir))
+	{
+		save_tuning(path);
+	}
+	return tuning_string();
+}
+
+std::string OperationManager::default_tuning_dir()
+{
+	if (const char *configured = std::getenv("BLITZMAT_TUNING_DIR"))
+	{
+		return configured;
+	}
+	if (const char *xdg_cache = std::getenv("XDG_CACHE_HOME"))
+	{
+		return std::string(xdg_cache) + "/blitzmat/tuning";
+	}
+	if (const char *home = std::getenv("HOME"))
+	{
+		return std::string(home) + "/.cache/blitzmat/tuning";
+	}
+	return "";
+}
+
+std::string OperationManager::tuning_path() const
+{
+	if (native || tuning_dir.empty())
+	{
+		return "";
+	}
+	return tuning_dir + "/" + KernelManager::keyHash(KernelManager::deviceIdentity(device)) + ".tune";
+}
+
+void OperationManager::set_tuning_dir(const std::string &directory)
+{
+	tuning_dir = directory;
+}
+
+std::string OperationManager::tuning_string() const
+{
+	std::ostringstream text;
+	text << "gemm tsm=" << gemm_tiling.tsm << " tsn=" << gemm_tiling.tsn << " tsk=" << gemm_tiling.tsk
+		 << " wptm=" << gemm_tiling.wptm << " wptn=" << gemm_tiling.wptn << "\n";
+	text << "transpose tile=" << transpose_tiling.tile << " rows=" << transpose_tiling.rows << "\n";
+	text << "elementwise rows=" << elementwise_launch.rows << " cols=" << elementwise_launch.cols
+		 << " vector=" << elementwise_launch.vector_width << "\n";
+	return text.str();
+}
+
+bool OperationManager::save_tuning(const std::string &path) const
+{
+	if (native)
+	{
+		return false;
+	}
+	char name[256] = {0};
+	clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(name) - 1, name, NULL);
+
+	// Written aside and renamed so a concurrent load never sees half a file
+	std::string temp_path = path + ".tmp." + std::to_string(getpid());
+	{
+		std::ofstream file(temp_path, std::ios::trunc);
+		if (!file.is_open())
+		{
+			return false;
+		}
+		// The device line ties the file to this device and driver, the name is for people reading it
+		file << "# " << name << "\n";
+		file << "device " << KernelManager::keyHash(KernelManager::deviceIdentity(device)) << "\n";
+		file << tuning_string();
+		if (!file)
+		{
+			file.close();
+			std::remove(temp_path.c_str());
+			return false;
+		}
+	}
+	if (std::rename(temp_path.c_str(), path.c_str()) != 0)
+	{
+		std::remove(temp_path.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool OperationManager::load_tuning(const std::string &path)
+{
+	if (native)
+	{
+		return false;
+	}
+	std::ifstream file(path);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	GemmTiling gemm = gemm_tiling;
+	TransposeTiling transpose = transpose_tiling;
+	ElementwiseLaunch launch = elementwise_launch;
+	bool same_device = false;
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::istringstream fields(line);
+		std::string section;
+		if (!(fields >> section) || section[0] == '#')
+		{
+			continue;
+		}
+		if (section == "device")
+		{
+			std::string hash;
+			fields >> hash;
+			same_device = hash == KernelManager::keyHash(KernelManager::deviceIdentity(device));
+			continue;
+		}
+
+		// key=value pairs, a missing key reads as 0 and fails validation
+		std::map<std::string, int> values;
+		std::string field;
+		while (fields >> field)
+		{
+			size_t equals = field.find('=');
+			if (equals == std::string::npos)
+			{
+				return false;
+			}
+			values[field.substr(0, equals)] = std::atoi(field.c_str() + equals + 1);
+		}
+		if (section == "gemm")
+		{
+			gemm.tsm = values["tsm"];
+			gemm.tsn = values["tsn"];
+			gemm.tsk = values["tsk"];
+			gemm.wptm = values["wptm"];
+			gemm.wptn = values["wptn"];
+		}
+		else if (section == "transpose")
+		{
+			transpose.tile = values["tile"];
+			transpose.rows = values["rows"];
+		}
+		else if (section == "elementwise")
+		{
+			launch.rows = static_cast<size_t>(std::max(0, values["rows"]));
+			launch.cols = static_cast<size_t>(std::max(0, values["cols"]));
+			// Files written before the flat kernel keep the device default
+			if (values.count("vector"))
+				launch.vector_width = values["vector"];
+		}
+	}
+
+	if (!same_device || !valid_tiling(gemm) || !valid_tiling(transpose) || !valid_launch(launch))
+	{
+		return false;
+	}
+	gemm_tiling = gemm;
+	transpose_tiling = transpose;
+	elementwise_launch = launch;
+	return true;
+}
+
+BufferPool::Stats OperationManager::get_pool_stats() const
+{
+	return native ? BufferPool::Stats() : buffer_pool->get_stats();
+}
+
+void OperationManager::trim_pool(size_t target_bytes)
+{
+	if (!native)
+		buffer_pool->trim(target_bytes);
+}
+
+void OperationManager::set_pool_limits(size_t max_pooled_bytes, size_t max_buffer_bytes)
+{
+	if (!native)
+		buffer_pool->set_limits(max_pooled_bytes, max_buffer_bytes);
+}
+
+void OperationManager::finish()
+{
+	// Native operations complete before returning
+	if (native)
+		return;
+	std::vector<cl_command_queue> queues;
+	{
+		std::lock_guard<std::mutex> lock(lane_mutex);
+		for (std::unique_ptr<Lane> &lane : lanes)
+			queues.push_back(lane->queue);
+	}
+	for (cl_command_queue lane_queue : queues)
+		clFinish(lane_queue);
+}
+
+void OperationManager::require_opencl() const
+{
+	if (native)
+	{
+		throw std::runtime_error("Device matrices need an OpenCL device");
+	}
+}
+
+std::string OperationManager::GemmTiling::build_options() const
+{
+	return "-DTSM=" + std::to_string(tsm) + " -DTSN=" + std::to_string(tsn) + " -DTSK=" + std::to_string(tsk) +
+		   " -DWPTM=" + std::to_string(wptm) + " -DWPTN=" + std::to_string(wptn);
+}
+
+std::string OperationManager::reduce_build_options() const
+{
+	return "-DREDUCE_WG=" + std::to_string(reduce_work_group);
+}
+
+std::string OperationManager::TransposeTiling::build_options() const
+{
+	return "-DTRANSPOSE_TILE=" + std::to_string(tile) + " -DTRANSPOSE_ROWS=" + std::to_string(rows);
+}
+
+std::string OperationManager::ElementwiseLaunch::build_options() const
+{
+	return "-DVECTOR_WIDTH=" + std::to_string(vector_width);
+}
+
+std::string OperationManager::LUBlocking::build_options(size_t work_group) const
+{
+	return "-DLU_WG=" + std::to_string(work_group) + " -DLU_TILE=" + std::to_string(tile);
+}
+
+DeviceMatrix OperationManager::from_host(const float *data, int height, int width)
+{
+	require_opencl();
+	OpScope scope(*this, "from_host", height, width, 0, 0, 0.0, static_cast<size_t>(height) * width * sizeof(float));
+	DeviceMatrix matrix(buffer_pool, queue(), height, width);
+	matrix.from_host(data);
+	record_event("write", matrix.event());
+	return matrix;
+}
+
+DeviceMatrix OperationManager::from_host_async(const float *data, int height, int width, const std::vector<cl_event> &wait_list)
+{
+	require_opencl();
+	OpScope scope(*this, "from_host", height, width, 0, 0, 0.0, static_cast<size_t>(height) * width * sizeof(float));
+	DeviceMatrix matrix(buffer_pool, queue(), height, width);
+	matrix.from_host_async(data, wait_list);
+	record_event("write", matrix.event());
+	return matrix;
+}
+
+DeviceMatrix OperationManager::from_mapped(std::shared_ptr<const MappedMatrix> mapped, size_t chunk_bytes,
+										  const std::vector<cl_event> &wait_list)
+{
+	require_opencl();
+	if (!mapped)
+	{
+		throw std::invalid_argument("No mapped matrix given");
+	}
+	int height = mapped->height();
+	int width = mapped->width();
+	const float *data = mapped->data();
+	size_t bytes = mapped->bytes();
+	OpScope scope(*this, "from_mapped", height, width, 0, 0, 0.0, bytes);
+
+	if (zero_copy && reinterpret_cast<uintptr_t>(data) % base_alignment == 0)
+	{
+		cl_int err;
+		cl_mem buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, bytes, const_cast<float *>(data), &err);
+		if (err == CL_SUCCESS)
+		{
+			auto *owner = new std::shared_ptr<const MappedMatrix>(mapped);
+			if (clSetMemObjectDestructorCallback(buffer, release_mapping, owner) != CL_SUCCESS)
+			{
+				delete owner;
+				clReleaseMemObject(buffer);
+				throw std::runtime_error("Failed to set buffer destructor callback");
+			}
+			DeviceMatrix matrix(queue(), buffer, height, width);
+			if (!wait_list.empty())
+			{
+				cl_event marker;
+				if (clEnqueueMarkerWithWaitList(queue(), static_cast<cl_uint>(wait_list.size()), wait_list.data(), &marker) != CL_SUCCESS)
+				{
+					throw std::runtime_error("Failed to enqueue marker");
+				}
+				matrix.set_event(marker);
+			}
+			return matrix;
+		}
+	}
+
+	DeviceMatrix matrix(buffer_pool, queue(), height, width);
+	std::vector<cl_event> events = wait_list;
+	if (matrix.event())
+	{
+		events.push_back(matrix.event());
+	}
+	size_t chunk = std::max<size_t>(chunk_bytes, sizeof(float));
+	cl_event last_write = nullptr;
+	for (size_t offset = 0; offset < bytes; offset += chunk)
+	{
+		cl_event write_event;
+		cl_int err = clEnqueueWriteBuffer(queue(), matrix.buffer(), CL_FALSE, offset, std::min(chunk, bytes - offset),
+										  reinterpret_cast<const char *>(data) + offset, static_cast<cl_uint>(events.size()),
+										  events.empty() ? NULL : events.data(), &write_event);
+		if (err != CL_SUCCESS)
+		{
+			// Earlier chunks may still be reading the mapping
+			clFinish(queue());
+			if (last_write)
+			{
+				clReleaseEvent(last_write);
+			}
+			throw std::runtime_error("Failed to write device buffer");
+		}
+		record_event("write", write_event);
+		if (last_write)
+		{
+			clReleaseEvent(last_write);
+		}
+		last_write = write_event;
+		events.clear(); // The in-order queue runs later chunks after the first
+	}
+
+	auto *owner = new std::shared_ptr<const MappedMatrix>(mapped);
+	if (clSetEventCallback(last_write, CL_COMPLETE, release_mapping_after, owner) != CL_SUCCESS)
+	{
+		clWaitForEvents(1, &last_write);
+		delete owner;
+	}
+	matrix.set_event(last_write);
+	return matrix;
+}
+
+DeviceMatrix OperationManager::load_bmat(const std::string &path)
+{
+	return from_mapped(std::make_shared<const MappedMatrix>(MappedMatrix::open_bmat(path)));
+}
+
+void OperationManager::enqueue_kernel(cl_kernel kernel, cl_uint work_dim, const size_t *global_work_size, const size_t *local_work_size,
+									  const std::vector<cl_event> &wait_list, const std::vector<const DeviceMatrix *> &inputs,
+									  DeviceMatrix &result)
+{
+	std::vector<cl_event> events = wait_list;
+	for (const DeviceMatrix *input : inputs)
+	{
+		if (input->event())
+			events.push_back(input->event());
+	}
+	// A recycled result buffer may still be in use by earlier commands
+	if (result.event())
+		events.push_back(result.event());
+	// An existing result (gemm, transpose_in_place) may still be read by kernels on other lanes
+	std::vector<cl_event> readers = result.pending_readers();
+	events.insert(events.end(), readers.begin(), readers.end());
+
+	cl_event kernel_event;
+	cl_int err = clEnqueueNDRangeKernel(queue(), kernel, work_dim, NULL, global_work_size, local_work_size,
+										static_cast<cl_uint>(events.size()), events.empty() ? NULL : events.data(), &kernel_event);
+	for (cl_event reader : readers)
+		clReleaseEvent(reader);
+	if (err != CL_SUCCESS)
+	{
+		throw std::runtime_error("Failed to execute kernel");
+	}
+	// Inputs made on other lanes must not be recycled before this kernel has read them
+	for (const DeviceMatrix *input : inputs)
+	{
+		if (input->command_queue() != queue())
+			input->add_reader(kernel_event);
+	}
+	result.set_event(kernel_event);
+	record_event("kernel", kernel_event);
+}
+
+OpFuture OperationManager::multi_vector_op_async(operation_types op_type, const float *lhs, int lheight, int lwidth, const float *rhs, int rheight, int rwidth,
+												 const std::vector<cl_event> &wait_list)
+{
+	if (native)
+	{
+		// Runs synchronously, the future is ready on return
+		return OpFuture(nullptr, native->multi_vector_op(op_type, lhs, lheight, lwidth, rhs, rheight, rwidth));
+	}
+	OpScope scope(*this, op_type, lheight, lwidth, rheight, rwidth);
+	DeviceMatrix lhs_matrix = host_input(lhs, lheight, lwidth, false, wait_list);
+	DeviceMatrix rhs_matrix = host_input(rhs, rheight, rwidth, false, wait_list);
+	DeviceMatrix result = multi_vector_op(op_type, lhs_matrix, rhs_matrix);
+	// Released buffers stay alive until the queued commands using them finish
+	return read_result_async(result);
+}
+
+OpFuture OperationManager::single_vector_op_async(operation_types op_type, const float *data, int height, int width,
+												  const std::vector<cl_event> &wait_list)
+{
+	if (native)
+	{
+		return OpFuture(nullptr, native->single_vector_op(op_type, data, height, width));
+	}
+	OpScope scope(*this, op_type, height, width);
+	DeviceMatrix input = host_input(data, height, width, false, wait_list);
+	DeviceMatrix result = single_vector_op(op_type, input);
+	return read_result_async(result);
+}
+
+float *OperationManager::multi_vector_op(operation_types op_type, float *lhs, int lheight, int lwidth, float *rhs, int rheight, int rwidth)
+{
+	if (native)
+	{
+		return native->multi_vector_op(op_type, lhs, lheight, lwidth, rhs, rheight, rwidth);
+	}
+	if (op_type == operation_types::MATRIX_MULTIPLICATION && needs_streaming(lheight, lwidth, rwidth))
+	{
+		float *result = static_cast<float *>(malloc(static_cast<size_t>(lheight) * rwidth * sizeof(float)));
+		if (!result)
+		{
+			throw std::bad_alloc();
+		}
+		try
+		{
+			streaming_gemm(lhs, lheight, lwidth, rhs, rheight, rwidth, result);
+		}
+		catch (...)
+		{
+			free(result);
+			throw;
+		}
+		return result;
+	}
+	OpScope scope(*this, op_type, lheight, lwidth, rheight, rwidth);
+	DeviceMatrix lhs_matrix = host_input(lhs, lheight, lwidth);
+	DeviceMatrix rhs_matrix = host_input(rhs, rheight, rwidth);
+	DeviceMatrix result = multi_vector_op(op_type, lhs_matrix, rhs_matrix);
+	return read_result(result);
+}
+
+float *OperationManager::single_vector_op(operation_types op_type, float *data, int height, int width)
+{
+	if (native)
+	{
+		return native->single_vector_op(op_type, data, height, width);
+	}
+	OpScope scope(*this, op_type, height, width);
+	DeviceMatrix input = host_input(data, height, width);
+	DeviceMatrix result = single_vector_op(op_type, input);
+	return read_result(result);
+}
+
+void OperationManager::multi_vector_op(operation_types op_type, const float *lhs, int lheight, int lwidth, const float *rhs, int rheight,
+									   int rwidth, float *out)
+{
+	if (native)
+	{
+		native->multi_vector_op(op_type, lhs, lheight, lwidth, rhs, rheight, rwidth, out);
+		return;
+	}
+	if (op_type == operation_types::MATRIX_MULTIPLICATION && needs_streaming(lheight, lwidth, rwidth))
+	{
+		streaming_gemm(lhs, lheight, lwidth, rhs, rheight, rwidth, out);
+		return;
+	}
+	OpScope scope(*this, op_type, lheight, lwidth, rheight, rwidth);
+	DeviceMatrix lhs_matrix = host_input(lhs, lheight, lwidth);
+	DeviceMatrix rhs_matrix = host_input(rhs, rheight, rwidth);
+	DeviceMatrix result = multi_vector_op(op_type, lhs_matrix, rhs_matrix);
+	read_result(result, out);
+}
+
+void OperationManager::single_vector_op(operation_types op_type, const float *data, int height, int width, float *out)
+{
+	if (native)
+	{
+		native->single_vector_op(op_type, data, height, width, out);
+		return;
+	}
+	OpScope scope(*this, op_type, height, width);
+	DeviceMatrix input = host_input(data, height, width);
+	DeviceMatrix result = single_vector_op(op_type, input);
+	read_result(result, out);
+}
+
+DeviceMatrix OperationManager::multi_vector_op(operation_types op_type, const DeviceMatrix &lhs, const DeviceMatrix &rhs,
+											   const std::vector<cl_event> &wait_list)
+{
+	require_opencl();
+	cl_int err;
+	int lheight = lhs.height();
+	int lwidth = lhs.width();
+	int rheight = rhs.height();
+	int rwidth = rhs.width();
+	OpScope scope(*this, op_type, lheight, lwidth, rheight, rwidth);
+
+	int result_height;
+	int result_width;
+	switch (op_type)
+	{
+	case operation_types::ELEM_WISE_ADD:
+	case operation_types::ELEM_WISE_SUB:
+	case operation_types::ELEM_WISE_MUL:
+	case operation_types::ELEM_WISE_DIV:
+	{
+		// rhs is broadcast across lhs by repeating its rows/columns
+		if (lheight % rheight != 0 || lwidth % rwidth != 0)
+		{
+			throw std::invalid_argument("Operand shapes cannot be broadcast together");
+		}
+		result_height = lheight;
+		result_width = lwidth;
+		break;
+	}
+	case operation_types::MATRIX_MULTIPLICATION:
+	{
+		if (lwidth != rheight)
+		{
+			throw std::invalid_argument("Inner matrix dimensions must agree");
+		}
+		DeviceMatrix result(buffer_pool, queue(), lheight, rwidth);
+		enqueue_gemm(lhs, rhs, result, DeviceGemmEpilogue(), 1.0f, 0.0f, wait_list);
+		return result;
+	}
+	default:
+		throw std::runtime_error("Incorrect Operation Type");
+	}
+
+	// Reference kernels use one work-item per output with a driver-chosen local size
+	size_t global_work_size[2] = {static_cast<size_t>(result_height), static_cast<size_t>(result_width)};
+	size_t local_work_size[2];
+	const size_t *local_size = NULL;
+
+	// Specialized for how rhs broadcasts, and for the exact sizes once the shape is hot
+	std::string options;
+	if (use_optimized_kernel(op_type, true))
+	{
+		KernelManager::Broadcast broadcast = KernelManager::broadcastKind(lheight, lwidth, rheight, rwidth);
+		bool fixed_shape = hot_shape(lheight, lwidth, rheight, rwidth);
+		options = KernelManager::elementwiseOptions(broadcast, fixed_shape, lheight, lwidth, rheight, rwidth);
+		// Both operands are contiguous and line up element for element
+		if (broadcast == KernelManager::Broadcast::NONE)
+		{
+			return enqueue_flat_elementwise(op_type, lhs, rhs, options + " " + elementwise_launch.build_options(), wait_list);
+		}
+	}
+	cl_kernel kernel = get_kernel(op_type, options);
+	// Tuned work-group shape, the elementwise kernels skip work-items past the edges
+	if (elementwise_launch.rows > 0 && kernel_work_group_size(kernel) >= elementwise_launch.rows * elementwise_launch.cols)
+	{
+		local_work_size[0] = elementwise_launch.rows;
+		local_work_size[1] = elementwise_launch.cols;
+		global_work_size[0] = (global_work_size[0] + local_work_size[0] - 1) / local_work_size[0] * local_work_size[0];
+		global_work_size[1] = (global_work_size[1] + local_work_size[1] - 1) / local_work_size[1] * local_work_size[1];
+		local_size = local_work_size;
+	}
+	DeviceMatrix result(buffer_pool, queue(), result_height, result_width);
+
+	cl_mem lhs_buffer = lhs.buffer();
+	cl_mem rhs_buffer = rhs.buffer();
+	cl_mem result_buffer = result.buffer();
+
+	// Set kernel arguments
+	err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &lhs_buffer);
+	err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &rhs_buffer);
+	err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &result_buffer);
+	err |= clSetKernelArg(kernel, 3, sizeof(int), &lheight);
+	err |= clSetKernelArg(kernel, 4, sizeof(int), &lwidth);
+	err |= clSetKernelArg(kernel, 5, sizeof(int), &rheight);
+	err |= clSetKernelArg(kernel, 6, sizeof(int), &rwidth);
+
+	if (err != CL_SUCCESS)
+	{
+		throw std::runtime_error("Failed to set kernel arguments");
+	}
+
+	// Execute kernel
+	enqueue_kernel(kernel, 2, global_work_size, local_size, wait_list, {&lhs, &rhs}, result);
+
+	return result;
+}
+
+DeviceMatrix OperationManager::enqueue_flat_elementwise(operation_types op_type, const DeviceMatrix &lhs, const DeviceMatrix &rhs,
+														const std::string &build_options, const std::vector<cl_event> &wait_list)
+{
+	cl_kernel kernel = get_kernel(op_type, build_options, "blitz_kernel_flat");
+	int count = static_cast<int>(lhs.size());
+	size_t vectors = static_cast<size_t>(count / elementwise_launch.vector_width);
+	size_t items = vectors + (count % elementwise_launch.vector_width ? 1 : 0);
+
+	// Rounded up to whole work-groups, the kernel skips work-items past the tail
+	size_t local_work_size = std::min<size_t>({256, kernel_work_group_size(kernel), max_work_item_sizes[0]});
+	local_work_size = std::max<size_t>(local_work_size, 1);
+	size_t global_work_size = std::max<size_t>((items + local_work_size - 1) / local_work_size, 1) * local_work_size;
+
+	DeviceMatrix result(buffer_pool, queue(), lhs.height(), lhs.width());
+	cl_mem lhs_buffer = lhs.buffer();
+	cl_mem rhs_buffer = rhs.buffer();
+	cl_mem result_buffer = result.buffer();
+	cl_int err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &lhs_buffer);
+	err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &rhs_buffer);
+	err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &result_buffer);
+	err |= clSetKernelArg(kernel, 3, sizeof(int), &count);
+	if (err != CL_SUCCESS)
+	{
+		throw std::runtime_error("Failed to set kernel arguments");
+	}
+
+	enqueue_kernel(kernel, 1, &global_work_size, &local_work_size, wait_list, {&lhs, &rhs}, result);
+	return result;
+}
+
+void OperationManager::gemm(float alpha, const DeviceMatrix &lhs, const DeviceMatrix &rhs, float beta, DeviceMatrix &result,
+							const DeviceGemmEpilogue &epilogue, const std::vector<cl_event> &wait_list)
+{
+	require_opencl();
+	int lheight = lhs.height();
+	int lwidth = lhs.width();
+	int rwidth = rhs.width();
+	OpScope scope(*this, "gemm", lheight, lwidth, rhs.height(), rwidth,
+				  operation_flops(operation_types::MATRIX_MULTIPLICATION, lheight, lwidth, rwidth),
+				  operation_bytes(operation_types::MATRIX_MULTIPLICATION, lheight, lwidth, rhs.height(), rwidth));
+
+	if (lwidth != rhs.height())
+	{
+		throw std::invalid_argument("Inner matrix dimensions must agree");
+	}
+	if (result.height() != lheight || result.width() != rwidth)
+	{
+		throw std::invalid_argument("GEMM result must be lheight x rwidth");
+	}
+	if (result.buffer() == lhs.buffer() || result.buffer() == rhs.buffer())
+	{
+		throw std::invalid_argument("GEMM result must not alias its inputs");
+	}
+	cl_mem_flags result_flags = 0;
+	clGetMemObjectInfo(result.buffer(), CL_MEM_FLAGS, sizeof(result_flags), &result_flags, NULL);
+	if (result_flags & CL_MEM_READ_ONLY)
+	{
+		throw std::invalid_argument("GEMM result is read-only (e.g. from from_mapped())");
+	}
+	if ((epilogue.row_bias && (epilogue.row_bias->height() != 1 || epilogue.row_bias->width() != rwidth)) ||
+		(epilogue.column_bias && (epilogue.column_bias->height() != lheight || epilogue.column_bias->width() != 1)) ||
+		(epilogue.scale && (epilogue.scale->height() != lheight || epilogue.scale->width() != rwidth)))
+	{
+		throw std::invalid_argument("GEMM epilogue operand shapes do not match the result");
+	}
+	if (epilogue.clamp && epilogue.clamp_min > epilogue.clamp_max)
+	{
+		throw std::invalid_argument("GEMM clamp_min must not exceed clamp_max");
+	}
+
+	enqueue_gemm(lhs, rhs, result, epilogue, alpha, beta, wait_list);
+}
+
+DeviceMatrix OperationManager::gemm(const DeviceMatrix &lhs, const DeviceMatrix &rhs, const DeviceGemmEpilogue &epilogue, float alpha,
+									const std::vector<cl_event> &wait_list)
+{
+	OpScope scope(*this, "gemm", lhs.height(), lhs.width(), rhs.height(), rhs.width(),
+				  operation_flops(operation_types::MATRIX_MULTIPLICATION, lhs.height(), lhs.width(), rhs.width()),
+				  operation_bytes(operation_types::MATRIX_MULTIPLICATION, lhs.height(), lhs.width(), rhs.height(), rhs.width()));
+	DeviceMatrix result(buffer_pool, queue(), lhs.height(), rhs.width());
+	gemm(alpha, lhs, rhs, 0.0f, result, epilogue, wait_list);
+	return result;
+}
+
+void OperationManager::gemm(float alpha, const float *lhs, int lheight, int lwidth, const float *rhs, int rheight, int rwidth, float beta,
+							float *result, const HostGemmEpilogue &epilogue)
+{
+	if (native)
+	{
+		native->gemm(alpha, lhs, lheight, lwidth, rhs, rheight, rwidth, beta, result, epilogue);
+		return;
+	}
+	OpScope scope(*this, "gemm", lheight, lwidth, rheight, rwidth,
+				  operation_flops(operation_types::MATRIX_MULTIPLICATION, lheight, lwidth, rwidth),
+				  operation_bytes(operation_types::MATRIX_MULTIPLICATION, lheight, lwidth, rheight, rwidth));
+	DeviceMatrix lhs_matrix = host_input(lhs, lheight, lwidth);
+	DeviceMatrix rhs_matrix = host_input(rhs, rheight, rwidth);
+	// result is only uploaded when beta makes the kernel read it
+	DeviceMatrix result_matrix = beta != 0.0f ? from_host(result, lheight, rwidth) : DeviceMatrix(buffer_pool, queue(), lheight, rwidth);
+
+	std::vector<DeviceMatrix> operands;
+	operands.reserve(3);
+	DeviceGemmEpilogue device_epilogue;
+	device_epilogue.clamp = epilogue.clamp;
+	device_epilogue.clamp_min = epilogue.clamp_min;
+	device_epilogue.clamp_max = epilogue.clamp_max;
+	if (epilogue.row_bias)
+	{
+		operands.push_back(host_input(epilogue.row_bias, 1, rwidth));
+		device_epilogue.row_bias = &operands.back();
+	}
+	if (epilogue.column_bias)
+	{
+		operands.push_back(host_input(epilogue.column_bias, lheight, 1));
+		device_epilogue.column_bias = &operands.back();
+	}
+	if (epilogue.scale)
+	{
+		operands.push_back(host_input(epilogue.scale, lheight, rwidth));
+		device_epilogue.scale = &operands.back();
+	}
+
+	gemm(alpha, lhs_matrix, rhs_matrix, beta, result_matrix, device_epilogue);
+	read_result(result_matrix, result);
+}
+
+int OperationManager::streaming_panel(size_t device_budget) const
+{
+	// Two steps are in flight at once, each holding an lhs, rhs and result panel
+	size_t budget = device_budget ? device_budget : static_cast<size_t>(global_memory_size / 2);
+	size_t panel_floats = budget / (6 * sizeof(float));
+	if (max_alloc_size)
+	{
+		panel_floats = std::min<size_t>(panel_floats, static_cast<size_t>(max_alloc_size / sizeof(float)));
+	}
+	int panel = static_cast<int>(std::min<double>(std::sqrt(static_cast<double>(panel_floats)), std::numeric_limits<int>::max()));
+	// Whole tiles of the tiled kernel, once panels are large enough to use it
+	int tile = std::max(gemm_tiling.tsm, gemm_tiling.tsn);
+	if (panel >= 2 * tile)
+	{
+		panel = panel / tile * tile;
+	}
+	return std::max(panel, 1);
+}
+
+bool OperationManager::needs_streaming(int lheight, int lwidth, int rwidth) const
+{
+	size_t largest = std::max({static_cast<size_t>(lheight) * lwidth, static_cast<size_t>(lwidth) * rwidth,
+							   static_cast<size_t>(lheight) * rwidth}) *
+					 sizeof(float);
+	return max_alloc_size && largest > max_alloc_size;
+}
+
+void OperationManager::upload_block(cl_command_queue transfer, const float *host, int host_width, int row, int col, DeviceMatrix &panel)
+{
+	size_t buffer_origin[3] = {0, 0, 0};
+	size_t host_origin[3] = {static_cast<size_t>(col) * sizeof(float), static_cast<size_t>(row), 0};
+	size_t region[3] = {static_cast<size_t>(panel.width()) * sizeof(float), static_cast<size_t>(panel.height()), 1};
+	// A recycled panel may still be read by an earlier kernel
+	cl_event previous = panel.event();
+	cl_event written;
+	if (clEnqueueWriteBufferRect(transfer, panel.buffer(), CL_FALSE, buffer_origin, host_origin, region, region[0], 0,
+								 static_cast<size_t>(host_width) * sizeof(float), 0, host, previous ? 1 : 0,
+								 previous ? &previous : NULL, &written) != CL_SUCCESS)
+	{
+		throw std::runtime_error("Failed to write panel to device");
+	}
+	panel.set_event(written);
+	record_event("write", written);
+}
+
+void OperationManager::download_block(cl_command_queue transfer, DeviceMatrix &panel, float *host, int host_width, int row, int col)
+{
+	size_t buffer_origin[3] = {0, 0, 0};
+	size_t host_origin[3] = {static_cast<size_t>(col) * sizeof(float), static_cast<size_t>(row), 0};
+	size_t region[3] = {static_cast<size_t>(panel.width()) * sizeof(float), static_cast<size_t>(panel.height()), 1};
+	cl_event computed = panel.event();
+	cl_event read;
+	if (clEnqueueReadBufferRect(transfer, panel.buffer(), CL_FALSE, buffer_origin, host_origin, region, region[0], 0,
+								static_cast<size_t>(host_width) * sizeof(float), 0, host, computed ? 1 : 0,
+								computed ? &computed : NULL, &read) != CL_SUCCESS)
+	{
+		throw std::runtime_error("Failed to read panel from device");
+	}
+	// Recycling the panel now waits for the read instead
+	panel.set_event(read);
+	record_event("read", read);
+}
+
+void OperationManager::streaming_gemm(const float *lhs, int lheight, int lwidth, const float *rhs, int rheight, int rwidth,
+									  float *result, size_t device_budget)
+{
+	if (native)
+	{
+		// Host memory already, mapped files page in as the blocked GEMM walks them
+		native->gemm(1.0f, lhs, lheight, lwidth, rhs, rheight, rwidth, 0.0f, result);
+		return;
+	}
+	if (lwidth != rheight)
+	{
+		throw std::invalid_argument("Inner matrix dimensions must agree");
+	}
+	if (lheight <= 0 || lwidth <= 0 || rwidth <= 0)
+	{
+		throw std::invalid_argument("Matrix dimensions must be positive");
+	}
+	OpScope scope(*this, "streaming_gemm", lheight, lwidth, rheight, rwidth,
+				  operation_flops(operation_types::MATRIX_MULTIPLICATION, lheight, lwidth, rwidth),
+				  operation_bytes(operation_types::MATRIX_MULTIPLICATION, lheight, lwidth, rheight, rwidth));
+
+	int panel = streaming_panel(device_budget);
+	int row_panel = std::min(panel, lheight);
+	int col_panel = std::min(panel, rwidth);
+	int depth_panel = std::min(panel, lwidth);
+
+	// Transfers get their own in-order queue so they overlap the kernels on this lane's queue
+	cl_int err;
+	cl_command_queue transfer = clCreateCommandQueue(context, device, queue_properties, &err);
+	if (err != CL_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create command queue");
+	}
+
+	// Panels of the previous step stay alive until the next step's uploads are queued,
+	// so the pool hands those uploads the buffers of the step before instead
+	std::unique_ptr<DeviceMatrix> held_lhs, held_rhs, held_block;
+	std::vector<cl_event> in_flight; // Kernel events, the host stays at most two steps ahead of them
+	auto drain = [&]()
+	{
+		clFinish(queue());
+		clFinish(transfer);
+		for (cl_event event : in_flight)
+			clReleaseEvent(event);
+		in_flight.clear();
+	};
+
+	try
+	{
+		for (int row = 0; row < lheight; row += row_panel)
+		{
+			int rows = std::min(row_panel, lheight - row);
+			for (int col = 0; col < rwidth; col += col_panel)
+			{
+				int cols = std::min(col_panel, rwidth - col);
+				std::unique_ptr<DeviceMatrix> block(new DeviceMatrix(buffer_pool, queue(), rows, cols));
+				for (int inner = 0; inner < lwidth; inner += depth_panel)
+				{
+					int depth = std::min(depth_panel, lwidth - inner);
+					if (in_flight.size() >= 2)
+					{
+						clWaitForEvents(1, &in_flight.front());
+						clReleaseEvent(in_flight.front());
+						in_flight.erase(in_flight.begin());
+					}
+
+					std::unique_ptr<DeviceMatrix> lhs_panel(new DeviceMatrix(buffer_pool, queue(), rows, depth));
+					std::unique_ptr<DeviceMatrix> rhs_panel(new DeviceMatrix(buffer_pool, queue(), depth, cols));
+					upload_block(transfer, lhs, lwidth, row, inner, *lhs_panel);
+					upload_block(transfer, rhs, rwidth, inner, col, *rhs_panel);
+					// The first panel pair overwrites the block, later ones accumulate into it
+					enqueue_gemm(*lhs_panel, *rhs_panel, *block, DeviceGemmEpilogue(), 1.0f, inner == 0 ? 0.0f : 1.0f, {});
+					clRetainEvent(block->event());
+					in_flight.push_back(block->event());
+					// Submit now, the transfer queue is already waiting on this kernel
+					clFlush(queue());
+					clFlush(transfer);
+
+					held_lhs = std::move(lhs_panel);
+					held_rhs = std::move(rhs_panel);
+				}
+				download_block(transfer, *block, result, rwidth, row, col);
+				held_block = std::move(block);
+			}
+		}
+	}
+	catch (...)
+	{
+		drain();
+		clReleaseCommandQueue(transfer);
+		throw;
+	}
+	// result and the host operands must outlive every queued transfer
+	drain();
+	clReleaseCommandQueue(transfer);
+}
+
+std::string OperationManager::gemm_epilogue_options(const DeviceGemmEpilogue &epilogue, float alpha, float beta)
+{
+	if (alpha == 1.0f && beta == 0.0f && !epilogue.row_bias && !epilogue.column_bias && !epilogue.scale && !epilogue.clamp)
+	{
+		return "";
+	}
+	std::string options = "-DGEMM_EPILOGUE";
+	if (beta != 0.0f)
+		options += " -DGEMM_BETA";
+	if (epilogue.row_bias)
+		options += " -DGEMM_ROW_BIAS";
+	if (epilogue.column_bias)
+		options += " -DGEMM_COLUMN_BIAS";
+	if (epilogue.scale)
+		options += " -DGEMM_SCALE";
+	if (epilogue.clamp)
+		options += " -DGEMM_CLAMP";
+	return options;
+}
+
+void OperationManager::enqueue_gemm(const DeviceMatrix &lhs, const DeviceMatrix &rhs, DeviceMatrix &result,
+									const DeviceGemmEpilogue &epilogue, float alpha, float beta, const std::vector<cl_event> &wait_list)
+{
+	const operation_types op_type = operation_types::MATRIX_MULTIPLICATION;
+	int lheight = lhs.height();
+	int lwidth = lhs.width();
+	int rheight = rhs.height();
+	int rwidth = rhs.width();
+	// Each epilogue combination is its own specialization of the mat_mul.cl program
+	std::string epilogue_options = gemm_epilogue_options(epilogue, alpha, beta);
+
+	// Reference kernel uses one work-item per output with a driver-chosen local size
+	size_t global_work_size[2] = {static_cast<size_t>(lheight), static_cast<size_t>(rwidth)};
+	size_t local_work_size[2];
+	const size_t *local_size = NULL;
+
+	cl_kernel kernel = nullptr;
+	if (use_optimized_kernel(op_type, lheight >= gemm_tiling.tsm && rwidth >= gemm_tiling.tsn))
+	{
+		// One work-group per tsm x tsn block of the result, dimension 0 walks columns
+		std::string options = gemm_tiling.build_options();
+		if (!epilogue_options.empty())
+			options += " " + epilogue_options;
+		kernel = get_kernel(op_type, options, "blitz_kernel_tiled");
+		local_work_size[0] = static_cast<size_t>(gemm_tiling.tsn / gemm_tiling.wptn);
+		local_work_size[1] = static_cast<size_t>(gemm_tiling.tsm / gemm_tiling.wptm);
+		if (kernel_work_group_size(kernel) >= local_work_size[0] * local_work_size[1])
+		{
+			global_work_size[0] = static_cast<size_t>((rwidth + gemm_tiling.tsn - 1) / gemm_tiling.tsn) * local_work_size[0];
+			global_work_size[1] = static_cast<size_t>((lheight + gemm_tiling.tsm - 1) / gemm_tiling.tsm) * local_work_size[1];
+			local_size = local_work_size;
+		}
+		else
+		{
+			kernel = nullptr;
+		}
+	}
+	if (!kernel)
+	{
+		kernel = get_kernel(op_type, epilogue_options);
+	}
+
+	cl_mem lhs_buffer = lhs.buffer();
+	cl_mem rhs_buffer = rhs.buffer();
+	cl_mem result_buffer = result.buffer();
+
+	cl_int err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &lhs_buffer);
+	err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &rhs_buffer);
+	err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &result_buffer);
+	err |= clSetKernelArg(kernel, 3, sizeof(int), &lheight);
+	err |= clSetKernelArg(kernel, 4, sizeof(int), &lwidth);
+	err |= clSetKernelArg(kernel, 5, sizeof(int), &rheight);
+	err |= clSetKernelArg(kernel, 6, sizeof(int), &rwidth);
+
+	std::vector<const DeviceMatrix *> inputs = {&lhs, &rhs};
+	if (!epilogue_options.empty())
+	{
+		// Steps left out are compiled away, their operands bind as NULL
+		const DeviceMatrix *operands[3] = {epilogue.row_bias, epilogue.column_bias, epilogue.scale};
+		for (cl_uint i = 0; i < 3; i++)
+		{
+			cl_mem operand_buffer = operands[i] ? operands[i]->buffer() : NULL;
+			err |= clSetKernelArg(kernel, 9 + i, sizeof(cl_mem), &operand_buffer);
+			if (operands[i])
+				inputs.push_back(operands[i]);
+		}
+		err |= clSetKernelArg(kernel, 7, sizeof(float), &alpha);
+		err |= clSetKernelArg(kernel, 8, sizeof(float), &beta);
+		err |= clSetKernelArg(kernel, 12, sizeof(float), &epilogue.clamp_min);
+		err |= clSetKernelArg(kernel, 13, sizeof(float), &epilogue.clamp_max);
+	}
+
+	if (err != CL_SUCCESS)
+	{
+		throw std::runtime_error("Failed to set kernel arguments");
+	}
+
+	// result is in the wait list through its own event when beta reads it
+	enqueue_kernel(kernel, 2, global_work_size, local_size, wait_list, inputs, result);
+}
+
+DeviceMatrix OperationManager::single_vector_op(operation_types op_type, const DeviceMatrix &data,
+												const std::vector<cl_event> &wait_list)
+{
+	require_opencl();
+	cl_int err;
+	int height = data.height();
+	int width = data.width();
+	OpScope scope(*this, op_type, height, width);
+	if (op_type == operation_types::DETERMINANT || op_type == operation_types::INVERSE ||
+		op_type == operation_types::LU_DECOMPOSITION)
+	{
+		if (height != width)
+		{
+			throw std::invalid_argument("Operation requires square matrix");
+		}
+	}
+
+	if (op_type == operation_types::LU_DECOMPOSITION)
+	{
+		return std::move(lu_factor(data, wait_list).lu);
+	}
+	if (op_type == operation_types::INVERSE)
+	{
+		return lu_inverse(lu_factor(data, wait_list));
+	}
+	if (op_type == operation_types::DETERMINANT)
+	{
+		if (use_optimized_kernel(op_type, true))
+		{
+			return lu_determinant(lu_factor(data, wait_list), 1, {});
+		}
+		// The reference kernel factors in fixed 16 x 16 private arrays
+		if (height > 16)
+		{
+			throw std::invalid_argument("Reference determinant kernel supports at most 16x16 matrices");
+		}
+	}
+
+	if (op_type == operation_types::FROBENIUS_NORM || op_type == operation_types::TRACE)
+	{
+		size_t length = op_type == operation_types::TRACE ? static_cast<size_t>(std::min(height, width)) : data.size();
+		if (use_optimized_kernel(op_type, length > reduce_work_group))
+		{
+			std::string options = reduce_build_options();
+			cl_kernel partial_kernel = get_kernel(op_type, options, "blitz_kernel_partial");
+			cl_kernel finalize_kernel = get_kernel(op_type, options, "blitz_kernel_finalize");
+			if (kernel_work_group_size(partial_kernel) >= reduce_work_group &&
+				kernel_work_group_size(finalize_kernel) >= reduce_work_group)
+			{
+				return parallel_reduction(partial_kernel, finalize_kernel, data, length, wait_list);
+			}
+		}
+	}
 
-	clGetPlatformIDs(1, &platform, &num_platforms);
+	int result_height;
+	int result_width;
+	size_t global_work_size[2];
+	switch (op_type)
+	{
+	case operation_types::DETERMINANT:
+	case operation_types::FROBENIUS_NORM:
+	case operation_types::TRACE:
+	{
+		result_height = 1;
+		result_width = 1;
+		global_work_size[0] = 1;
+		global_work_size[1] = 1;
+	} break;
+	case operation_types::TRANSPOSE:
+	{
+		// The kernel indexes rows of the transposed matrix by global id 0
+		result_height = width;
+		result_width = height;
+		global_work_size[0] = static_cast<size_t>(width);
+		global_work_size[1] = static_cast<size_t>(height);
+	} break;
+	default:
+		throw std::runtime_error("Incorrect Operation Type");
+	}
+
+	size_t local_work_size[2];
+	const size_t *local_size = NULL;
 
-	switch (device_type)
+	// Fetch cached kernel (built on first use)
+	cl_kernel kernel = nullptr;
+	std::string options = program_options(op_type);
+	if (op_type == operation_types::TRANSPOSE &&
+		use_optimized_kernel(op_type, height >= transpose_tiling.tile && width >= transpose_tiling.tile))
 	{
-	case (device_types::CPU_DEVICE):
-		clGetDeviceIDs(platform, CL_DEVICE_TYPE_CPU, 1, &device, &num_devices);
+		// One work-group per tile of the input, dimension 0 walks input columns
+		kernel = get_kernel(op_type, options, "blitz_kernel_tiled");
+		local_work_size[0] = static_cast<size_t>(transpose_tiling.tile);
+		local_work_size[1] = static_cast<size_t>(transpose_tiling.rows);
+		if (kernel_work_group_size(kernel) >= local_work_size[0] * local_work_size[1])
+		{
+			global_work_size[0] = static_cast<size_t>((width + transpose_tiling.tile - 1) / transpose_tiling.tile) * local_work_size[0];
+			global_work_size[1] = static_cast<size_t>((height + transpose_tiling.tile - 1) / transpose_tiling.tile) * local_work_size[1];
+			local_size = local_work_size;
+		}
+		else
+		{
+			kernel = nullptr;
+		}
+	}
+	if (!kernel)
+	{
+		kernel = get_kernel(op_type, options);
+	}
+	DeviceMatrix result(buffer_pool, queue(), result_height, result_width);
+
+	cl_mem input_buffer = data.buffer();
+	cl_mem result_buffer = result.buffer();
 
-	case (device_types::GPU_DEVICE):
-		clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, &num_devices);
+	// Set kernel arguments
+	err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input_buffer);
+	err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &result_buffer);
+	err |= clSetKernelArg(kernel, 2, sizeof(int), &height);
+	err |= clSetKernelArg(kernel, 3, sizeof(int), &width);
+
+	if (err != CL_SUCCESS)
+	{
+		throw std::runtime_error("Failed to set kernel arguments");
 	}
 
-	// Step 2: Create Context and Command Queue
-	context = clCreateContext(NULL, 1, &device, NULL, NULL, NULL);
-	queue = clCreateCommandQueue(context, device, 0, NULL);
-}
+	// Execute kernel
+	enqueue_kernel(kernel, 2, global_work_size, local_size, wait_list, {&data}, result);
 
-OperationManager::~OperationManager()
-{
-	clReleaseCommandQueue(queue);
-	clReleaseContext(context);
+	return result;
 }
 
-float *OperationManager::multi_vector_op(operation_types op_type, float *lhs, int lheight, int lwidth, float *rhs, int rheight, int rwidth)
+void OperationManager::transpose_in_place(DeviceMatrix &matrix, const std::vector<cl_event> &wait_list)
 {
-	cl_int err;
-
-	// Create program
-	const char *kernel_source = *kernel_manager.getKernelSource(op_type);
-	cl_program program = clCreateProgramWithSource(context, 1, &kernel_source, NULL, &err);
-	if (err != CL_SUCCESS)
+	require_opencl();
+	int n = matrix.height();
+	if (n != matrix.width())
 	{
-		throw std::runtime_error("Failed to create program");
+		throw std::invalid_argument("Operation requires square matrix");
 	}
+	OpScope scope(*this, "transpose_in_place", n, n, 0, 0, 0.0, 2 * matrix.bytes());
 
-	// Build program
-	err = clBuildProgram(program, 1, &device, NULL, NULL, NULL);
-	if (err != CL_SUCCESS)
+	cl_kernel kernel = get_kernel(operation_types::TRANSPOSE, program_options(operation_types::TRANSPOSE), "blitz_kernel_inplace");
+	size_t local_work_size[2] = {static_cast<size_t>(transpose_tiling.tile), static_cast<size_t>(transpose_tiling.rows)};
+	if (kernel_work_group_size(kernel) < local_work_size[0] * local_work_size[1])
 	{
-		// Get build log for debugging
-		size_t log_size;
-		clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
-		std::vector<char> build_log(log_size);
-		clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_size, build_log.data(), NULL);
-		clReleaseProgram(program);
-		throw std::runtime_error("Failed to build program: " + std::string(build_log.data()));
+		throw std::runtime_error("Device work-group limit is below the transpose tile");
 	}
 
-	// Create kernel
-	cl_kernel kernel = clCreateKernel(program, "blitz_kernel", &err);
+	cl_mem buffer = matrix.buffer();
+	cl_int err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &buffer);
+	err |= clSetKernelArg(kernel, 1, sizeof(int), &n);
 	if (err != CL_SUCCESS)
 	{
-		clReleaseProgram(program);
-		throw std::runtime_error("Failed to create kernel");
+		throw std::runtime_error("Failed to set kernel arguments");
 	}
 
-	const size_t lhs_size = lheight * lwidth * sizeof(float);
-	const size_t rhs_size = rheight * rwidth * sizeof(float);
+	// Full grid of tiles, groups below the diagonal exit straight away
+	size_t tiles = static_cast<size_t>((n + transpose_tiling.tile - 1) / transpose_tiling.tile);
+	size_t global_work_size[2] = {tiles * local_work_size[0], tiles * local_work_size[1]};
+	enqueue_kernel(kernel, 2, global_work_size, local_work_size, wait_list, {}, matrix);
+}
 
-	float *matrix_result = nullptr;
-	cl_mem lhs_buffer = nullptr;
-	cl_mem rhs_buffer = nullptr;
-	cl_mem result_buffer = nullptr;
+float *OperationManager::batched_multi_vector_op(operation_types op_type, float *lhs, int batch, int lheight, int lwidth, float *rhs,
+												 int rheight, int rwidth)
+{
+	if (native)
+	{
+		return native->batched_multi_vector_op(op_type, lhs, batch, lheight, lwidth, rhs, rheight, rwidth);
+	}
+	OpScope scope(*this, op_type, lheight, lwidth, rheight, rwidth, batch);
+	DeviceMatrix lhs_matrix = host_input(lhs, batch * lheight, lwidth);
+	DeviceMatrix rhs_matrix = host_input(rhs, batch * rheight, rwidth);
+	DeviceMatrix result = batched_multi_vector_op(op_type, lhs_matrix, rhs_matrix, batch);
+	return read_result(result);
+}
 
-	// Create buffers
-	lhs_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-								lhs_size, lhs, &err);
-	rhs_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-								rhs_size, rhs, &err);
-	if (err != CL_SUCCESS)
+float *OperationManager::batched_single_vector_op(operation_types op_type, float *data, int batch, int height, int width)
+{
+	if (native)
 	{
-		throw std::runtime_error("Failed to create input buffer");
+		return native->batched_single_vector_op(op_type, data, batch, height, width);
 	}
+	OpScope scope(*this, op_type, height, width, 0, 0, batch);
+	DeviceMatrix input = host_input(data, batch * height, width);
+	DeviceMatrix result = batched_single_vector_op(op_type, input, batch);
+	return read_result(result);
+}
 
-	size_t result_size;
-	try
+DeviceMatrix OperationManager::batched_multi_vector_op(operation_types op_type, const DeviceMatrix &lhs, const DeviceMatrix &rhs, int batch,
+													   const std::vector<cl_event> &wait_list)
+{
+	require_opencl();
+	if (op_type != operation_types::MATRIX_MULTIPLICATION)
 	{
-		switch (op_type)
-		{
-		case operation_types::ELEM_WISE_ADD:
-		case operation_types::ELEM_WISE_SUB:
-		case operation_types::ELEM_WISE_MUL:
-		case operation_types::ELEM_WISE_DIV:
-		{
-			// Allocate host memory
-			result_size = lhs_size;
-			break;
-		}
-		case operation_types::MATRIX_MULTIPLICATION:
-		{
-			// Allocate host memory
-			result_size = lheight * rwidth * sizeof(float);
-			break;
-		}
-		default:
-			throw std::runtime_error("Incorrect Operation Type");
-		}
+		throw std::runtime_error("Incorrect Operation Type");
 	}
-	catch (...)
+	if (batch <= 0 || lhs.height() % batch != 0 || rhs.height() % batch != 0)
 	{
-		if (lhs_buffer)
-			clReleaseMemObject(lhs_buffer);
-		if (rhs_buffer)
-			clReleaseMemObject(rhs_buffer);
-		if (result_buffer)
-			clReleaseMemObject(result_buffer);
-		clReleaseKernel(kernel);
-		clReleaseProgram(program);
-		throw;
+		throw std::invalid_argument("Matrix heights must be a multiple of the batch size");
 	}
+	OpScope scope(*this, op_type, lhs.height() / batch, lhs.width(), rhs.height() / batch, rhs.width(), batch);
 
-	matrix_result = (float *)malloc(result_size);
-	result_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, result_size, NULL, &err);
-	if (!matrix_result)
+	int lheight = lhs.height() / batch;
+	int lwidth = lhs.width();
+	int rheight = rhs.height() / batch;
+	int rwidth = rhs.width();
+	if (lwidth != rheight)
 	{
-		throw std::bad_alloc();
+		throw std::invalid_argument("Inner matrix dimensions must agree");
 	}
-	if (err != CL_SUCCESS)
+	if (std::max({lheight, lwidth, rwidth}) > batch_max_size())
 	{
-		throw std::runtime_error("Failed to create result buffer");
+		throw std::invalid_argument("Batched operations support matrices up to 32x32");
 	}
 
-	// Set kernel arguments
-	err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &lhs_buffer);
-	err = clSetKernelArg(kernel, 1, sizeof(cl_mem), &rhs_buffer);
+	cl_kernel kernel = get_kernel(op_type, program_options(op_type), "blitz_batched_kernel");
+	DeviceMatrix result(buffer_pool, queue(), batch * lheight, rwidth);
+
+	cl_mem lhs_buffer = lhs.buffer();
+	cl_mem rhs_buffer = rhs.buffer();
+	cl_mem result_buffer = result.buffer();
+
+	cl_int err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &lhs_buffer);
+	err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &rhs_buffer);
 	err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &result_buffer);
 	err |= clSetKernelArg(kernel, 3, sizeof(int), &lheight);
 	err |= clSetKernelArg(kernel, 4, sizeof(int), &lwidth);
 	err |= clSetKernelArg(kernel, 5, sizeof(int), &rheight);
 	err |= clSetKernelArg(kernel, 6, sizeof(int), &rwidth);
-
 	if (err != CL_SUCCESS)
 	{
 		throw std::runtime_error("Failed to set kernel arguments");
 	}
 
-	// Execute kernel
-	size_t global_work_size[2] = {static_cast<size_t>(lheight), static_cast<size_t>(rwidth)};
-	err = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global_work_size, NULL, 0, NULL, NULL);
+	enqueue_batched(kernel, batch, std::max(lheight * lwidth, lheight * rwidth), wait_list, {&lhs, &rhs}, result);
+	return result;
+}
+
+DeviceMatrix OperationManager::batched_single_vector_op(operation_types op_type, const DeviceMatrix &data, int batch,
+														const std::vector<cl_event> &wait_list)
+{
+	require_opencl();
+	if (batch <= 0 || data.height() % batch != 0)
+	{
+		throw std::invalid_argument("Matrix height must be a multiple of the batch size");
+	}
+	int height = data.height() / batch;
+	int width = data.width();
+	OpScope scope(*this, op_type, height, width, 0, 0, batch);
+	if (std::max(height, width) > batch_max_size())
+	{
+		throw std::invalid_argument("Batched operations support matrices up to 32x32");
+	}
+
+	int result_height;
+	int result_width;
+	switch (op_type)
+	{
+	case operation_types::DETERMINANT:
+	case operation_types::INVERSE:
+	{
+		if (height != width)
+		{
+			throw std::invalid_argument("Operation requires square matrix");
+		}
+		result_height = op_type == operation_types::DETERMINANT ? 1 : height;
+		result_width = op_type == operation_types::DETERMINANT ? 1 : width;
+	} break;
+	case operation_types::TRANSPOSE:
+	{
+		result_height = width;
+		result_width = height;
+	} break;
+	default:
+		throw std::runtime_error("Incorrect Operation Type");
+	}
+
+	cl_kernel kernel = get_kernel(op_type, program_options(op_type), "blitz_batched_kernel");
+	DeviceMatrix result(buffer_pool, queue(), batch * result_height, result_width);
+
+	cl_mem input_buffer = data.buffer();
+	cl_mem result_buffer = result.buffer();
+
+	cl_int err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input_buffer);
+	err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &result_buffer);
+	err |= clSetKernelArg(kernel, 2, sizeof(int), &height);
+	err |= clSetKernelArg(kernel, 3, sizeof(int), &width);
 	if (err != CL_SUCCESS)
 	{
-		throw std::runtime_error("Failed to execute kernel");
+		throw std::runtime_error("Failed to set kernel arguments");
 	}
 
-	// Read results
-	err = clEnqueueReadBuffer(queue, result_buffer, CL_TRUE, 0, lheight * rwidth * sizeof(float), matrix_result, 0, NULL, NULL);
+	// Gauss-Jordan works on the n x 2n augmented matrix
+	int elements = op_type == operation_types::INVERSE ? 2 * height * width : height * width;
+	enqueue_batched(kernel, batch, elements, wait_list, {&data}, result);
+	return result;
+}
+
+void OperationManager::enqueue_batched(cl_kernel kernel, int batch, int elements, const std::vector<cl_event> &wait_list,
+									   const std::vector<const DeviceMatrix *> &inputs, DeviceMatrix &result)
+{
+	// Power of two from 32 (a SIMD width on most devices) up to 256 work-items
+	size_t work_group = 32;
+	size_t limit = std::min<size_t>(256, kernel_work_group_size(kernel));
+	while (work_group < static_cast<size_t>(elements) && work_group * 2 <= limit)
+	{
+		work_group *= 2;
+	}
+	work_group = std::min(work_group, limit);
+
+	size_t global_work_size = static_cast<size_t>(batch) * work_group;
+	enqueue_kernel(kernel, 1, &global_work_size, &work_group, wait_list, inputs, result);
+}
+
+DeviceMatrix OperationManager::evaluate(const Expression &expression, const std::vector<cl_event> &wait_list)
+{
+	require_opencl();
+	cl_int err = CL_SUCCESS;
+	int height = expression.height();
+	int width = expression.width();
+
+	Expression::FusedKernel fused = expression.fuse();
+	OpScope scope(*this, "evaluate", height, width, 0, 0, 0.0,
+					   (fused.matrices.size() + 1) * static_cast<size_t>(height) * width * sizeof(float));
+	cl_kernel kernel = get_fused_kernel(fused.source);
+	DeviceMatrix result(buffer_pool, queue(), height, width);
+
+	// Arguments in the order fuse() declared them: matrices, scalars, then the result
+	cl_uint arg = 0;
+	for (const DeviceMatrix *matrix : fused.matrices)
+	{
+		cl_mem buffer = matrix->buffer();
+		int matrix_height = matrix->height();
+		int matrix_width = matrix->width();
+		err |= clSetKernelArg(kernel, arg++, sizeof(cl_mem), &buffer);
+		err |= clSetKernelArg(kernel, arg++, sizeof(int), &matrix_height);
+		err |= clSetKernelArg(kernel, arg++, sizeof(int), &matrix_width);
+	}
+	for (float value : fused.scalars)
+	{
+		err |= clSetKernelArg(kernel, arg++, sizeof(float), &value);
+	}
+	cl_mem result_buffer = result.buffer();
+	err |= clSetKernelArg(kernel, arg++, sizeof(cl_mem), &result_buffer);
+	err |= clSetKernelArg(kernel, arg++, sizeof(int), &height);
+	err |= clSetKernelArg(kernel, arg++, sizeof(int), &width);
 	if (err != CL_SUCCESS)
 	{
-		throw std::runtime_error("Failed to read results");
+		throw std::runtime_error("Failed to set kernel arguments");
 	}
 
-	// Cleanup
-	clReleaseMemObject(lhs_buffer);
-	clReleaseMemObject(rhs_buffer);
-	clReleaseMemObject(result_buffer);
-	clReleaseKernel(kernel);
-	clReleaseProgram(program);
+	size_t global_work_size[2] = {static_cast<size_t>(height), static_cast<size_t>(width)};
+	enqueue_kernel(kernel, 2, global_work_size, NULL, wait_list, fused.matrices, result);
+	return result;
+}
+
+DeviceMatrix OperationManager::parallel_reduction(cl_kernel partial_kernel, cl_kernel finalize_kernel, const DeviceMatrix &data,
+												  size_t length, const std::vector<cl_event> &wait_list)
+{
+	cl_int err;
+	int height = data.height();
+	int width = data.width();
+
+	// Enough work-groups to fill the device, each reducing a grid-strided slice
+	size_t groups = (length + reduce_work_group - 1) / reduce_work_group;
+	groups = std::max<size_t>(1, std::min<size_t>(groups, static_cast<size_t>(compute_units) * 4));
+	int partial_count = static_cast<int>(groups);
+
+	DeviceMatrix partials(buffer_pool, queue(), 1, partial_count);
+	DeviceMatrix result(buffer_pool, queue(), 1, 1);
+
+	cl_mem input_buffer = data.buffer();
+	cl_mem partials_buffer = partials.buffer();
+	cl_mem result_buffer = result.buffer();
+
+	err = clSetKernelArg(partial_kernel, 0, sizeof(cl_mem), &input_buffer);
+	err |= clSetKernelArg(partial_kernel, 1, sizeof(cl_mem), &partials_buffer);
+	err |= clSetKernelArg(partial_kernel, 2, sizeof(int), &height);
+	err |= clSetKernelArg(partial_kernel, 3, sizeof(int), &width);
+	err |= clSetKernelArg(finalize_kernel, 0, sizeof(cl_mem), &partials_buffer);
+	err |= clSetKernelArg(finalize_kernel, 1, sizeof(cl_mem), &result_buffer);
+	err |= clSetKernelArg(finalize_kernel, 2, sizeof(int), &partial_count);
+	if (err != CL_SUCCESS)
+	{
+		throw std::runtime_error("Failed to set kernel arguments");
+	}
 
-	return matrix_result;
+	size_t local_work_size = reduce_work_group;
+	size_t partial_global_size = groups * reduce_work_group;
+	enqueue_kernel(partial_kernel, 1, &partial_global_size, &local_work_size, wait_list, {&data}, partials);
+	enqueue_kernel(finalize_kernel, 1, &local_work_size, &local_work_size, {}, {&partials}, result);
+	return result;
 }
 
-float *OperationManager::single_vector_op(operation_types op_type, float *data, int height, int width)
+OperationManager::LUFactors OperationManager::lu_factor(const DeviceMatrix &data, const std::vector<cl_event> &wait_list)
 {
+	require_opencl();
 	cl_int err;
-	if (op_type == operation_types::DETERMINANT || op_type == operation_types::INVERSE)
+	int n = data.height();
+	if (n != data.width())
 	{
-		if (height != width)
-		{
-			throw std::invalid_argument("Operation requires square matrix");
-		}
+		throw std::invalid_argument("Operation requires square matrix");
 	}
-	// Create program
-	const char *kernel_source = *kernel_manager.getKernelSource(op_type);
-	cl_program program = clCreateProgramWithSource(context, 1, &kernel_source, NULL, &err);
+	OpScope scope(*this, operation_types::LU_DECOMPOSITION, n, n);
+
+	LUFactors factors{DeviceMatrix(buffer_pool, queue(), n, n), DeviceMatrix(buffer_pool, queue(), 1, n)};
+	cl_mem lu_buffer = factors.lu.buffer();
+	cl_mem pivots_buffer = factors.pivots.buffer();
+
+	// Factor a copy in place so the input stays usable
+	std::vector<cl_event> copy_wait_list = wait_list;
+	if (data.event())
+		copy_wait_list.push_back(data.event());
+	if (factors.lu.event())
+		copy_wait_list.push_back(factors.lu.event());
+	cl_event copy_event;
+	err = clEnqueueCopyBuffer(queue(), data.buffer(), lu_buffer, 0, 0, data.bytes(), static_cast<cl_uint>(copy_wait_list.size()),
+							  copy_wait_list.empty() ? NULL : copy_wait_list.data(), &copy_event);
 	if (err != CL_SUCCESS)
 	{
-		throw std::runtime_error("Failed to create program");
+		throw std::runtime_error("Failed to copy matrix");
 	}
+	if (data.command_queue() != queue())
+		data.add_reader(copy_event);
+	factors.lu.set_event(copy_event);
+	record_event("kernel", copy_event);
+
+	std::string options = lu_blocking.build_options(reduce_work_group);
+	cl_kernel pivot_kernel = get_kernel(operation_types::LU_DECOMPOSITION, options, "blitz_lu_pivot");
+	cl_kernel panel_kernel = get_kernel(operation_types::LU_DECOMPOSITION, options, "blitz_lu_panel");
+	cl_kernel trsm_kernel = get_kernel(operation_types::LU_DECOMPOSITION, options, "blitz_lu_trsm");
+	cl_kernel update_kernel = get_kernel(operation_types::LU_DECOMPOSITION, options, "blitz_lu_update");
 
-	// Build program
-	err = clBuildProgram(program, 1, &device, NULL, NULL, NULL);
+	err = clSetKernelArg(pivot_kernel, 0, sizeof(cl_mem), &lu_buffer);
+	err |= clSetKernelArg(pivot_kernel, 1, sizeof(cl_mem), &pivots_buffer);
+	err |= clSetKernelArg(pivot_kernel, 2, sizeof(int), &n);
+	err |= clSetKernelArg(panel_kernel, 0, sizeof(cl_mem), &lu_buffer);
+	err |= clSetKernelArg(panel_kernel, 1, sizeof(int), &n);
+	err |= clSetKernelArg(trsm_kernel, 0, sizeof(cl_mem), &lu_buffer);
+	err |= clSetKernelArg(trsm_kernel, 1, sizeof(int), &n);
+	err |= clSetKernelArg(update_kernel, 0, sizeof(cl_mem), &lu_buffer);
+	err |= clSetKernelArg(update_kernel, 1, sizeof(int), &n);
 	if (err != CL_SUCCESS)
 	{
-		// Get build log for debugging
-		size_t log_size;
-		clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
-		std::vector<char> build_log(log_size);
-		clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_size, build_log.data(), NULL);
-		clReleaseProgram(program);
-		throw std::runtime_error("Failed to build program: " + std::string(build_log.data()));
+		throw std::runtime_error("Failed to set kernel arguments");
+	}
+
+	size_t pivot_work_size = reduce_work_group;
+	size_t tile_work_size[2] = {lu_blocking.tile, lu_blocking.tile};
+	for (int panel_start = 0; panel_start < n; panel_start += lu_blocking.panel)
+	{
+		int panel_end = std::min(panel_start + lu_blocking.panel, n);
+
+		// Column by column: pick and swap the pivot row, then eliminate below it within the panel
+		for (int col = panel_start; col < panel_end; col++)
+		{
+			err = clSetKernelArg(pivot_kernel, 3, sizeof(int), &col);
+			err |= clSetKernelArg(panel_kernel, 2, sizeof(int), &col);
+			err |= clSetKernelArg(panel_kernel, 3, sizeof(int), &panel_end);
+			if (err != CL_SUCCESS)
+			{
+				throw std::runtime_error("Failed to set kernel arguments");
+			}
+			enqueue_kernel(pivot_kernel, 1, &pivot_work_size, &pivot_work_size, {}, {&factors.pivots}, factors.lu);
+			if (col + 1 < n)
+			{
+				size_t rows_below = static_cast<size_t>(n - col - 1);
+				enqueue_kernel(panel_kernel, 1, &rows_below, NULL, {}, {}, factors.lu);
+			}
+		}
+
+		// Rows of U right of the panel, then the panel's update of the trailing submatrix
+		if (panel_end < n)
+		{
+			err = clSetKernelArg(trsm_kernel, 2, sizeof(int), &panel_start);
+			err |= clSetKernelArg(trsm_kernel, 3, sizeof(int), &panel_end);
+			err |= clSetKernelArg(update_kernel, 2, sizeof(int), &panel_start);
+			err |= clSetKernelArg(update_kernel, 3, sizeof(int), &panel_end);
+			if (err != CL_SUCCESS)
+			{
+				throw std::runtime_error("Failed to set kernel arguments");
+			}
+			size_t trailing = static_cast<size_t>(n - panel_end);
+			size_t update_work_size[2] = {(trailing + lu_blocking.tile - 1) / lu_blocking.tile * lu_blocking.tile,
+										  (trailing + lu_blocking.tile - 1) / lu_blocking.tile * lu_blocking.tile};
+			enqueue_kernel(trsm_kernel, 1, &trailing, NULL, {}, {}, factors.lu);
+			enqueue_kernel(update_kernel, 2, update_work_size, tile_work_size, {}, {}, factors.lu);
+		}
 	}
 
-	// Create kernel
-	cl_kernel kernel = clCreateKernel(program, "blitz_kernel", &err);
+	// The last pivot write is ordered before the final factorization step
+	clRetainEvent(factors.lu.event());
+	factors.pivots.set_event(factors.lu.event());
+	return factors;
+}
+
+DeviceMatrix OperationManager::lu_determinant(const LUFactors &factors, int det_only, const std::vector<cl_event> &wait_list)
+{
+	require_opencl();
+	cl_int err;
+	int n = factors.lu.height();
+	cl_kernel kernel = get_kernel(operation_types::LU_DECOMPOSITION, lu_blocking.build_options(reduce_work_group), "blitz_lu_logdet");
+	DeviceMatrix result(buffer_pool, queue(), 1, det_only ? 1 : 2);
+
+	cl_mem lu_buffer = factors.lu.buffer();
+	cl_mem pivots_buffer = factors.pivots.buffer();
+	cl_mem result_buffer = result.buffer();
+
+	err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &lu_buffer);
+	err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &pivots_buffer);
+	err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &result_buffer);
+	err |= clSetKernelArg(kernel, 3, sizeof(int), &n);
+	err |= clSetKernelArg(kernel, 4, sizeof(int), &det_only);
 	if (err != CL_SUCCESS)
 	{
-		clReleaseProgram(program);
-		throw std::runtime_error("Failed to create kernel");
+		throw std::runtime_error("Failed to set kernel arguments");
 	}
 
-	const size_t input_size = height * width * sizeof(float);
+	size_t work_size = reduce_work_group;
+	enqueue_kernel(kernel, 1, &work_size, &work_size, wait_list, {&factors.lu, &factors.pivots}, result);
+	return result;
+}
 
-	float *matrix_result = nullptr;
-	cl_mem input_buffer = nullptr;
-	cl_mem result_buffer = nullptr;
+DeviceMatrix OperationManager::lu_inverse(const LUFactors &factors, const std::vector<cl_event> &wait_list)
+{
+	require_opencl();
+	cl_int err;
+	int n = factors.lu.height();
+	OpScope scope(*this, operation_types::INVERSE, n, n);
+	std::string options = program_options(operation_types::INVERSE);
+	cl_kernel permute_kernel = get_kernel(operation_types::INVERSE, options, "blitz_inverse_permute");
+	cl_kernel block_kernel = get_kernel(operation_types::INVERSE, options, "blitz_inverse_block");
+	cl_kernel update_kernel = get_kernel(operation_types::INVERSE, options, "blitz_inverse_update");
+	DeviceMatrix result(buffer_pool, queue(), n, n);
 
-	// Create buffers
-	input_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-								  input_size, data, &err);
+	cl_mem lu_buffer = factors.lu.buffer();
+	cl_mem pivots_buffer = factors.pivots.buffer();
+	cl_mem result_buffer = result.buffer();
 
+	err = clSetKernelArg(permute_kernel, 0, sizeof(cl_mem), &pivots_buffer);
+	err |= clSetKernelArg(permute_kernel, 1, sizeof(cl_mem), &result_buffer);
+	err |= clSetKernelArg(permute_kernel, 2, sizeof(int), &n);
+	err |= clSetKernelArg(block_kernel, 0, sizeof(cl_mem), &lu_buffer);
+	err |= clSetKernelArg(block_kernel, 1, sizeof(cl_mem), &result_buffer);
+	err |= clSetKernelArg(block_kernel, 2, sizeof(int), &n);
+	err |= clSetKernelArg(update_kernel, 0, sizeof(cl_mem), &lu_buffer);
+	err |= clSetKernelArg(update_kernel, 1, sizeof(cl_mem), &result_buffer);
+	err |= clSetKernelArg(update_kernel, 2, sizeof(int), &n);
 	if (err != CL_SUCCESS)
 	{
-		throw std::runtime_error("Failed to create input buffer");
+		throw std::runtime_error("Failed to set kernel arguments");
 	}
-	size_t output_size;
-	try
+
+	size_t tile = lu_blocking.tile;
+	size_t tile_work_size[2] = {tile, tile};
+	size_t columns = static_cast<size_t>(n);
+	size_t tiled_columns = (columns + tile - 1) / tile * tile;
+
+	// Solves one block of rows, then removes it from the rows [row_start, row_end) still to be solved
+	auto substitute = [&](int block_start, int block_end, int upper, int row_start, int row_end)
 	{
-		switch (op_type)
-		{
-		case operation_types::DETERMINANT:
-		case operation_types::FROBENIUS_NORM:
-		case operation_types::TRACE:
+		err = clSetKernelArg(block_kernel, 3, sizeof(int), &block_start);
+		err |= clSetKernelArg(block_kernel, 4, sizeof(int), &block_end);
+		err |= clSetKernelArg(block_kernel, 5, sizeof(int), &upper);
+		err |= clSetKernelArg(update_kernel, 3, sizeof(int), &block_start);
+		err |= clSetKernelArg(update_kernel, 4, sizeof(int), &block_end);
+		err |= clSetKernelArg(update_kernel, 5, sizeof(int), &row_start);
+		err |= clSetKernelArg(update_kernel, 6, sizeof(int), &row_end);
+		if (err != CL_SUCCESS)
 		{
-			output_size = sizeof(float);
-			// Allocate host memory
-		} break;
-		case operation_types::INVERSE:
-		case operation_types::TRANSPOSE:
+			throw std::runtime_error("Failed to set kernel arguments");
+		}
+		enqueue_kernel(block_kernel, 1, &columns, NULL, {}, {&factors.lu}, result);
+		if (row_start < row_end)
 		{
-			output_size = sizeof(float) * height * width;
-			// Allocate host memory
-		} break;
-		default:
-			throw std::runtime_error("Incorrect Operation Type");
+			size_t rows = static_cast<size_t>(row_end - row_start);
+			size_t update_work_size[2] = {tiled_columns, (rows + tile - 1) / tile * tile};
+			enqueue_kernel(update_kernel, 2, update_work_size, tile_work_size, {}, {&factors.lu}, result);
 		}
+	};
+
+	enqueue_kernel(permute_kernel, 1, &columns, NULL, wait_list, {&factors.pivots}, result);
+
+	// L Y = P I from the top block down, then U X = Y from the bottom block up
+	int block = lu_blocking.panel;
+	for (int block_start = 0; block_start < n; block_start += block)
+	{
+		int block_end = std::min(block_start + block, n);
+		substitute(block_start, block_end, 0, block_end, n);
 	}
-	catch (...)
+	for (int block_start = (n - 1) / block * block; block_start >= 0; block_start -= block)
 	{
-		if (input_buffer)
-			clReleaseMemObject(input_buffer);
-		if (result_buffer)
-			clReleaseMemObject(result_buffer);
-		clReleaseKernel(kernel);
-		clReleaseProgram(program);
-		throw;
+		int block_end = std::min(block_start + block, n);
+		substitute(block_start, block_end, 1, 0, block_start);
+	}
+	return result;
+}
+
+float *OperationManager::slogdet(float *data, int height, int width)
+{
+	if (native)
+	{
+		return native->slogdet(data, height, width);
 	}
+	OpScope scope(*this, "slogdet", height, width);
+	DeviceMatrix input = host_input(data, height, width);
+	DeviceMatrix result = slogdet(input);
+	return read_result(result);
+}
+
+DeviceMatrix OperationManager::slogdet(const DeviceMatrix &data, const std::vector<cl_event> &wait_list)
+{
+	OpScope scope(*this, "slogdet", data.height(), data.width());
+	return lu_determinant(lu_factor(data, wait_list), 0, {});
+}
 
-	matrix_result = (float *)malloc(output_size);
-	result_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY,
-								   output_size, NULL, &err);
+DeviceMatrix OperationManager::slogdet(const LUFactors &factors, const std::vector<cl_event> &wait_list)
+{
+	OpScope scope(*this, "slogdet", factors.lu.height(), factors.lu.width());
+	return lu_determinant(factors, 0, wait_list);
+}
 
-	if (!matrix_result)
+OperationManager::OpScope::OpScope(OperationManager &manager, const std::string &name, int height, int width, int rhs_height,
+								  int rhs_width, double flops, size_t bytes_moved)
+	: manager(manager), previous(active_lane)
+{
+	manager.require_opencl();
+	// Nested ops run on the lane the outermost op on this thread holds
+	lane = previous && previous->owner == &manager ? previous : manager.acquire_lane();
+	active_lane = lane;
+	if (lane->depth++ > 0 || !manager.profiling)
 	{
-		throw std::bad_alloc();
+		return;
 	}
-	if (err != CL_SUCCESS)
+	lane->profiled = true;
 	{
-		throw std::runtime_error("Failed to create result buffer");
+		std::lock_guard<std::mutex> lock(manager.state_mutex);
+		build_start = manager.cache_stats.build_seconds;
 	}
+	buffer_start = manager.buffer_pool->get_stats().create_seconds;
 
-	// Set kernel arguments
-	err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input_buffer);
-	err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &result_buffer);
-	err |= clSetKernelArg(kernel, 2, sizeof(int), &height);
-	err |= clSetKernelArg(kernel, 3, sizeof(int), &width);
+	PendingProfile &pending = lane->open_profile;
+	pending = PendingProfile();
+	pending.profile.name = name;
+	pending.profile.height = height;
+	pending.profile.width = width;
+	pending.profile.rhs_height = rhs_height;
+	pending.profile.rhs_width = rhs_width;
+	pending.profile.flops = flops;
+	pending.profile.bytes_moved = bytes_moved;
+	pending.profile.queue = lane->index;
+	pending.profile.start_seconds = manager.host_seconds();
+}
 
-	if (err != CL_SUCCESS)
+OperationManager::OpScope::OpScope(OperationManager &manager, operation_types op_type, int height, int width, int rhs_height,
+								  int rhs_width, int batch)
+	: OpScope(manager, operation_name(op_type), height, width, rhs_height, rhs_width,
+			  batch * operation_flops(op_type, height, width, rhs_width),
+			  batch * operation_bytes(op_type, height, width, rhs_height, rhs_width))
+{
+}
+
+OperationManager::OpScope::~OpScope()
+{
+	if (--lane->depth == 0 && lane->profiled)
 	{
-		throw std::runtime_error("Failed to set kernel arguments");
+		// Counters may have been reset during the op
+		OpProfile &profile = lane->open_profile.profile;
+		profile.buffer_seconds = std::max(0.0, manager.buffer_pool->get_stats().create_seconds - buffer_start);
+		profile.end_seconds = manager.host_seconds();
+		lane->profiled = false;
+
+		std::lock_guard<std::mutex> lock(manager.state_mutex);
+		profile.build_seconds = std::max(0.0, manager.cache_stats.build_seconds - build_start);
+		manager.pending_profiles.push_back(std::move(lane->open_profile));
+	}
+	active_lane = previous;
+	if (lane != previous)
+	{
+		manager.release_lane(lane);
 	}
+}
 
-	size_t global_work_size[2];
-	if (op_type == operation_types::DETERMINANT ||
-		op_type == operation_types::FROBENIUS_NORM ||
-		op_type == operation_types::TRACE)
+double OperationManager::host_seconds() const
+{
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - created;
+	return elapsed.count();
+}
+
+void OperationManager::record_event(const char *phase, cl_event event)
+{
+	if (!profiling || !event)
 	{
-		global_work_size[0] = 1;
-		global_work_size[1] = 1;
+		return;
 	}
-	else
+	Lane &lane = current_lane();
+	if (!lane.profiled)
 	{
-		global_work_size[0] = static_cast<size_t>(height);
-		global_work_size[1] = static_cast<size_t>(width);
+		return;
 	}
+	clRetainEvent(event);
+	lane.open_profile.events.push_back({phase, event});
+}
 
-	err = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global_work_size, NULL, 0, NULL, NULL);
-	if (err != CL_SUCCESS)
+float *OperationManager::read_result(DeviceMatrix &result)
+{
+	if (!profiling && !result.host_backed())
 	{
-		throw std::runtime_error("Failed to execute kernel");
+		return result.to_host();
 	}
+	// The blocking read has no event to time, go through a future instead
+	return read_result_async(result).wait();
+}
 
-	// Read results
-	err = clEnqueueReadBuffer(queue, result_buffer, CL_TRUE, 0, output_size, matrix_result, 0, NULL, NULL);
-	if (err != CL_SUCCESS)
+void OperationManager::read_result(const DeviceMatrix &result, float *out)
+{
+	if (!profiling)
+	{
+		result.to_host(out);
+		return;
+	}
+	OpFuture future = result.to_host_async(out);
+	record_event("read", future.event());
+	future.wait();
+}
+
+OpFuture OperationManager::read_result_async(DeviceMatrix &result)
+{
+	// Zero-copy results already sit in host memory, the mapping only synchronizes it
+	OpFuture future = result.host_backed() ? result.take_host_async() : result.to_host_async();
+	record_event("read", future.event());
+	return future;
+}
+
+DeviceMatrix OperationManager::host_input(const float *data, int height, int width, bool blocking, const std::vector<cl_event> &wait_list)
+{
+	if (zero_copy && reinterpret_cast<uintptr_t>(data) % base_alignment == 0 && height > 0 && width > 0)
+	{
+		// Read-only wrap of the caller's memory: nothing is copied and kernels never write it
+		cl_int err;
+		size_t bytes = static_cast<size_t>(height) * width * sizeof(float);
+		cl_mem buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, bytes, const_cast<float *>(data), &err);
+		if (err == CL_SUCCESS)
+		{
+			DeviceMatrix matrix(queue(), buffer, height, width);
+			if (!wait_list.empty())
+			{
+				// Stands in for the write that would otherwise wait on wait_list
+				cl_event marker;
+				if (clEnqueueMarkerWithWaitList(queue(), static_cast<cl_uint>(wait_list.size()), wait_list.data(), &marker) != CL_SUCCESS)
+				{
+					throw std::runtime_error("Failed to enqueue marker");
+				}
+				matrix.set_event(marker);
+			}
+			return matrix;
+		}
+	}
+	return blocking ? from_host(data, height, width) : from_host_async(data, height, width, wait_list);
+}
+
+size_t OperationManager::page_alignment() const
+{
+	return std::max<size_t>(base_alignment, 4096);
+}
+
+void OperationManager::set_zero_copy(bool enabled)
+{
+	if (native)
+	{
+		return;
+	}
+	zero_copy = enabled;
+	buffer_pool->set_host_alignment(enabled ? page_alignment() : 0);
+}
+
+float *OperationManager::alloc_host(int height, int width) const
+{
+	void *data = nullptr;
+	size_t bytes = static_cast<size_t>(std::max(height, 0)) * std::max(width, 0) * sizeof(float);
+	if (posix_memalign(&data, page_alignment(), std::max<size_t>(bytes, 1)) != 0)
 	{
-		throw std::runtime_error("Failed to read results");
+		throw std::bad_alloc();
+	}
+	return static_cast<float *>(data);
+}
+
+void OperationManager::resolve_profiles()
+{
+	// Waiting on events happens unlocked, ops on other threads keep recording meanwhile
+	std::vector<PendingProfile> finished;
+	{
+		std::lock_guard<std::mutex> lock(state_mutex);
+		finished.swap(pending_profiles);
+	}
+	for (PendingProfile &pending : finished)
+	{
+		OpProfile &profile = pending.profile;
+		for (ProfileEvent &recorded : pending.events)
+		{
+			cl_ulong start = 0;
+			cl_ulong end = 0;
+			clWaitForEvents(1, &recorded.event);
+			if (clGetEventProfilingInfo(recorded.event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL) == CL_SUCCESS &&
+				clGetEventProfilingInfo(recorded.event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL) == CL_SUCCESS)
+			{
+				double start_seconds = start * 1e-9 + device_clock_offset;
+				double end_seconds = end * 1e-9 + device_clock_offset;
+				double seconds = end_seconds - start_seconds;
+				if (std::strcmp(recorded.phase, "write") == 0)
+					profile.write_seconds += seconds;
+				else if (std::strcmp(recorded.phase, "read") == 0)
+					profile.read_seconds += seconds;
+				else
+					profile.kernel_seconds += seconds;
+				profile.spans.push_back({recorded.phase, start_seconds, end_seconds});
+				profile.end_seconds = std::max(profile.end_seconds, end_seconds);
+			}
+			clReleaseEvent(recorded.event);
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(state_mutex);
+	for (PendingProfile &pending : finished)
+	{
+		profiles.push_back(std::move(pending.profile));
 	}
+}
+
+std::vector<OperationManager::OpProfile> OperationManager::get_profile()
+{
+	resolve_profiles();
+	std::lock_guard<std::mutex> lock(state_mutex);
+	return profiles;
+}
+
+void OperationManager::reset_profile()
+{
+	resolve_profiles();
+	std::lock_guard<std::mutex> lock(state_mutex);
+	profiles.clear();
+}
 
-	// Cleanup
-	clReleaseMemObject(input_buffer);
-	clReleaseMemObject(result_buffer);
-	clReleaseKernel(kernel);
-	clReleaseProgram(program);
+bool OperationManager::export_chrome_trace(const std::string &path)
+{
+	std::ofstream file(path, std::ios::trunc);
+	if (!file.is_open())
+	{
+		return false;
+	}
+	std::vector<OpProfile> records = get_profile();
+	int queues = 1;
+	for (const OpProfile &profile : records)
+	{
+		queues = std::max(queues, profile.queue + 1);
+	}
 
-	return matrix_result;
-}
\ No newline at end of file
+	// Complete ("X") events in microseconds. Queue q has its ops on track 2q + 1
+	// and their device commands on track 2q + 2, so ops of concurrent callers never overlap.
+	file << std::fixed;
+	file.precision(3);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	for (int queue_index = 0; queue_index < queues; queue_index++)
+	{
+		std::string suffix = queue_index ? " (queue " + std::to_string(queue_index) + ")" : "";
+		file << (queue_index ? ",\n" : "\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << 2 * queue_index + 1
+			 << ",\"args\":{\"name\":\"operations" << suffix << "\"}},\n";
+		file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << 2 * queue_index + 2
+			 << ",\"args\":{\"name\":\"device" << suffix << "\"}}";
+	}
+	for (const OpProfile &profile : records)
+	{
+		file << ",\n{\"name\":\"" << profile.name << "\",\"cat\":\"op\",\"ph\":\"X\",\"pid\":1,\"tid\":" << 2 * profile.queue + 1
+			 << ",\"ts\":" << profile.start_seconds * 1e6 << ",\"dur\":" << (profile.end_seconds - profile.start_seconds) * 1e6
+			 << ",\"args\":{\"shape\":\"" << profile.height << "x" << profile.width;
+		if (profile.rhs_height || profile.rhs_width)
+			file << ", " << profile.rhs_height << "x" << profile.rhs_width;
+		file << "\",\"bytes_moved\":" << profile.bytes_moved << ",\"flops\":" << profile.flops
+			 << ",\"build_ms\":" << profile.build_seconds * 1e3 << ",\"buffer_ms\":" << profile.buffer_seconds * 1e3
+			 << ",\"write_ms\":" << profile.write_seconds * 1e3 << ",\"kernel_ms\":" << profile.kernel_seconds * 1e3
+			 << ",\"read_ms\":" << profile.read_seconds * 1e3 << ",\"gflops\":" << profile.gflops()
+			 << ",\"gbytes_per_second\":" << profile.gbytes_per_second() << "}}";
+		for (const OpProfile::Span &span : profile.spans)
+		{
+			file << ",\n{\"name\":\"" << span.phase << "\",\"cat\":\"" << profile.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+				 << 2 * profile.queue + 2 << ",\"ts\":" << span.start_seconds * 1e6
+				 << ",\"dur\":" << (span.end_seconds - span.start_seconds) * 1e6 << "}";
+		}
+	}
+	file << "\n]}\n";
+	return static_cast<bool>(file);
+}
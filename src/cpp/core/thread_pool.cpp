@@ -0,0 +1,99 @@
+#include "include/thread_pool.hpp"
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threads)
+{
+	if (threads == 0)
+	{
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	for (unsigned i = 1; i < threads; i++)
+	{
+		workers.emplace_back(&ThreadPool::worker_loop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread &worker : workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::parallel_for(size_t count, size_t grain, const std::function<void(size_t, size_t)> &fn)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	// A few chunks per thread balances uneven chunks without much contention
+	size_t chunks = (count + std::max<size_t>(grain, 1) - 1) / std::max<size_t>(grain, 1);
+	chunks = std::min(chunks, static_cast<size_t>(size()) * 4);
+	if (workers.empty() || chunks <= 1)
+	{
+		fn(0, count);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &fn;
+		job_count = count;
+		job_chunk = (count + chunks - 1) / chunks;
+		next_index = 0;
+		busy = static_cast<unsigned>(workers.size());
+		generation++;
+	}
+	wake.notify_all();
+
+	run_chunks();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this]() { return busy == 0; });
+	job = nullptr;
+}
+
+void ThreadPool::run_chunks()
+{
+	for (;;)
+	{
+		size_t begin = next_index.fetch_add(job_chunk);
+		if (begin >= job_count)
+		{
+			return;
+		}
+		(*job)(begin, std::min(begin + job_chunk, job_count));
+	}
+}
+
+void ThreadPool::worker_loop()
+{
+	size_t seen = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&]() { return stopping || generation != seen; });
+			if (stopping)
+			{
+				return;
+			}
+			seen = generation;
+		}
+
+		run_chunks();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busy == 0)
+		{
+			done.notify_one();
+		}
+	}
+}
@@ -1,4 +1,4 @@
-from .opencl_ops import OperationManager
+from .opencl_ops import OperationManager, DeviceMatrix, load_bmat, save_bmat
 
 # Operation types for multi-vector operations
 OPERATIONS = {
@@ -21,11 +21,15 @@ SINGLE_OPERATIONS = {
 # Device types
 DEVICES = {
     'CPU': 'CPU',
-    'GPU': 'GPU'
+    'GPU': 'GPU',
+    'NATIVE': 'NATIVE'  # Native SIMD CPU backend, host arrays only
 }
 
 __all__ = [
     'OperationManager',
+    'DeviceMatrix',
+    'load_bmat',
+    'save_bmat',
     'OPERATIONS',
     'SINGLE_OPERATIONS',
     'DEVICES'
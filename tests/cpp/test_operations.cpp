@@ -5,6 +5,12 @@
 #include <cmath>
 #include <iterator>
 #include <algorithm>
+#include <fstream>
+#include <cstddef>
+#include <cstdlib>
+#include <limits>
+#include <dirent.h>
+#include <thread>
 
 class OperationTest : public ::testing::Test
 {
@@ -52,6 +58,32 @@ protected:
 		matrix4[12] = 1.5; matrix4[13] = 9.2; matrix4[14] = 12.7; matrix4[15] = 4.3;
 	}
 
+	// m x k by k x n operands whose sizes are not multiples of any tile shape, and
+	// their product. The small integer values keep every sum exact in float.
+	struct ProductOperands
+	{
+		int m = 130, k = 70, n = 99;
+		std::vector<float> lhs, rhs, expected;
+	};
+
+	static ProductOperands ragged_product()
+	{
+		ProductOperands operands;
+		const int m = operands.m, k = operands.k, n = operands.n;
+		operands.lhs.resize(m * k);
+		operands.rhs.resize(k * n);
+		for (int i = 0; i < m * k; i++)
+			operands.lhs[i] = static_cast<float>((i * 7) % 13) - 6.0f;
+		for (int i = 0; i < k * n; i++)
+			operands.rhs[i] = static_cast<float>((i * 5) % 11) - 5.0f;
+		operands.expected.assign(m * n, 0.0f);
+		for (int row = 0; row < m; row++)
+			for (int inner = 0; inner < k; inner++)
+				for (int col = 0; col < n; col++)
+					operands.expected[row * n + col] += operands.lhs[row * k + inner] * operands.rhs[inner * n + col];
+		return operands;
+	}
+
 	void TearDown() override
 	{
 		delete cpuopmanager;
@@ -134,6 +166,41 @@ TEST_F(OperationTest, Element_Wise_Mul_Test)
 
 TEST_F(OperationTest, Frobenius_Norm_Test)
 {
+	// sqrt(1 + 4 + ... + 81) = sqrt(285)
+	result_matrix = cpuopmanager->single_vector_op(operation_types::FROBENIUS_NORM, matrix1, rows1, cols1);
+	EXPECT_TRUE(check_result(result_matrix[0], std::sqrt(285.0f), relative_tolerance, absolute_tolerance))
+		<< "CPU frb_nrm(matrix1) = " << result_matrix[0];
+	free(result_matrix);
+
+	result_matrix = gpuopmanager->single_vector_op(operation_types::FROBENIUS_NORM, matrix1, rows1, cols1);
+	EXPECT_TRUE(check_result(result_matrix[0], std::sqrt(285.0f), relative_tolerance, absolute_tolerance))
+		<< "GPU frb_nrm(matrix1) = " << result_matrix[0];
+	free(result_matrix);
+
+	// Large enough for the multi-work-group reduction
+	const int height = 1500, width = 1100;
+	std::vector<float> large(height * width);
+	double expected = 0.0;
+	for (int i = 0; i < height * width; i++)
+	{
+		large[i] = static_cast<float>((i * 37) % 101) / 101.0f;
+		expected += static_cast<double>(large[i]) * large[i];
+	}
+	expected = std::sqrt(expected);
+
+	for (OperationManager *manager : {cpuopmanager, gpuopmanager})
+	{
+		for (auto variant : {OperationManager::kernel_variants::REFERENCE, OperationManager::kernel_variants::OPTIMIZED})
+		{
+			manager->set_kernel_variant(operation_types::FROBENIUS_NORM, variant);
+			// The reference kernel sums serially in float, which drifts by ~3e-4 over 1.65M terms
+			float tolerance = variant == OperationManager::kernel_variants::REFERENCE ? 1e-3f : 1e-5f;
+			result_matrix = manager->single_vector_op(operation_types::FROBENIUS_NORM, large.data(), height, width);
+			EXPECT_TRUE(check_result(result_matrix[0], static_cast<float>(expected), tolerance, absolute_tolerance))
+				<< "frb_nrm(large) = " << result_matrix[0] << ", expected " << expected;
+			free(result_matrix);
+		}
+	}
 }
 
 TEST_F(OperationTest, Matrix_Multiplication_Test)
@@ -142,6 +209,37 @@ TEST_F(OperationTest, Matrix_Multiplication_Test)
 
 TEST_F(OperationTest, Trace_Test)
 {
+	result_matrix = cpuopmanager->single_vector_op(operation_types::TRACE, matrix3, rows2, cols2);
+	EXPECT_TRUE(check_result(result_matrix[0], 121.2f, relative_tolerance, absolute_tolerance))
+		<< "CPU trace(matrix3) = " << result_matrix[0] << ", expected 121.2";
+	free(result_matrix);
+
+	result_matrix = gpuopmanager->single_vector_op(operation_types::TRACE, matrix1, rows1, cols1);
+	EXPECT_TRUE(check_result(result_matrix[0], 15.0f, relative_tolerance, absolute_tolerance))
+		<< "GPU trace(matrix1) = " << result_matrix[0] << ", expected 15";
+	free(result_matrix);
+
+	// Non-square and long enough for the multi-work-group reduction
+	const int height = 3000, width = 2000;
+	std::vector<float> large(height * width, 1.0f);
+	double expected = 0.0;
+	for (int i = 0; i < width; i++)
+	{
+		large[i * width + i] = static_cast<float>(i % 17) * 0.25f;
+		expected += large[i * width + i];
+	}
+
+	for (OperationManager *manager : {cpuopmanager, gpuopmanager})
+	{
+		for (auto variant : {OperationManager::kernel_variants::REFERENCE, OperationManager::kernel_variants::OPTIMIZED})
+		{
+			manager->set_kernel_variant(operation_types::TRACE, variant);
+			result_matrix = manager->single_vector_op(operation_types::TRACE, large.data(), height, width);
+			EXPECT_TRUE(check_result(result_matrix[0], static_cast<float>(expected), relative_tolerance, absolute_tolerance))
+				<< "trace(large) = " << result_matrix[0] << ", expected " << expected;
+			free(result_matrix);
+		}
+	}
 }
 
 TEST_F(OperationTest, Transpose_Test)
@@ -230,4 +328,1011 @@ TEST_F(OperationTest, Transpose_Test)
 
 TEST_F(OperationTest, Inverse_Test)
 {
+	float expected_inverse2[9] = {-0.2, -0.2, 0.4, -2, 0, 1, 1.4, 0.4, -0.8};
+	result_matrix = cpuopmanager->single_vector_op(operation_types::INVERSE, matrix2, rows1, cols1);
+	for (int i = 0; i < rows1 * cols1; i++)
+		EXPECT_TRUE(check_result(result_matrix[i], expected_inverse2[i], 1e-5, 1e-5))
+			<< "CPU inverse(matrix2)[" << i << "] = " << result_matrix[i] << ", expected " << expected_inverse2[i];
+	free(result_matrix);
+
+	// Only solvable with a row swap
+	float swap[4] = {0, 1, 1, 0};
+	result_matrix = gpuopmanager->single_vector_op(operation_types::INVERSE, swap, 2, 2);
+	for (int i = 0; i < 4; i++)
+		EXPECT_FLOAT_EQ(result_matrix[i], swap[i]);
+	free(result_matrix);
+
+	// Several row blocks: A * inverse(A) must be the identity
+	const int n = 100;
+	std::vector<float> matrix(n * n);
+	for (int row = 0; row < n; row++)
+		for (int col = 0; col < n; col++)
+			matrix[row * n + col] = row == col ? n : ((row * 7 + col * 3) % 11) / 10.0f - 0.5f;
+	result_matrix = gpuopmanager->single_vector_op(operation_types::INVERSE, matrix.data(), n, n);
+	for (int row = 0; row < n; row++)
+	{
+		for (int col = 0; col < n; col++)
+		{
+			double sum = 0.0;
+			for (int k = 0; k < n; k++)
+				sum += matrix[row * n + k] * result_matrix[k * n + col];
+			EXPECT_NEAR(sum, row == col ? 1.0 : 0.0, 1e-4) << "(A * inverse(A))[" << row << "][" << col << "]";
+		}
+	}
+	free(result_matrix);
+}
+
+
+TEST_F(OperationTest, Kernel_Cache_Test)
+{
+	cpuopmanager->reset_cache_stats();
+
+	result_matrix = cpuopmanager->single_vector_op(operation_types::TRANSPOSE, matrix1, rows1, cols1);
+	free(result_matrix);
+	OperationManager::CacheStats first_call = cpuopmanager->get_cache_stats();
+	EXPECT_EQ(first_call.program_builds + first_call.binary_loads, 1u);
+	EXPECT_EQ(first_call.kernel_misses, 1u);
+
+	result_matrix = cpuopmanager->single_vector_op(operation_types::TRANSPOSE, matrix3, rows2, cols2);
+	free(result_matrix);
+	OperationManager::CacheStats second_call = cpuopmanager->get_cache_stats();
+	EXPECT_EQ(second_call.program_builds + second_call.binary_loads, 1u) << "Steady-state call rebuilt the program";
+	EXPECT_EQ(second_call.kernel_hits, 1u);
+
+	// After warming up every operation, no call should reach the compiler
+	gpuopmanager->warm_up();
+	size_t builds = gpuopmanager->get_cache_stats().program_builds;
+	result_matrix = gpuopmanager->multi_vector_op(operation_types::ELEM_WISE_ADD, matrix1, rows1, cols1, matrix2, rows1, cols1);
+	free(result_matrix);
+	result_matrix = gpuopmanager->single_vector_op(operation_types::DETERMINANT, matrix2, rows1, cols1);
+	free(result_matrix);
+	EXPECT_EQ(gpuopmanager->get_cache_stats().program_builds, builds);
+}
+
+
+TEST_F(OperationTest, Binary_Cache_Test)
+{
+	char cache_dir[] = "/tmp/blitzmat_kernel_cache_XXXXXX";
+	ASSERT_NE(mkdtemp(cache_dir), nullptr);
+
+	// First manager compiles from source and stores the binary
+	{
+		OperationManager cold(OperationManager::device_types::CPU_DEVICE);
+		cold.set_binary_cache_dir(cache_dir);
+		cold.warm_up({operation_types::TRANSPOSE});
+		EXPECT_EQ(cold.get_cache_stats().program_builds, 1u);
+		EXPECT_EQ(cold.get_cache_stats().binary_loads, 0u);
+	}
+
+	// Second manager picks the binary up without compiling
+	{
+		OperationManager warm(OperationManager::device_types::CPU_DEVICE);
+		warm.set_binary_cache_dir(cache_dir);
+		warm.warm_up({operation_types::TRANSPOSE});
+		EXPECT_EQ(warm.get_cache_stats().program_builds, 0u);
+		EXPECT_EQ(warm.get_cache_stats().binary_loads, 1u);
+
+		result_matrix = warm.single_vector_op(operation_types::TRANSPOSE, matrix1, rows1, cols1);
+		EXPECT_FLOAT_EQ(result_matrix[1], 4.0f);
+		free(result_matrix);
+	}
+
+	// Corrupt every entry, the next manager must fall back to a source build
+	DIR *dir = opendir(cache_dir);
+	ASSERT_NE(dir, nullptr);
+	while (dirent *entry = readdir(dir))
+	{
+		std::string name = entry->d_name;
+		if (name == "." || name == "..")
+			continue;
+		std::ofstream corrupt(std::string(cache_dir) + "/" + name, std::ios::binary | std::ios::trunc);
+		corrupt << "not a program binary";
+	}
+	closedir(dir);
+	{
+		OperationManager rebuilt(OperationManager::device_types::CPU_DEVICE);
+		rebuilt.set_binary_cache_dir(cache_dir);
+		rebuilt.warm_up({operation_types::TRANSPOSE});
+		EXPECT_EQ(rebuilt.get_cache_stats().program_builds, 1u);
+		EXPECT_EQ(rebuilt.get_cache_stats().binary_loads, 0u);
+	}
+
+	dir = opendir(cache_dir);
+	ASSERT_NE(dir, nullptr);
+	while (dirent *entry = readdir(dir))
+	{
+		std::string name = entry->d_name;
+		if (name != "." && name != "..")
+			std::remove((std::string(cache_dir) + "/" + name).c_str());
+	}
+	closedir(dir);
+	rmdir(cache_dir);
+}
+
+TEST_F(OperationTest, Device_Matrix_Chain_Test)
+{
+	// (matrix1 x matrix2 + matrix1)^T computed without leaving the device
+	float expected[] = {
+		17, 41, 65,
+		9, 21, 33,
+		16, 37, 58
+	};
+
+	DeviceMatrix lhs = cpuopmanager->from_host(matrix1, rows1, cols1);
+	DeviceMatrix rhs = cpuopmanager->from_host(matrix2, rows1, cols1);
+	DeviceMatrix product = cpuopmanager->multi_vector_op(operation_types::MATRIX_MULTIPLICATION, lhs, rhs);
+	DeviceMatrix sum = cpuopmanager->multi_vector_op(operation_types::ELEM_WISE_ADD, product, lhs);
+	DeviceMatrix transposed = cpuopmanager->single_vector_op(operation_types::TRANSPOSE, sum);
+
+	EXPECT_EQ(transposed.height(), cols1);
+	EXPECT_EQ(transposed.width(), rows1);
+
+	result_matrix = transposed.to_host();
+	for (int i = 0; i < rows1 * cols1; i++)
+	{
+		EXPECT_TRUE(check_result(result_matrix[i], expected[i], relative_tolerance, absolute_tolerance))
+			<< "Index " << i << ": " << result_matrix[i] << ", expected " << expected[i];
+	}
+	free(result_matrix);
+
+	EXPECT_THROW(cpuopmanager->multi_vector_op(operation_types::MATRIX_MULTIPLICATION, lhs, cpuopmanager->from_host(matrix3, rows2, cols2)),
+				 std::invalid_argument);
+}
+
+TEST_F(OperationTest, Tiled_Matrix_Multiplication_Test)
+{
+	// Sizes that are not multiples of the tile shape exercise the edge handling
+	ProductOperands operands = ragged_product();
+	const int m = operands.m, k = operands.k, n = operands.n;
+	std::vector<float> &lhs = operands.lhs, &rhs = operands.rhs, &expected = operands.expected;
+
+	for (OperationManager *manager : {cpuopmanager, gpuopmanager})
+	{
+		for (auto variant : {OperationManager::kernel_variants::REFERENCE, OperationManager::kernel_variants::OPTIMIZED})
+		{
+			manager->set_kernel_variant(operation_types::MATRIX_MULTIPLICATION, variant);
+			result_matrix = manager->multi_vector_op(operation_types::MATRIX_MULTIPLICATION, lhs.data(), m, k, rhs.data(), k, n);
+			for (int i = 0; i < m * n; i++)
+			{
+				ASSERT_TRUE(check_result(result_matrix[i], expected[i], relative_tolerance, absolute_tolerance))
+					<< "Index " << i << ": " << result_matrix[i] << ", expected " << expected[i];
+			}
+			free(result_matrix);
+		}
+	}
+}
+
+TEST_F(OperationTest, Async_Op_Test)
+{
+	float expected_sum[] = {3, 2, 4, 5, 7, 9, 11, 9, 11};
+	float expected_transpose[] = {1, 4, 7, 2, 5, 8, 3, 6, 9};
+
+	// Queue independent operations, then sync once
+	OpFuture sum = cpuopmanager->multi_vector_op_async(operation_types::ELEM_WISE_ADD, matrix1, rows1, cols1, matrix2, rows1, cols1);
+	OpFuture transposed = cpuopmanager->single_vector_op_async(operation_types::TRANSPOSE, matrix1, rows1, cols1, {sum.event()});
+
+	result_matrix = transposed.wait();
+	EXPECT_TRUE(sum.ready()) << "Dependent operation finished before its wait list";
+	for (int i = 0; i < rows1 * cols1; i++)
+		EXPECT_FLOAT_EQ(result_matrix[i], expected_transpose[i]);
+	free(result_matrix);
+
+	result_matrix = sum.wait();
+	for (int i = 0; i < rows1 * cols1; i++)
+		EXPECT_FLOAT_EQ(result_matrix[i], expected_sum[i]);
+	free(result_matrix);
+	EXPECT_EQ(sum.wait(), nullptr);
+
+	// Device chain with a single host sync at the end
+	DeviceMatrix lhs = cpuopmanager->from_host_async(matrix1, rows1, cols1);
+	DeviceMatrix rhs = cpuopmanager->from_host_async(matrix2, rows1, cols1);
+	DeviceMatrix chained = cpuopmanager->single_vector_op(operation_types::TRANSPOSE,
+														   cpuopmanager->multi_vector_op(operation_types::ELEM_WISE_ADD, lhs, rhs));
+	OpFuture host_result = chained.to_host_async();
+	result_matrix = host_result.wait();
+	EXPECT_TRUE(chained.ready());
+	for (int row = 0; row < rows1; row++)
+		for (int col = 0; col < cols1; col++)
+			EXPECT_FLOAT_EQ(result_matrix[col * rows1 + row], expected_sum[row * cols1 + col]);
+	free(result_matrix);
+}
+
+
+TEST_F(OperationTest, Buffer_Pool_Test)
+{
+	EXPECT_EQ(BufferPool::bucket_size(1), 256u);
+	EXPECT_EQ(BufferPool::bucket_size(513), 640u);
+	EXPECT_EQ(BufferPool::bucket_size(1024), 1024u);
+	EXPECT_EQ(BufferPool::bucket_size(1025), 1280u);
+
+	// First call creates lhs, rhs and result buffers (zero-copy would use the host arrays instead)
+	cpuopmanager->set_zero_copy(false);
+	result_matrix = cpuopmanager->multi_vector_op(operation_types::ELEM_WISE_MUL, matrix3, rows2, cols2, matrix4, rows2, cols2);
+	free(result_matrix);
+	BufferPool::Stats first_call = cpuopmanager->get_pool_stats();
+	EXPECT_EQ(first_call.misses, 3u);
+	EXPECT_EQ(first_call.bytes_in_use, 0u);
+	EXPECT_EQ(first_call.bytes_pooled, 3 * BufferPool::bucket_size(rows2 * cols2 * sizeof(float)));
+
+	// Same-shaped call is served entirely from the pool
+	result_matrix = cpuopmanager->multi_vector_op(operation_types::ELEM_WISE_MUL, matrix3, rows2, cols2, matrix4, rows2, cols2);
+	EXPECT_FLOAT_EQ(result_matrix[5], 91 * 5.9f);
+	free(result_matrix);
+	BufferPool::Stats second_call = cpuopmanager->get_pool_stats();
+	EXPECT_EQ(second_call.misses, 3u);
+	EXPECT_EQ(second_call.hits, 3u);
+	EXPECT_EQ(second_call.peak_bytes_in_use, first_call.bytes_pooled);
+
+	cpuopmanager->trim_pool();
+	EXPECT_EQ(cpuopmanager->get_pool_stats().bytes_pooled, 0u);
+
+	// Nothing is kept once the high-water limit is zero
+	cpuopmanager->set_pool_limits(0, 0);
+	result_matrix = cpuopmanager->single_vector_op(operation_types::TRANSPOSE, matrix3, rows2, cols2);
+	free(result_matrix);
+	EXPECT_EQ(cpuopmanager->get_pool_stats().bytes_pooled, 0u);
+}
+
+
+TEST_F(OperationTest, LU_Determinant_Test)
+{
+	// Needs a row swap, the reference kernel divides by the zero pivot
+	float swap[4] = {0, 1, 1, 0};
+	result_matrix = gpuopmanager->single_vector_op(operation_types::DETERMINANT, swap, 2, 2);
+	EXPECT_FLOAT_EQ(result_matrix[0], -1);
+	free(result_matrix);
+
+	// det of the n x n [-1 2 -1] tridiagonal matrix is n + 1, past the old 16 x 16 limit
+	const int n = 70;
+	std::vector<float> tridiagonal(n * n, 0.0f);
+	for (int i = 0; i < n; i++)
+	{
+		tridiagonal[i * n + i] = 2;
+		if (i > 0)
+			tridiagonal[i * n + i - 1] = -1;
+		if (i + 1 < n)
+			tridiagonal[i * n + i + 1] = -1;
+	}
+	result_matrix = cpuopmanager->single_vector_op(operation_types::DETERMINANT, tridiagonal.data(), n, n);
+	EXPECT_NEAR(result_matrix[0], n + 1, 1e-3);
+	free(result_matrix);
+
+	// |det| = 1e210 overflows float, slogdet stays finite; 35 negative entries flip the sign
+	std::vector<float> scaled(n * n, 0.0f);
+	for (int i = 0; i < n; i++)
+		scaled[i * n + i] = i % 2 ? 1e3f : -1e3f;
+	result_matrix = gpuopmanager->slogdet(scaled.data(), n, n);
+	EXPECT_FLOAT_EQ(result_matrix[0], -1);
+	EXPECT_NEAR(result_matrix[1], n * std::log(1e3), 1e-3);
+	free(result_matrix);
+
+	result_matrix = cpuopmanager->slogdet(matrix1, rows1, cols1);
+	EXPECT_FLOAT_EQ(result_matrix[0], 0);
+	EXPECT_TRUE(std::isinf(result_matrix[1]) && result_matrix[1] < 0);
+	free(result_matrix);
+
+	// Factors computed once feed later ops
+	DeviceMatrix input = cpuopmanager->from_host(matrix3, rows2, cols2);
+	OperationManager::LUFactors factors = cpuopmanager->lu_factor(input);
+	result_matrix = cpuopmanager->slogdet(factors).to_host();
+	EXPECT_FLOAT_EQ(result_matrix[0], -1);
+	EXPECT_TRUE(check_result(std::exp(result_matrix[1]), 26398.6062, 1e-5, absolute_tolerance));
+	free(result_matrix);
+
+	// The reference kernel is still selectable for small matrices
+	gpuopmanager->set_kernel_variant(operation_types::DETERMINANT, OperationManager::kernel_variants::REFERENCE);
+	result_matrix = gpuopmanager->single_vector_op(operation_types::DETERMINANT, matrix2, rows1, cols1);
+	EXPECT_TRUE(check_result(result_matrix[0], -5, relative_tolerance, absolute_tolerance));
+	free(result_matrix);
+	EXPECT_THROW(gpuopmanager->single_vector_op(operation_types::DETERMINANT, tridiagonal.data(), n, n), std::invalid_argument);
+}
+
+
+TEST_F(OperationTest, Tiled_Transpose_Test)
+{
+	// Partial edge tiles in both directions
+	const int height = 70;
+	const int width = 45;
+	std::vector<float> matrix(height * width);
+	for (int i = 0; i < height * width; i++)
+		matrix[i] = static_cast<float>(i);
+
+	gpuopmanager->set_kernel_variant(operation_types::TRANSPOSE, OperationManager::kernel_variants::OPTIMIZED);
+	result_matrix = gpuopmanager->single_vector_op(operation_types::TRANSPOSE, matrix.data(), height, width);
+	for (int row = 0; row < height; row++)
+		for (int col = 0; col < width; col++)
+			EXPECT_EQ(result_matrix[col * height + row], matrix[row * width + col]) << "at (" << row << ", " << col << ")";
+	free(result_matrix);
+
+	// In place on a square matrix, tiles above and below the diagonal swap
+	std::vector<float> square_data(height * height);
+	for (int i = 0; i < height * height; i++)
+		square_data[i] = static_cast<float>(i);
+	DeviceMatrix square = cpuopmanager->from_host(square_data.data(), height, height);
+	cpuopmanager->transpose_in_place(square);
+	result_matrix = square.to_host();
+	for (int row = 0; row < height; row++)
+		for (int col = 0; col < height; col++)
+			EXPECT_EQ(result_matrix[col * height + row], square_data[row * height + col]) << "at (" << row << ", " << col << ")";
+	free(result_matrix);
+
+	DeviceMatrix rectangular = cpuopmanager->from_host(matrix.data(), height, width);
+	EXPECT_THROW(cpuopmanager->transpose_in_place(rectangular), std::invalid_argument);
+}
+
+
+TEST_F(OperationTest, Expression_Fusion_Test)
+{
+	float row_scale[4] = {1, 2, 3, 4};
+	DeviceMatrix a = gpuopmanager->from_host(matrix3, rows2, cols2);
+	DeviceMatrix b = gpuopmanager->from_host(matrix4, rows2, cols2);
+	DeviceMatrix c = gpuopmanager->from_host(row_scale, 1, cols2);
+
+	// (a + b) * c - a / 2 with c repeated down the rows, as a single kernel
+	Expression sum = a + b;
+	gpuopmanager->reset_cache_stats();
+	DeviceMatrix fused = gpuopmanager->evaluate(sum * c - a / 2.0f);
+	EXPECT_EQ(gpuopmanager->get_cache_stats().kernel_misses, 1u);
+	result_matrix = fused.to_host();
+	for (int row = 0; row < rows2; row++)
+	{
+		for (int col = 0; col < cols2; col++)
+		{
+			int i = row * cols2 + col;
+			float expected = (matrix3[i] + matrix4[i]) * row_scale[col] - matrix3[i] / 2.0f;
+			EXPECT_TRUE(check_result(result_matrix[i], expected, relative_tolerance, absolute_tolerance))
+				<< "at " << i << ": " << result_matrix[i] << ", expected " << expected;
+		}
+	}
+	free(result_matrix);
+
+	// Same structure with other operands and scalars reuses the generated kernel
+	Expression swapped = b + a;
+	DeviceMatrix again = gpuopmanager->evaluate(swapped * c - b / 3.0f);
+	OperationManager::CacheStats stats = gpuopmanager->get_cache_stats();
+	EXPECT_EQ(stats.kernel_misses, 1u);
+	EXPECT_EQ(stats.kernel_hits, 1u);
+	result_matrix = again.to_host();
+	EXPECT_TRUE(check_result(result_matrix[5], (91 + 5.9f) * 2 - 5.9f / 3.0f, relative_tolerance, absolute_tolerance));
+	free(result_matrix);
+
+	EXPECT_THROW(c + a, std::invalid_argument);
+}
+
+
+TEST_F(OperationTest, Batched_Op_Test)
+{
+	// [matrix1, matrix2] back to back
+	const int batch = 2;
+	std::vector<float> pair(matrix1, matrix1 + rows1 * cols1);
+	pair.insert(pair.end(), matrix2, matrix2 + rows1 * cols1);
+
+	result_matrix = gpuopmanager->batched_single_vector_op(operation_types::DETERMINANT, pair.data(), batch, rows1, cols1);
+	EXPECT_TRUE(check_result(result_matrix[0], 0, relative_tolerance, absolute_tolerance)) << "det(matrix1) = " << result_matrix[0];
+	EXPECT_TRUE(check_result(result_matrix[1], -5, relative_tolerance, absolute_tolerance)) << "det(matrix2) = " << result_matrix[1];
+	free(result_matrix);
+
+	result_matrix = cpuopmanager->batched_single_vector_op(operation_types::TRANSPOSE, pair.data(), batch, rows1, cols1);
+	for (int m = 0; m < batch; m++)
+		for (int row = 0; row < rows1; row++)
+			for (int col = 0; col < cols1; col++)
+				EXPECT_EQ(result_matrix[m * 9 + col * rows1 + row], pair[m * 9 + row * cols1 + col]);
+	free(result_matrix);
+
+	// Each product matches the single-matrix op
+	result_matrix = cpuopmanager->batched_multi_vector_op(operation_types::MATRIX_MULTIPLICATION, pair.data(), batch, rows1, cols1,
+														  pair.data(), rows1, cols1);
+	for (int m = 0; m < batch; m++)
+	{
+		float *single = cpuopmanager->multi_vector_op(operation_types::MATRIX_MULTIPLICATION, &pair[m * 9], rows1, cols1, &pair[m * 9], rows1, cols1);
+		for (int i = 0; i < rows1 * cols1; i++)
+			EXPECT_FLOAT_EQ(result_matrix[m * 9 + i], single[i]);
+		free(single);
+	}
+	free(result_matrix);
+
+	// The second inverse needs a row swap
+	std::vector<float> two_by_two = {2, 0, 0, 4, 0, 1, 1, 0};
+	result_matrix = gpuopmanager->batched_single_vector_op(operation_types::INVERSE, two_by_two.data(), 2, 2, 2);
+	float expected_inverses[8] = {0.5, 0, 0, 0.25, 0, 1, 1, 0};
+	for (int i = 0; i < 8; i++)
+		EXPECT_FLOAT_EQ(result_matrix[i], expected_inverses[i]);
+	free(result_matrix);
+
+	std::vector<float> too_large(2 * 33 * 33, 1.0f);
+	EXPECT_THROW(cpuopmanager->batched_single_vector_op(operation_types::DETERMINANT, too_large.data(), 2, 33, 33), std::invalid_argument);
+}
+
+TEST_F(OperationTest, Native_Backend_Test)
+{
+	OperationManager native(OperationManager::device_types::NATIVE_CPU);
+
+	float expected_sum[] = {3, 2, 4, 5, 7, 9, 11, 9, 11};
+	result_matrix = native.multi_vector_op(operation_types::ELEM_WISE_ADD, matrix1, rows1, cols1, matrix2, rows1, cols1);
+	for (int i = 0; i < rows1 * cols1; i++)
+		EXPECT_FLOAT_EQ(result_matrix[i], expected_sum[i]);
+	free(result_matrix);
+
+	result_matrix = native.single_vector_op(operation_types::DETERMINANT, matrix2, rows1, cols1);
+	EXPECT_TRUE(check_result(result_matrix[0], -5, relative_tolerance, absolute_tolerance)) << result_matrix[0];
+	free(result_matrix);
+
+	result_matrix = native.single_vector_op(operation_types::TRACE, matrix1, rows1, cols1);
+	EXPECT_FLOAT_EQ(result_matrix[0], 15);
+	free(result_matrix);
+
+	OpFuture future = native.single_vector_op_async(operation_types::TRANSPOSE, matrix1, rows1, cols1);
+	EXPECT_TRUE(future.ready());
+	result_matrix = future.wait();
+	float expected_transpose[] = {1, 4, 7, 2, 5, 8, 3, 6, 9};
+	for (int i = 0; i < rows1 * cols1; i++)
+		EXPECT_FLOAT_EQ(result_matrix[i], expected_transpose[i]);
+	free(result_matrix);
+
+	EXPECT_THROW(native.from_host(matrix1, rows1, cols1), std::runtime_error);
+
+	// Every instruction set the CPU has, with edges that do not fill a register tile
+	ProductOperands operands = ragged_product();
+	const int m = operands.m, k = operands.k, n = operands.n;
+	std::vector<float> &lhs = operands.lhs, &rhs = operands.rhs, &expected = operands.expected;
+
+	for (simd_levels level : {simd_levels::SCALAR, simd_levels::AVX2, simd_levels::AVX512})
+	{
+		NativeBackend backend(3, level);
+		EXPECT_LE(static_cast<int>(backend.instruction_set()), static_cast<int>(level));
+		result_matrix = backend.multi_vector_op(operation_types::MATRIX_MULTIPLICATION, lhs.data(), m, k, rhs.data(), k, n);
+		for (int i = 0; i < m * n; i++)
+		{
+			ASSERT_FLOAT_EQ(result_matrix[i], expected[i]) << backend.instruction_set_name() << " index " << i;
+		}
+		free(result_matrix);
+
+		result_matrix = backend.single_vector_op(operation_types::INVERSE, matrix3, rows2, cols2);
+		float *product = backend.multi_vector_op(operation_types::MATRIX_MULTIPLICATION, matrix3, rows2, cols2, result_matrix, rows2, cols2);
+		for (int row = 0; row < rows2; row++)
+			for (int col = 0; col < cols2; col++)
+				EXPECT_NEAR(product[row * cols2 + col], row == col ? 1.0f : 0.0f, 1e-4) << backend.instruction_set_name();
+		free(product);
+		free(result_matrix);
+	}
+}
+
+TEST_F(OperationTest, Multi_Device_Test)
+{
+	std::vector<DeviceManager::Device> devices = DeviceManager::enumerate();
+	ASSERT_FALSE(devices.empty());
+	for (const DeviceManager::Device &device : devices)
+		EXPECT_FALSE(device.name.empty());
+
+	// Two managers on the same device still exercise the split and gather
+	DeviceManager split({devices[0], devices[0]});
+	split.set_split_thresholds(0, 0);
+
+	ProductOperands operands = ragged_product();
+	const int m = operands.m, k = operands.k, n = operands.n;
+	std::vector<float> &lhs = operands.lhs, &rhs = operands.rhs;
+
+	// Repeat so the second call splits by measured rather than estimated throughput
+	double estimate = split.throughput(1, operation_types::MATRIX_MULTIPLICATION);
+	for (int repeat = 0; repeat < 2; repeat++)
+	{
+		float *expected = split.manager(0).multi_vector_op(operation_types::MATRIX_MULTIPLICATION, lhs.data(), m, k, rhs.data(), k, n);
+		result_matrix = split.multi_vector_op(operation_types::MATRIX_MULTIPLICATION, lhs.data(), m, k, rhs.data(), k, n);
+		for (int i = 0; i < m * n; i++)
+			ASSERT_FLOAT_EQ(result_matrix[i], expected[i]) << "Index " << i;
+		free(result_matrix);
+		free(expected);
+		// Measured in flop/s, far from the compute units x clock estimate
+		EXPECT_NE(split.throughput(1, operation_types::MATRIX_MULTIPLICATION), estimate);
+		EXPECT_GT(split.throughput(1, operation_types::MATRIX_MULTIPLICATION), 0);
+	}
+
+	// A broadcast row reaches every panel
+	std::vector<float> row = {10, 20, 30};
+	result_matrix = split.multi_vector_op(operation_types::ELEM_WISE_ADD, matrix1, rows1, cols1, row.data(), 1, cols1);
+	for (int i = 0; i < rows1 * cols1; i++)
+		EXPECT_FLOAT_EQ(result_matrix[i], matrix1[i] + row[i % cols1]);
+	free(result_matrix);
+
+	std::vector<float> column = {10, 20, 30, 40, 50, 60, 70, 80, 90, 100, 110, 120};
+	std::vector<float> pattern = {1, 2, 3};
+	result_matrix = split.multi_vector_op(operation_types::ELEM_WISE_MUL, column.data(), 12, 1, pattern.data(), 3, 1);
+	for (int i = 0; i < 12; i++)
+		EXPECT_FLOAT_EQ(result_matrix[i], column[i] * pattern[i % 3]);
+	free(result_matrix);
+
+	EXPECT_THROW(split.multi_vector_op(operation_types::MATRIX_MULTIPLICATION, lhs.data(), m, k, rhs.data(), n, k), std::invalid_argument);
+}
+
+TEST_F(OperationTest, Profiling_Test)
+{
+	OperationManager profiled(OperationManager::device_types::CPU_DEVICE, true);
+	ASSERT_TRUE(profiled.profiling_enabled());
+	profiled.set_zero_copy(false); // The copies are part of what is timed here
+
+	result_matrix = profiled.multi_vector_op(operation_types::MATRIX_MULTIPLICATION, matrix3, rows2, cols2, matrix4, rows2, cols2);
+	free(result_matrix);
+	// Nested LU factor and solve count towards the outer op
+	result_matrix = profiled.single_vector_op(operation_types::INVERSE, matrix3, rows2, cols2);
+	free(result_matrix);
+
+	std::vector<OperationManager::OpProfile> profile = profiled.get_profile();
+	ASSERT_EQ(profile.size(), 2u);
+
+	const OperationManager::OpProfile &gemm = profile[0];
+	EXPECT_EQ(gemm.name, "MATRIX_MULTIPLICATION");
+	EXPECT_EQ(gemm.rhs_width, cols2);
+	EXPECT_DOUBLE_EQ(gemm.flops, 2.0 * rows2 * cols2 * cols2);
+	EXPECT_EQ(gemm.bytes_moved, 3u * rows2 * cols2 * sizeof(float));
+	EXPECT_GT(gemm.build_seconds, 0.0); // First use compiles mat_mul.cl
+	EXPECT_GT(gemm.write_seconds, 0.0);
+	EXPECT_GT(gemm.kernel_seconds, 0.0);
+	EXPECT_GT(gemm.read_seconds, 0.0);
+	EXPECT_GE(gemm.end_seconds, gemm.start_seconds);
+	EXPECT_EQ(gemm.spans.size(), 4u); // Two writes, one kernel, one read
+
+	EXPECT_EQ(profile[1].name, "INVERSE");
+	EXPECT_GT(profile[1].spans.size(), 3u);
+
+	std::string path = testing::TempDir() + "blitzmat_trace.json";
+	ASSERT_TRUE(profiled.export_chrome_trace(path));
+	std::ifstream trace(path);
+	std::string contents((std::istreambuf_iterator<char>(trace)), std::istreambuf_iterator<char>());
+	EXPECT_NE(contents.find("\"traceEvents\""), std::string::npos);
+	EXPECT_NE(contents.find("\"name\":\"MATRIX_MULTIPLICATION\""), std::string::npos);
+	std::remove(path.c_str());
+
+	profiled.reset_profile();
+	EXPECT_TRUE(profiled.get_profile().empty());
+
+	// Off by default
+	result_matrix = cpuopmanager->single_vector_op(operation_types::TRANSPOSE, matrix1, rows1, cols1);
+	free(result_matrix);
+	EXPECT_TRUE(cpuopmanager->get_profile().empty());
+}
+
+TEST_F(OperationTest, Autotune_Test)
+{
+	char tuning_dir[] = "/tmp/blitzmat_tuning_XXXXXX";
+	ASSERT_NE(mkdtemp(tuning_dir), nullptr);
+
+	OperationManager tuned(OperationManager::device_types::CPU_DEVICE);
+	tuned.set_tuning_dir(tuning_dir);
+	std::string tuning = tuned.autotune(96);
+	EXPECT_EQ(tuning, tuned.tuning_string());
+	EXPECT_NE(tuning.find("gemm tsm="), std::string::npos);
+	ASSERT_FALSE(tuned.tuning_path().empty());
+	EXPECT_EQ(tuned.tuning_path().find(tuning_dir), 0u);
+
+	// A later manager picks the winners up from the file
+	OperationManager loaded(OperationManager::device_types::CPU_DEVICE);
+	ASSERT_TRUE(loaded.load_tuning(tuned.tuning_path()));
+	EXPECT_EQ(loaded.tuning_string(), tuning);
+
+	// Tuned kernels still compute the same results, including ragged edges
+	std::vector<float> lhs(100 * 70), rhs(70 * 90);
+	for (size_t i = 0; i < lhs.size(); i++)
+		lhs[i] = static_cast<float>(i % 7) - 3.0f;
+	for (size_t i = 0; i < rhs.size(); i++)
+		rhs[i] = static_cast<float>(i % 5) - 2.0f;
+	loaded.set_kernel_variant(operation_types::MATRIX_MULTIPLICATION, OperationManager::kernel_variants::OPTIMIZED);
+	result_matrix = loaded.multi_vector_op(operation_types::MATRIX_MULTIPLICATION, lhs.data(), 100, 70, rhs.data(), 70, 90);
+	for (int row = 0; row < 100; row += 9)
+	{
+		for (int col = 0; col < 90; col += 11)
+		{
+			float expected = 0.0f;
+			for (int k = 0; k < 70; k++)
+				expected += lhs[row * 70 + k] * rhs[k * 90 + col];
+			EXPECT_NEAR(result_matrix[row * 90 + col], expected, 1e-3f);
+		}
+	}
+	free(result_matrix);
+	result_matrix = loaded.multi_vector_op(operation_types::ELEM_WISE_ADD, lhs.data(), 100, 70, lhs.data(), 1, 70);
+	EXPECT_FLOAT_EQ(result_matrix[99 * 70 + 69], lhs[99 * 70 + 69] + lhs[69]);
+	free(result_matrix);
+
+	// Files of other devices and unusable parameters are rejected
+	std::string foreign = std::string(tuning_dir) + "/foreign.tune";
+	{
+		std::ofstream file(foreign);
+		file << "device 0000000000000000\n" << tuning;
+	}
+	EXPECT_FALSE(loaded.load_tuning(foreign));
+	std::string device_line;
+	{
+		std::ifstream saved(tuned.tuning_path());
+		while (std::getline(saved, device_line) && device_line.compare(0, 7, "device ") != 0)
+			;
+	}
+	{
+		std::ofstream file(foreign);
+		file << device_line << "\ngemm tsm=64 tsn=64 tsk=6 wptm=4 wptn=4\n"; // tsk must be a multiple of 4
+	}
+	EXPECT_FALSE(loaded.load_tuning(foreign));
+	EXPECT_FALSE(loaded.load_tuning(std::string(tuning_dir) + "/missing.tune"));
+	EXPECT_EQ(loaded.tuning_string(), tuning);
+
+	std::remove(foreign.c_str());
+	std::remove(tuned.tuning_path().c_str());
+	rmdir(tuning_dir);
+}
+
+TEST_F(OperationTest, Zero_Copy_Test)
+{
+	OperationManager zero_copy(OperationManager::device_types::CPU_DEVICE);
+	zero_copy.set_zero_copy(true); // Default on CPU runtimes, forced in case one reports otherwise
+	ASSERT_TRUE(zero_copy.zero_copy_enabled());
+
+	float *lhs = zero_copy.alloc_host(rows2, cols2);
+	float *rhs = zero_copy.alloc_host(rows2, cols2);
+	ASSERT_EQ(reinterpret_cast<uintptr_t>(lhs) % zero_copy.host_alignment(), 0u);
+	std::copy(matrix3, matrix3 + rows2 * cols2, lhs);
+	std::copy(matrix4, matrix4 + rows2 * cols2, rhs);
+
+	// Aligned inputs are used in place, only the result needs a buffer, and it is handed over
+	result_matrix = zero_copy.multi_vector_op(operation_types::ELEM_WISE_MUL, lhs, rows2, cols2, rhs, rows2, cols2);
+	EXPECT_FLOAT_EQ(result_matrix[5], 91 * 5.9f);
+	free(result_matrix);
+	BufferPool::Stats stats = zero_copy.get_pool_stats();
+	EXPECT_EQ(stats.misses, 1u);
+	EXPECT_EQ(stats.bytes_in_use, 0u);
+	EXPECT_EQ(stats.bytes_pooled, 0u);
+
+	// Same results as the copying path, including ops with intermediates and async ops
+	OperationManager copying(OperationManager::device_types::CPU_DEVICE);
+	copying.set_zero_copy(false);
+	for (operation_types op_type : {operation_types::INVERSE, operation_types::TRANSPOSE, operation_types::FROBENIUS_NORM})
+	{
+		float *expected = copying.single_vector_op(op_type, matrix3, rows2, cols2);
+		OpFuture future = zero_copy.single_vector_op_async(op_type, lhs, rows2, cols2);
+		float *actual = future.wait();
+		int count = op_type == operation_types::FROBENIUS_NORM ? 1 : rows2 * cols2;
+		for (int i = 0; i < count; i++)
+			EXPECT_NEAR(actual[i], expected[i], 1e-4f) << operation_name(op_type) << " " << i;
+		free(expected);
+		free(actual);
+	}
+	// Misaligned inputs fall back to a copy
+	result_matrix = zero_copy.multi_vector_op(operation_types::ELEM_WISE_ADD, lhs + 1, rows1, cols1, rhs + 1, rows1, cols1);
+	EXPECT_FLOAT_EQ(result_matrix[0], lhs[1] + rhs[1]);
+	EXPECT_FLOAT_EQ(result_matrix[8], lhs[9] + rhs[9]);
+	free(result_matrix);
+
+	free(lhs);
+	free(rhs);
+}
+
+TEST_F(OperationTest, Output_Buffer_Test)
+{
+	OperationManager native(OperationManager::device_types::NATIVE_CPU);
+	for (OperationManager *manager : {cpuopmanager, &native})
+	{
+		std::pair<int, int> shape = operation_result_shape(operation_types::MATRIX_MULTIPLICATION, rows2, cols2, cols2);
+		std::vector<float> out(static_cast<size_t>(shape.first) * shape.second, -1.0f);
+		manager->multi_vector_op(operation_types::MATRIX_MULTIPLICATION, matrix3, rows2, cols2, matrix4, rows2, cols2, out.data());
+		result_matrix = manager->multi_vector_op(operation_types::MATRIX_MULTIPLICATION, matrix3, rows2, cols2, matrix4, rows2, cols2);
+		for (size_t i = 0; i < out.size(); i++)
+			EXPECT_FLOAT_EQ(out[i], result_matrix[i]);
+		free(result_matrix);
+
+		// Scalar results fill a single float, transposes a width x height block
+		float trace = 0.0f;
+		manager->single_vector_op(operation_types::TRACE, matrix1, rows1, cols1, &trace);
+		EXPECT_FLOAT_EQ(trace, 15.0f);
+		EXPECT_EQ(operation_result_shape(operation_types::TRANSPOSE, 2, 5), std::make_pair(5, 2));
+		std::vector<float> transposed(rows1 * cols1);
+		manager->single_vector_op(operation_types::TRANSPOSE, matrix1, rows1, cols1, transposed.data());
+		EXPECT_FLOAT_EQ(transposed[1], matrix1[3]);
+	}
+}
+
+TEST_F(OperationTest, Concurrent_Threads_Test)
+{
+	float *expected = cpuopmanager->multi_vector_op(operation_types::MATRIX_MULTIPLICATION, matrix3, rows2, cols2, matrix4, rows2, cols2);
+	cpuopmanager->set_max_queues(2);
+
+	// Four threads share two lanes, each mixing host ops with device chains
+	std::vector<int> mismatches(4, 0);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++)
+	{
+		threads.emplace_back([&, t]()
+		{
+			for (int i = 0; i < 20; i++)
+			{
+				float *product = cpuopmanager->multi_vector_op(operation_types::MATRIX_MULTIPLICATION, matrix3, rows2, cols2, matrix4, rows2, cols2);
+				DeviceMatrix lhs = cpuopmanager->from_host(matrix3, rows2, cols2);
+				DeviceMatrix rhs = cpuopmanager->from_host(matrix4, rows2, cols2);
+				DeviceMatrix twice = cpuopmanager->single_vector_op(operation_types::TRANSPOSE,
+																	cpuopmanager->single_vector_op(operation_types::TRANSPOSE,
+																								   cpuopmanager->multi_vector_op(operation_types::MATRIX_MULTIPLICATION, lhs, rhs)));
+				float *chained = twice.to_host();
+				for (int j = 0; j < rows2 * cols2; j++)
+				{
+					if (std::fabs(product[j] - expected[j]) > 1e-3f || std::fabs(chained[j] - expected[j]) > 1e-3f)
+						mismatches[t]++;
+				}
+				free(product);
+				free(chained);
+			}
+		});
+	}
+	for (std::thread &thread : threads)
+		thread.join();
+
+	for (int t = 0; t < 4; t++)
+		EXPECT_EQ(mismatches[t], 0) << "thread " << t;
+	EXPECT_GE(cpuopmanager->queue_count(), 1u);
+	EXPECT_LE(cpuopmanager->queue_count(), 2u);
+	free(expected);
+
+	// Threads sharing a native manager share its thread pool, large enough that every op splits across it
+	OperationManager native(OperationManager::device_types::NATIVE_CPU);
+	const int n = 160;
+	std::vector<float> lhs(n * n), rhs(n * n);
+	for (int i = 0; i < n * n; i++)
+	{
+		lhs[i] = static_cast<float>(i % 13) - 6.0f;
+		rhs[i] = static_cast<float>(i % 7) - 3.0f;
+	}
+	std::unique_ptr<float, decltype(&free)> native_product(
+		native.multi_vector_op(operation_types::MATRIX_MULTIPLICATION, lhs.data(), n, n, rhs.data(), n, n), &free);
+	std::unique_ptr<float, decltype(&free)> native_sum(
+		native.multi_vector_op(operation_types::ELEM_WISE_ADD, lhs.data(), n, n, rhs.data(), n, n), &free);
+	std::fill(mismatches.begin(), mismatches.end(), 0);
+	threads.clear();
+	for (int t = 0; t < 4; t++)
+	{
+		threads.emplace_back([&, t]()
+		{
+			for (int i = 0; i < 20; i++)
+			{
+				float *product = native.multi_vector_op(operation_types::MATRIX_MULTIPLICATION, lhs.data(), n, n, rhs.data(), n, n);
+				float *sum = native.multi_vector_op(operation_types::ELEM_WISE_ADD, lhs.data(), n, n, rhs.data(), n, n);
+				for (int j = 0; j < n * n; j++)
+				{
+					if (product[j] != native_product.get()[j] || sum[j] != native_sum.get()[j])
+						mismatches[t]++;
+				}
+				free(product);
+				free(sum);
+			}
+		});
+	}
+	for (std::thread &thread : threads)
+		thread.join();
+	for (int t = 0; t < 4; t++)
+		EXPECT_EQ(mismatches[t], 0) << "native thread " << t;
+}
+
+TEST_F(OperationTest, Fused_Gemm_Test)
+{
+	std::vector<float> row_bias = {1.0f, -2.0f, 3.0f, -4.0f};
+	std::vector<float> column_bias = {-1.0f, 0.0f, 1.0f, 2.0f};
+	std::vector<float> scale(rows2 * cols2);
+	for (int i = 0; i < rows2 * cols2; i++)
+		scale[i] = 1.0f + 0.1f * i;
+	HostGemmEpilogue epilogue;
+	epilogue.row_bias = row_bias.data();
+	epilogue.column_bias = column_bias.data();
+	epilogue.scale = scale.data();
+	epilogue.clamp = true;
+	epilogue.clamp_min = -100.0f;
+	epilogue.clamp_max = 5000.0f;
+
+	OperationManager native(OperationManager::device_types::NATIVE_CPU);
+	for (OperationManager *manager : {cpuopmanager, &native})
+	{
+		// result = clamp((2 * A * B + 0.5 * C + row_bias + column_bias) * scale)
+		float *product = manager->multi_vector_op(operation_types::MATRIX_MULTIPLICATION, matrix3, rows2, cols2, matrix4, rows2, cols2);
+		std::vector<float> result(matrix4, matrix4 + rows2 * cols2);
+		manager->gemm(2.0f, matrix3, rows2, cols2, matrix4, rows2, cols2, 0.5f, result.data(), epilogue);
+		for (int i = 0; i < rows2; i++)
+		{
+			for (int j = 0; j < cols2; j++)
+			{
+				int idx = i * cols2 + j;
+				float expected = (2.0f * product[idx] + 0.5f * matrix4[idx] + row_bias[j] + column_bias[i]) * scale[idx];
+				expected = std::min(std::max(expected, -100.0f), 5000.0f);
+				EXPECT_NEAR(result[idx], expected, 1e-4f * std::fabs(expected) + 1e-3f) << "at " << idx;
+			}
+		}
+		free(product);
+	}
+
+	// Device variant with only a row bias, and mismatched epilogue shapes
+	DeviceMatrix lhs = cpuopmanager->from_host(matrix3, rows2, cols2);
+	DeviceMatrix rhs = cpuopmanager->from_host(matrix4, rows2, cols2);
+	DeviceMatrix bias = cpuopmanager->from_host(row_bias.data(), 1, cols2);
+	DeviceGemmEpilogue device_epilogue;
+	device_epilogue.row_bias = &bias;
+	float *biased = cpuopmanager->gemm(lhs, rhs, device_epilogue).to_host();
+	float *product = cpuopmanager->multi_vector_op(operation_types::MATRIX_MULTIPLICATION, matrix3, rows2, cols2, matrix4, rows2, cols2);
+	for (int i = 0; i < rows2 * cols2; i++)
+		EXPECT_NEAR(biased[i], product[i] + row_bias[i % cols2], 1e-4f * std::fabs(product[i]) + 1e-3f);
+	free(biased);
+	free(product);
+
+	device_epilogue.row_bias = &lhs;
+	EXPECT_THROW(cpuopmanager->gemm(lhs, rhs, device_epilogue), std::invalid_argument);
+	DeviceMatrix aliased = cpuopmanager->from_host(matrix3, rows2, cols2);
+	EXPECT_THROW(cpuopmanager->gemm(1.0f, aliased, rhs, 1.0f, aliased), std::invalid_argument);
+}
+
+TEST_F(OperationTest, Elementwise_Specialization_Test)
+{
+	EXPECT_EQ(KernelManager::broadcastKind(4, 4, 4, 4), KernelManager::Broadcast::NONE);
+	EXPECT_EQ(KernelManager::broadcastKind(4, 4, 1, 4), KernelManager::Broadcast::ROW);
+	EXPECT_EQ(KernelManager::broadcastKind(4, 4, 4, 1), KernelManager::Broadcast::COLUMN);
+	EXPECT_EQ(KernelManager::broadcastKind(4, 4, 1, 1), KernelManager::Broadcast::SCALAR);
+	EXPECT_EQ(KernelManager::broadcastKind(4, 4, 2, 4), KernelManager::Broadcast::GENERIC);
+
+	// Every broadcast pattern, specialized and fixed-shape, matches the generic kernel
+	cpuopmanager->set_shape_specialization(2);
+	DeviceMatrix lhs = cpuopmanager->from_host(matrix3, rows2, cols2);
+	const std::pair<int, int> rhs_shapes[] = {{4, 4}, {1, 4}, {4, 1}, {1, 1}, {2, 4}, {2, 2}};
+	for (const std::pair<int, int> &shape : rhs_shapes)
+	{
+		DeviceMatrix rhs = cpuopmanager->from_host(matrix4, shape.first, shape.second);
+		cpuopmanager->set_kernel_variant(operation_types::ELEM_WISE_SUB, OperationManager::kernel_variants::REFERENCE);
+		float *expected = cpuopmanager->multi_vector_op(operation_types::ELEM_WISE_SUB, lhs, rhs).to_host();
+		cpuopmanager->set_kernel_variant(operation_types::ELEM_WISE_SUB, OperationManager::kernel_variants::AUTO);
+		for (int call = 0; call < 3; call++)
+		{
+			float *actual = cpuopmanager->multi_vector_op(operation_types::ELEM_WISE_SUB, lhs, rhs).to_host();
+			for (int i = 0; i < rows2 * cols2; i++)
+				EXPECT_FLOAT_EQ(actual[i], expected[i]) << shape.first << "x" << shape.second << " call " << call << " at " << i;
+			free(actual);
+		}
+		free(expected);
+	}
+
+	// A hot shape builds its fixed-size program once, then reuses it
+	DeviceMatrix rhs = cpuopmanager->from_host(matrix4, rows2, cols2);
+	cpuopmanager->reset_cache_stats();
+	DeviceMatrix warm = cpuopmanager->multi_vector_op(operation_types::ELEM_WISE_SUB, lhs, rhs);
+	cpuopmanager->finish();
+	OperationManager::CacheStats stats = cpuopmanager->get_cache_stats();
+	EXPECT_EQ(stats.program_builds + stats.binary_loads, 0u);
+}
+
+TEST_F(OperationTest, Flat_Elementwise_Test)
+{
+	EXPECT_NE(cpuopmanager->tuning_string().find(" vector="), std::string::npos);
+
+	// Sizes below, at and past whole vectors exercise the scalar tail
+	const operation_types op_types[] = {operation_types::ELEM_WISE_ADD, operation_types::ELEM_WISE_SUB,
+										operation_types::ELEM_WISE_MUL, operation_types::ELEM_WISE_DIV};
+	const std::pair<int, int> shapes[] = {{1, 1}, {1, 3}, {3, 3}, {5, 7}, {4, 16}, {33, 65}};
+	for (const std::pair<int, int> &shape : shapes)
+	{
+		std::vector<float> lhs(shape.first * shape.second), rhs(lhs.size());
+		for (size_t i = 0; i < lhs.size(); i++)
+		{
+			lhs[i] = static_cast<float>(i % 11) - 5.0f;
+			rhs[i] = static_cast<float>(i % 7) + 1.0f;
+		}
+		for (operation_types op_type : op_types)
+		{
+			cpuopmanager->set_kernel_variant(op_type, OperationManager::kernel_variants::REFERENCE);
+			float *expected = cpuopmanager->multi_vector_op(op_type, lhs.data(), shape.first, shape.second, rhs.data(), shape.first, shape.second);
+			cpuopmanager->set_kernel_variant(op_type, OperationManager::kernel_variants::AUTO);
+			float *actual = cpuopmanager->multi_vector_op(op_type, lhs.data(), shape.first, shape.second, rhs.data(), shape.first, shape.second);
+			for (size_t i = 0; i < lhs.size(); i++)
+				EXPECT_FLOAT_EQ(actual[i], expected[i]) << operation_name(op_type) << " " << shape.first << "x" << shape.second << " at " << i;
+			free(expected);
+			free(actual);
+		}
+	}
+}
+
+TEST_F(OperationTest, Streaming_Gemm_Test)
+{
+	// Operands in mapped files, streamed through 16 x 16 panels with ragged edges
+	char directory[] = "/tmp/blitzmat_stream_XXXXXX";
+	ASSERT_NE(mkdtemp(directory), nullptr);
+	std::string lhs_path = std::string(directory) + "/lhs.bin";
+	std::string rhs_path = std::string(directory) + "/rhs.bin";
+	std::string result_path = std::string(directory) + "/result.bin";
+	{
+		MappedMatrix lhs = MappedMatrix::create(lhs_path, 70, 50);
+		MappedMatrix rhs = MappedMatrix::create(rhs_path, 50, 90);
+		for (size_t i = 0; i < lhs.size(); i++)
+			lhs.data()[i] = static_cast<float>(i % 7) - 3.0f;
+		for (size_t i = 0; i < rhs.size(); i++)
+			rhs.data()[i] = static_cast<float>(i % 5) - 2.0f;
+	}
+	MappedMatrix lhs = MappedMatrix::open(lhs_path, 70, 50);
+	MappedMatrix rhs = MappedMatrix::open(rhs_path, 50, 90);
+	EXPECT_FALSE(lhs.writable());
+	std::vector<float> expected(70 * 90);
+	cpuopmanager->multi_vector_op(operation_types::MATRIX_MULTIPLICATION, lhs.data(), 70, 50, rhs.data(), 50, 90, expected.data());
+
+	OperationManager native(OperationManager::device_types::NATIVE_CPU);
+	for (OperationManager *manager : {cpuopmanager, &native})
+	{
+		MappedMatrix result = MappedMatrix::create(result_path, 70, 90);
+		manager->streaming_gemm(lhs.data(), 70, 50, rhs.data(), 50, 90, result.data(), 6 * sizeof(float) * 16 * 16);
+		for (size_t i = 0; i < result.size(); i++)
+			EXPECT_NEAR(result.data()[i], expected[i], 1e-3f) << "at " << i;
+	}
+
+	EXPECT_THROW(cpuopmanager->streaming_gemm(lhs.data(), 70, 50, rhs.data(), 40, 90, nullptr), std::invalid_argument);
+	EXPECT_THROW(MappedMatrix::open(lhs_path, 71, 50), std::invalid_argument);
+	std::remove(lhs_path.c_str());
+	std::remove(rhs_path.c_str());
+	std::remove(result_path.c_str());
+	rmdir(directory);
+}
+
+TEST_F(OperationTest, Bmat_File_Test)
+{
+	char directory[] = "/tmp/blitzmat_bmat_XXXXXX";
+	ASSERT_NE(mkdtemp(directory), nullptr);
+	std::string path = std::string(directory) + "/matrix.bmat";
+	std::vector<float> values(37 * 23);
+	for (size_t i = 0; i < values.size(); i++)
+		values[i] = static_cast<float>(i % 11) - 5.0f;
+	MappedMatrix::save_bmat(path, values.data(), 37, 23);
+
+	// Header fields as written, data on its own page
+	BmatHeader header;
+	std::ifstream file(path, std::ios::binary);
+	ASSERT_TRUE(file.read(reinterpret_cast<char *>(&header), sizeof(header)));
+	file.close();
+	EXPECT_EQ(std::string(header.magic, 4), "BMAT");
+	EXPECT_EQ(header.shape[0], 37u);
+	EXPECT_EQ(header.shape[1], 23u);
+	EXPECT_EQ(header.strides[0], 23 * sizeof(float));
+	EXPECT_EQ(header.data_offset % header.alignment, 0u);
+
+	{
+		auto mapped = std::make_shared<const MappedMatrix>(MappedMatrix::open_bmat(path));
+		ASSERT_EQ(mapped->height(), 37);
+		ASSERT_EQ(mapped->width(), 23);
+		EXPECT_TRUE(std::equal(values.begin(), values.end(), mapped->data()));
+		// The upload holds its own reference to the mapping, in chunks that split rows
+		DeviceMatrix matrix = cpuopmanager->from_mapped(mapped, 100 * sizeof(float));
+		mapped.reset();
+		std::unique_ptr<float, decltype(&free)> uploaded(matrix.to_host(), &free);
+		EXPECT_TRUE(std::equal(values.begin(), values.end(), uploaded.get()));
+		if (cpuopmanager->zero_copy_enabled())
+		{
+			// The mapping itself is the buffer, kernels may only read it
+			DeviceMatrix column = cpuopmanager->from_host(values.data(), 37, 1);
+			DeviceMatrix row = cpuopmanager->from_host(values.data(), 1, 23);
+			EXPECT_THROW(cpuopmanager->gemm(1.0f, column, row, 0.0f, matrix), std::invalid_argument);
+		}
+	}
+	DeviceMatrix loaded = cpuopmanager->load_bmat(path);
+	std::unique_ptr<float, decltype(&free)> copied(loaded.to_host(), &free);
+	EXPECT_TRUE(std::equal(values.begin(), values.end(), copied.get()));
+
+	// Data offsets past the end of the file are rejected rather than mapped
+	{
+		std::fstream patch(path, std::ios::binary | std::ios::in | std::ios::out);
+		uint64_t offset = uint64_t(1) << 62;
+		patch.seekp(offsetof(BmatHeader, data_offset));
+		patch.write(reinterpret_cast<const char *>(&offset), sizeof(offset));
+	}
+	EXPECT_THROW(MappedMatrix::open_bmat(path), std::invalid_argument);
+	EXPECT_THROW(MappedMatrix::open(path, 37, 23, uint64_t(1) << 62), std::invalid_argument);
+	EXPECT_THROW(MappedMatrix::open(path, 37, 23, std::numeric_limits<size_t>::max() - 16), std::invalid_argument);
+
+	// Column-major data is rejected, as is a file that is not .bmat
+	{
+		std::fstream patch(path, std::ios::binary | std::ios::in | std::ios::out);
+		uint64_t strides[2] = {sizeof(float), 37 * sizeof(float)};
+		patch.seekp(offsetof(BmatHeader, strides));
+		patch.write(reinterpret_cast<const char *>(strides), sizeof(strides));
+	}
+	EXPECT_THROW(MappedMatrix::open_bmat(path), std::invalid_argument);
+	{
+		std::ofstream patch(path, std::ios::binary | std::ios::in | std::ios::out);
+		patch.write("NOPE", 4);
+	}
+	EXPECT_THROW(MappedMatrix::open_bmat(path), std::invalid_argument);
+	std::remove(path.c_str());
+	rmdir(directory);
 }